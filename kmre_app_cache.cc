@@ -0,0 +1,496 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_app_cache.h"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/syslog.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "kmre_log.h"
+#include "kmre_socket.h"
+#include "kmre_connect_socket.h"
+#include "kmre_singleflight.h"
+
+namespace KmreSocket {
+
+#define APP_CACHE_MIN_CAPACITY (64 * 1024)
+#define APP_CACHE_MAX_CAPACITY (256 * 1024 * 1024)  // 大于该值的容量视为读到了写了一半的头部
+#define APP_CACHE_LOCK_TIMEOUT_MS 3000
+#define APP_CACHE_READ_RETRIES 64
+#define APP_CACHE_VIEW_RETRIES 4    // 读取过程中快照被改写时重新读取的次数
+#define APP_CACHE_INSTALLED_MAX_AGE_MS (60 * 1000)
+#define APP_CACHE_RUNNING_MAX_AGE_MS 2000
+
+// 文件锁的字节范围: 0为刷新锁，1为初始化锁
+enum {
+    eLockByte_Refresh = 0,
+    eLockByte_Init = 1,
+};
+
+static bool ofd_lock(int fd, int byte, short type, bool wait)
+{
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = 1;
+    while (fcntl(fd, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+SharedBlob::DataMap::~DataMap()
+{
+    if (addr) {
+        munmap(const_cast<char *>(addr), size);
+    }
+}
+
+SharedBlob::~SharedBlob()
+{
+    mData.reset();
+    if (mHeader) {
+        munmap(mHeader, APP_CACHE_HEADER_SIZE);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool SharedBlob::open(const std::string &path)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Open '%s' failed: %s", __func__, path.c_str(), strerror(errno));
+        return false;
+    }
+
+    // 可能位于/tmp，只接受本用户的普通文件
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != geteuid()) {
+        KMRE_LOG(LOG_ERR, "[%s] Refuse to use '%s'!", __func__, path.c_str());
+        close(fd);
+        return false;
+    }
+
+    ofd_lock(fd, eLockByte_Init, F_WRLCK, true);
+    if (fstat(fd, &st) == 0 && st.st_size < APP_CACHE_HEADER_SIZE) {
+        if (ftruncate(fd, APP_CACHE_HEADER_SIZE) != 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Resize '%s' failed: %s", __func__, path.c_str(), strerror(errno));
+            ofd_lock(fd, eLockByte_Init, F_UNLCK, false);
+            close(fd);
+            return false;
+        }
+        st.st_size = APP_CACHE_HEADER_SIZE;
+    }
+
+    void *addr = mmap(nullptr, APP_CACHE_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        KMRE_LOG(LOG_ERR, "[%s] mmap '%s' failed: %s", __func__, path.c_str(), strerror(errno));
+        ofd_lock(fd, eLockByte_Init, F_UNLCK, false);
+        close(fd);
+        return false;
+    }
+
+    // 新文件或格式不同的旧文件: 重新初始化头部，文件只增不减，其他进程的映射不会越界
+    AppCacheHeader *header = static_cast<AppCacheHeader *>(addr);
+    if (header->magic != APP_CACHE_MAGIC || header->version != APP_CACHE_VERSION) {
+        header->seq.store(0);
+        header->invalidations.store(0);
+        header->fetchedAt = 0;
+        header->sessionKey = 0;
+        header->updatedUs = 0;
+        header->length = 0;
+        header->capacity = st.st_size - APP_CACHE_HEADER_SIZE;
+        header->version = APP_CACHE_VERSION;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = APP_CACHE_MAGIC;
+    }
+    ofd_lock(fd, eLockByte_Init, F_UNLCK, false);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mFd = fd;
+    mHeader = header;
+    return true;
+}
+
+bool SharedBlob::mapDataLocked(uint64_t capacity)
+{
+    if (mData && capacity <= mData->size) {
+        return true;
+    }
+
+    void *addr = mmap(nullptr, capacity, PROT_READ, MAP_SHARED, mFd, APP_CACHE_HEADER_SIZE);
+    if (addr == MAP_FAILED) {
+        KMRE_LOG(LOG_ERR, "[%s] mmap %llu bytes failed: %s", __func__,
+                 static_cast<unsigned long long>(capacity), strerror(errno));
+        return false;
+    }
+    std::shared_ptr<DataMap> map = std::make_shared<DataMap>();
+    map->addr = static_cast<const char *>(addr);
+    map->size = capacity;
+    mData = map;
+    return true;
+}
+
+bool SharedBlob::validLocked(uint64_t sessionKey, int maxAgeMs, uint64_t &seq, uint64_t &length)
+{
+    for (int tries = 0; tries < APP_CACHE_READ_RETRIES; tries++) {
+        uint64_t before = mHeader->seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const uint64_t capacity = mHeader->capacity;
+        length = mHeader->length;
+        const uint64_t key = mHeader->sessionKey;
+        const uint64_t fetchedAt = mHeader->fetchedAt;
+        const int64_t updatedUs = mHeader->updatedUs;
+        if (capacity > APP_CACHE_MAX_CAPACITY || length > capacity) {
+            continue;
+        }
+        if (length > 0 && !mapDataLocked(capacity)) {
+            return false;
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (mHeader->seq.load(std::memory_order_relaxed) != before) {
+            continue;
+        }
+
+        seq = before;
+        return before != 0 && key == sessionKey &&
+               fetchedAt == mHeader->invalidations.load(std::memory_order_acquire) &&
+               monotonic_us() - updatedUs <= static_cast<int64_t>(maxAgeMs) * 1000;
+    }
+    return false;
+}
+
+bool SharedBlob::read(uint64_t sessionKey, int maxAgeMs, std::string &data)
+{
+    return view(sessionKey, maxAgeMs, [&data](const char *snapshot, int len, const std::function<bool()> &unchanged) {
+        data.assign(snapshot, len);
+        return unchanged();
+    });
+}
+
+bool SharedBlob::view(uint64_t sessionKey, int maxAgeMs, const SnapshotVisitor &visit)
+{
+    for (int tries = 0; tries < APP_CACHE_VIEW_RETRIES; tries++) {
+        uint64_t seq = 0;
+        uint64_t length = 0;
+        std::shared_ptr<const DataMap> map;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mHeader || !validLocked(sessionKey, maxAgeMs, seq, length)) {
+                return false;
+            }
+            map = mData;
+        }
+
+        // 不持有mMutex，visit中可以再访问缓存; 文件只增不减，映射内的读取不会越界
+        auto unchanged = [this, seq]() {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return mHeader->seq.load(std::memory_order_relaxed) == seq;
+        };
+        if (visit(length > 0 ? map->addr : "", static_cast<int>(length), unchanged)) {
+            return true;
+        }
+        if (unchanged()) {
+            return false;// 数据没有被改写，是visit本身失败
+        }
+    }
+    return false;
+}
+
+bool SharedBlob::lockRefresh(int timeoutMs)
+{
+    if (mFd < 0) {
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> lock(mRefreshMutex, std::defer_lock);
+    while (!lock.try_lock()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    // 持锁的进程崩溃时锁自动释放; 等待超时(对方卡在请求上)则不写入，直接请求
+    while (!ofd_lock(mFd, eLockByte_Refresh, F_WRLCK, false)) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    lock.release();
+    return true;
+}
+
+void SharedBlob::unlockRefresh()
+{
+    ofd_lock(mFd, eLockByte_Refresh, F_UNLCK, false);
+    mRefreshMutex.unlock();
+}
+
+uint64_t SharedBlob::invalidations()
+{
+    return mHeader ? mHeader->invalidations.load(std::memory_order_acquire) : 0;
+}
+
+void SharedBlob::invalidate()
+{
+    if (mHeader) {
+        mHeader->invalidations.fetch_add(1, std::memory_order_acq_rel);
+    }
+}
+
+// 调用方持有刷新锁，同一时间只有一个写者
+bool SharedBlob::write(uint64_t sessionKey, uint64_t fetchedAt, const std::string &data)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mHeader) {
+        return false;
+    }
+
+    uint64_t capacity = mHeader->capacity;
+    if (data.size() > capacity) {
+        capacity = std::max<uint64_t>(capacity, APP_CACHE_MIN_CAPACITY);
+        while (capacity < data.size()) {
+            capacity *= 2;
+        }
+        if (capacity > APP_CACHE_MAX_CAPACITY || ftruncate(mFd, APP_CACHE_HEADER_SIZE + capacity) != 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Grow cache to %llu bytes failed!", __func__,
+                     static_cast<unsigned long long>(capacity));
+            return false;
+        }
+    }
+
+    // 上一个写者在两次写seq之间退出时seq停在奇数，不能盲目加1，先按持锁时的值对齐到偶数
+    uint64_t seq = mHeader->seq.load(std::memory_order_relaxed);
+    if (seq & 1) {
+        ++seq;
+    }
+    mHeader->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // 数据区在本进程中是只读映射，经由页缓存写入，其他进程的映射立即可见
+    bool ok = true;
+    for (size_t written = 0; written < data.size();) {
+        ssize_t len = pwrite(mFd, data.data() + written, data.size() - written, APP_CACHE_HEADER_SIZE + written);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            ok = false;
+            break;
+        }
+        written += len;
+    }
+
+    mHeader->capacity = capacity;
+    mHeader->length = ok ? data.size() : 0;
+    mHeader->sessionKey = ok ? sessionKey : 0;
+    mHeader->fetchedAt = fetchedAt;
+    mHeader->updatedUs = monotonic_us();
+    mHeader->seq.store(seq + 2, std::memory_order_release);
+    return ok;
+}
+
+static bool env_disabled()
+{
+    const char *value = getenv("KMRE_APP_CACHE");
+    return value && strcmp(value, "0") == 0;
+}
+
+AppListCache& AppListCache::getInstance()
+{
+    static AppListCache instance;
+    return instance;
+}
+
+AppListCache::AppListCache()
+{
+    mEnabled = !env_disabled();
+    mMaxAgeMs[eAppCache_Installed] = APP_CACHE_INSTALLED_MAX_AGE_MS;
+    mMaxAgeMs[eAppCache_Running] = APP_CACHE_RUNNING_MAX_AGE_MS;
+}
+
+static std::string cache_dir()
+{
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    struct stat st;
+    if (runtime && *runtime && stat(runtime, &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == geteuid()) {
+        return runtime;
+    }
+    return "/tmp";
+}
+
+SharedBlob *AppListCache::blob(AppCacheList list)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mBlobs[list].isOpen()) {
+        return &mBlobs[list];
+    }
+    if (mOpenFailed[list]) {
+        return nullptr;
+    }
+
+    static const char *kSuffix[eAppCache_Count] = {"installed", "running"};
+    std::string path = cache_dir() + "/.kmre-" + get_uid() + "-" + convertUserNameToPath(get_user_name()) +
+                       "-" + kSuffix[list] + ".cache";
+    if (!mBlobs[list].open(path)) {
+        mOpenFailed[list] = true;
+        return nullptr;
+    }
+    return &mBlobs[list];
+}
+
+// 容器重启后socket文件重新创建，inode和ctime随之改变
+bool AppListCache::sessionKey(uint64_t &key)
+{
+    std::string path = get_socket_path(eLink_Launcher);
+    std::string selfPath;
+    if (!get_target_socket_path(0, eLink_Launcher, selfPath) || path != selfPath) {
+        return false;// 其他用户的容器不缓存
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+    key = static_cast<uint64_t>(st.st_ino) * 0x9e3779b97f4a7c15ULL ^
+          (static_cast<uint64_t>(st.st_ctim.tv_sec) * 1000000000ULL + st.st_ctim.tv_nsec);
+    return true;
+}
+
+template <typename T, typename R>
+bool AppListCache::get(AppCacheList list, const T &request, R &reply)
+{
+    uint64_t key = 0;
+    SharedBlob *shared = mEnabled ? blob(list) : nullptr;
+    if (!shared || !sessionKey(key)) {
+        ++mBypassed;
+        return send_command_shared(request, reply) == eCommand_Ok;
+    }
+
+    std::string data;
+    const int maxAgeMs = mMaxAgeMs[list];
+    if (shared->read(key, maxAgeMs, data) && reply.ParseFromString(data)) {
+        ++mHits;
+        return true;
+    }
+
+    // 同时启动的多个进程只有拿到锁的一个去请求，其余等它写完后直接读
+    bool locked = shared->lockRefresh(APP_CACHE_LOCK_TIMEOUT_MS);
+    if (locked && shared->read(key, maxAgeMs, data) && reply.ParseFromString(data)) {
+        shared->unlockRefresh();
+        ++mWaitHits;
+        return true;
+    }
+
+    ++mFetches;
+    const uint64_t fetchedAt = shared->invalidations();
+    bool ok = send_command_shared(request, reply) == eCommand_Ok;
+    if (ok && locked && reply.SerializeToString(&data)) {
+        shared->write(key, fetchedAt, data);
+    }
+    if (locked) {
+        shared->unlockRefresh();
+    }
+    return ok;
+}
+
+bool AppListCache::getInstalled(cn::kylinos::kmre::kmrecore::InstalledAppList &data)
+{
+    cn::kylinos::kmre::kmrecore::GetInstalledAppList obj;
+    obj.set_include_hide_app(true);
+    return get(eAppCache_Installed, obj, data);
+}
+
+bool AppListCache::getRunning(cn::kylinos::kmre::kmrecore::RunningAppList &data)
+{
+    cn::kylinos::kmre::kmrecore::GetRunningAppList obj;
+    obj.set_with_thumbnail(true);
+    return get(eAppCache_Running, obj, data);
+}
+
+bool AppListCache::viewSnapshot(AppCacheList list, const SnapshotVisitor &visit)
+{
+    uint64_t key = 0;
+    SharedBlob *shared = mEnabled ? blob(list) : nullptr;
+    if (shared && sessionKey(key) && shared->view(key, mMaxAgeMs[list], visit)) {
+        ++mHits;
+        return true;
+    }
+    return false;
+}
+
+void AppListCache::invalidate(AppCacheList list)
+{
+    if (list < 0 || list >= eAppCache_Count) {
+        return;
+    }
+    SharedBlob *shared = mEnabled ? blob(list) : nullptr;
+    if (shared) {
+        shared->invalidate();
+    }
+}
+
+void AppListCache::setEnabled(bool enabled)
+{
+    mEnabled = enabled;
+}
+
+void AppListCache::setMaxAge(int installedMs, int runningMs)
+{
+    if (installedMs >= 0) {
+        mMaxAgeMs[eAppCache_Installed] = installedMs;
+    }
+    if (runningMs >= 0) {
+        mMaxAgeMs[eAppCache_Running] = runningMs;
+    }
+}
+
+std::string AppListCache::statsJson()
+{
+    std::string json = std::string("{\"enabled\":") + (mEnabled ? "true" : "false");
+    json += ",\"hits\":" + std::to_string(mHits.load());
+    json += ",\"wait_hits\":" + std::to_string(mWaitHits.load());
+    json += ",\"fetches\":" + std::to_string(mFetches.load());
+    json += ",\"bypassed\":" + std::to_string(mBypassed.load());
+    json += ",\"installed_max_age_ms\":" + std::to_string(mMaxAgeMs[eAppCache_Installed].load());
+    json += ",\"running_max_age_ms\":" + std::to_string(mMaxAgeMs[eAppCache_Running].load()) + "}";
+    return json;
+}
+
+}
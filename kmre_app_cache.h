@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_APP_CACHE_H__
+#define __KMRE_APP_CACHE_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "KmreCore.pb.h"
+
+namespace KmreSocket {
+
+#define APP_CACHE_MAGIC 0x4b4d4143  // "KMAC"
+#define APP_CACHE_VERSION 1
+#define APP_CACHE_HEADER_SIZE 4096  // 头部独占一页，数据区只读映射
+
+typedef enum {
+    eAppCache_Installed = 0,
+    eAppCache_Running,
+    eAppCache_Count,
+}AppCacheList;
+
+// 文件头部; seq为奇数时正在写入，读者前后两次读到相同的偶数才算读到完整的快照
+struct AppCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint64_t> seq;
+    std::atomic<uint64_t> invalidations;    // 任一进程发现列表可能变化时加1
+    uint64_t fetchedAt;                     // 写入的快照是在invalidations为该值时取得的
+    uint64_t sessionKey;                    // launcher socket文件的inode和ctime，容器重启后改变
+    int64_t updatedUs;                      // CLOCK_MONOTONIC，各进程一致
+    uint64_t length;                        // 数据区中有效的字节数(序列化后的回复)
+    uint64_t capacity;                      // 数据区大小，只增不减
+};
+
+// 直接访问映射中的快照: data/len为序列化的回复，不复制; 其他进程可能随时改写数据区，
+// 使用解析出的内容前须调用unchanged()确认读到的仍是同一份快照
+typedef std::function<bool(const char *data, int len, const std::function<bool()> &unchanged)> SnapshotVisitor;
+
+// 一个列表对应一个文件，映射到每个使用者的进程中
+class SharedBlob
+{
+public:
+    SharedBlob() = default;
+    ~SharedBlob();
+
+    bool open(const std::string &path);
+    bool isOpen() const { return mFd >= 0; }
+
+    // 快照有效(会话相同、未失效且未过期)时复制出来
+    bool read(uint64_t sessionKey, int maxAgeMs, std::string &data);
+    // 快照有效时在映射上调用visit并返回其结果，无效时返回false且不调用
+    bool view(uint64_t sessionKey, int maxAgeMs, const SnapshotVisitor &visit);
+    // 跨进程刷新锁，拿不到锁时最多等待timeoutMs
+    bool lockRefresh(int timeoutMs);
+    void unlockRefresh();
+    uint64_t invalidations();
+    bool write(uint64_t sessionKey, uint64_t fetchedAt, const std::string &data);
+    void invalidate();
+
+private:
+    SharedBlob(const SharedBlob&) = delete;
+    SharedBlob& operator=(const SharedBlob&) = delete;
+
+    // 数据区的只读映射，容量增长时换成更大的映射，正在使用旧映射的读者用完后才解除
+    struct DataMap {
+        const char *addr = nullptr;
+        uint64_t size = 0;
+        ~DataMap();
+    };
+
+    bool mapDataLocked(uint64_t capacity);
+    // 读取一致的头部，快照有效时返回true; seq为读到的序号
+    bool validLocked(uint64_t sessionKey, int maxAgeMs, uint64_t &seq, uint64_t &length);
+
+    std::mutex mMutex;          // 保护数据区映射的替换
+    std::mutex mRefreshMutex;   // 文件锁属于打开的文件，同一进程的线程之间另外互斥
+    int mFd = -1;
+    AppCacheHeader *mHeader = nullptr;  // 可写映射，只有头部一页
+    std::shared_ptr<const DataMap> mData;
+};
+
+// 已安装/运行中应用列表的跨进程缓存: 同一用户的多个进程共享一份快照，
+// 只有一个进程向容器请求，其余进程直接读映射的文件，不再经过socket
+class AppListCache
+{
+public:
+    static AppListCache& getInstance();
+
+    bool getInstalled(cn::kylinos::kmre::kmrecore::InstalledAppList &data);
+    bool getRunning(cn::kylinos::kmre::kmrecore::RunningAppList &data);
+    // 快照有效时在映射的快照上调用visit，供流式解析; 无效时返回false，不请求也不等待
+    bool viewSnapshot(AppCacheList list, const SnapshotVisitor &visit);
+
+    // 所有进程的快照在下一次读取时重新请求
+    void invalidate(AppCacheList list);
+    void setEnabled(bool enabled);
+    void setMaxAge(int installedMs, int runningMs);
+    std::string statsJson();
+
+private:
+    AppListCache();
+    AppListCache(const AppListCache&) = delete;
+    AppListCache& operator=(const AppListCache&) = delete;
+
+    template <typename T, typename R>
+    bool get(AppCacheList list, const T &request, R &reply);
+    SharedBlob *blob(AppCacheList list);
+    bool sessionKey(uint64_t &key);
+
+    std::mutex mMutex;// 保护文件的打开
+    SharedBlob mBlobs[eAppCache_Count];
+    bool mOpenFailed[eAppCache_Count] = {};
+    std::atomic<bool> mEnabled{true};
+    std::atomic<int> mMaxAgeMs[eAppCache_Count];
+
+    std::atomic<uint64_t> mHits{0};
+    std::atomic<uint64_t> mWaitHits{0};  // 等待其他进程刷新后命中
+    std::atomic<uint64_t> mFetches{0};
+    std::atomic<uint64_t> mBypassed{0};  // 缓存不可用或访问的是其他用户的容器
+};
+
+}
+
+#endif // __KMRE_APP_CACHE_H__
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_app_snapshot.h"
+
+#include <unordered_set>
+
+namespace KmreSocket {
+
+#define MAX_REMOVED_RECORDS 256
+
+InstalledAppSnapshot& InstalledAppSnapshot::getInstance()
+{
+    static InstalledAppSnapshot instance;
+    return instance;
+}
+
+void InstalledAppSnapshot::update(const cn::kylinos::kmre::kmrecore::InstalledAppList &list)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    const uint64_t nextGen = mGeneration + 1;
+    bool changed = false;
+    std::unordered_set<std::string> present;
+    present.reserve(list.item_size());
+
+    for (int n = 0; n < list.item_size(); n++) {
+        const auto &app = list.item(n);
+        present.insert(app.package_name());
+
+        auto it = mApps.find(app.package_name());
+        if (it == mApps.end() || it->second.removed) {
+            Entry &entry = mApps[app.package_name()];
+            if (entry.removed) {
+                --mRemovedCount;
+            }
+            entry.info.appName = app.app_name();
+            entry.info.packageName = app.package_name();
+            entry.info.versionCode = app.version_code();
+            entry.info.versionName = app.version_name();
+            entry.addedGen = entry.changedGen = nextGen;
+            entry.removed = false;
+            changed = true;
+        }
+        else if (it->second.info.versionCode != app.version_code() ||
+                 it->second.info.versionName != app.version_name() ||
+                 it->second.info.appName != app.app_name()) {
+            it->second.info.appName = app.app_name();
+            it->second.info.versionCode = app.version_code();
+            it->second.info.versionName = app.version_name();
+            it->second.changedGen = nextGen;
+            changed = true;
+        }
+    }
+
+    for (auto &app : mApps) {
+        if (!app.second.removed && present.find(app.first) == present.end()) {
+            app.second.removed = true;
+            app.second.changedGen = nextGen;
+            ++mRemovedCount;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        mGeneration = nextGen;
+        pruneRemovedLocked();
+    }
+}
+
+// 删除记录过多时全部清理，之后早于当前generation的查询会得到reset
+void InstalledAppSnapshot::pruneRemovedLocked()
+{
+    if (mRemovedCount <= MAX_REMOVED_RECORDS) {
+        return;
+    }
+
+    for (auto it = mApps.begin(); it != mApps.end();) {
+        if (it->second.removed) {
+            it = mApps.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    mRemovedCount = 0;
+    mPrunedGeneration = mGeneration;
+}
+
+uint64_t InstalledAppSnapshot::generation()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mGeneration;
+}
+
+InstalledAppDelta InstalledAppSnapshot::changesSince(uint64_t generation)
+{
+    InstalledAppDelta delta;
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    delta.generation = mGeneration;
+    if (generation > mGeneration || generation < mPrunedGeneration) {// 快照已重建或删除记录已清理
+        delta.reset = true;
+        generation = 0;
+    }
+
+    for (const auto &app : mApps) {
+        const Entry &entry = app.second;
+        if (entry.changedGen <= generation) {
+            continue;
+        }
+
+        if (entry.removed) {
+            if (entry.addedGen <= generation) {
+                delta.removed.push_back(app.first);
+            }
+        }
+        else if (entry.addedGen > generation) {
+            delta.added.push_back(entry.info);
+        }
+        else {
+            delta.updated.push_back(entry.info);
+        }
+    }
+
+    return delta;
+}
+
+}
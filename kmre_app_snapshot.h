@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_APP_SNAPSHOT_H__
+#define __KMRE_APP_SNAPSHOT_H__
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "KmreCore.pb.h"
+
+namespace KmreSocket {
+
+struct InstalledAppInfo {
+    std::string appName;
+    std::string packageName;
+    int64_t versionCode = 0;
+    std::string versionName;
+};
+
+struct InstalledAppDelta {
+    uint64_t generation = 0;
+    bool reset = false;// 请求的generation太旧，added中为全部应用，调用者需重建列表
+    std::vector<InstalledAppInfo> added;
+    std::vector<InstalledAppInfo> updated;
+    std::vector<std::string> removed;
+};
+
+// 已安装应用列表的本地快照，每次内容发生变化generation加1，
+// 每个应用记录其最近一次新增/更新/删除时的generation
+class InstalledAppSnapshot
+{
+public:
+    static InstalledAppSnapshot& getInstance();
+
+    void update(const cn::kylinos::kmre::kmrecore::InstalledAppList &list);
+    uint64_t generation();
+    InstalledAppDelta changesSince(uint64_t generation);
+
+private:
+    InstalledAppSnapshot() = default;
+    InstalledAppSnapshot(const InstalledAppSnapshot&) = delete;
+    InstalledAppSnapshot& operator=(const InstalledAppSnapshot&) = delete;
+
+    struct Entry {
+        InstalledAppInfo info;
+        uint64_t addedGen = 0;
+        uint64_t changedGen = 0;// 最近一次新增、更新或删除
+        bool removed = false;
+    };
+
+    void pruneRemovedLocked();
+
+    std::mutex mMutex;
+    std::unordered_map<std::string, Entry> mApps;
+    uint64_t mGeneration = 0;
+    uint64_t mPrunedGeneration = 0;// 早于此generation的删除记录已被清理
+    size_t mRemovedCount = 0;
+};
+
+}
+
+#endif // __KMRE_APP_SNAPSHOT_H__
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_app_stats.h"
+
+#include <string.h>
+#include <algorithm>
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+AppStatsTable& AppStatsTable::getInstance()
+{
+    static AppStatsTable instance;
+    return instance;
+}
+
+void AppStatsTable::update(const cn::kylinos::kmre::kmrecore::AppStatsList &list, bool pushed)
+{
+    const int64_t now = monotonic_us();
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLatest = list;
+    mHasLatest = true;
+    mReceivedUs = now;
+    if (pushed) {
+        mLastPushUs = now;
+        ++mPushes;
+    }
+    else {
+        ++mQueries;
+    }
+}
+
+void AppStatsTable::setPushInterval(int intervalMs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPushIntervalMs = intervalMs > 0 ? intervalMs : 0;
+    mLastPushUs = 0;// 只信任新间隔下的推送
+}
+
+bool AppStatsTable::freshPushed(const std::string &pkgname, std::vector<KmreAppStats> &entries)
+{
+    const int64_t now = monotonic_us();
+    std::lock_guard<std::mutex> lock(mMutex);
+    // 允许一次推送丢失或延迟
+    if (mPushIntervalMs <= 0 || mLastPushUs == 0 || now - mLastPushUs > 2000LL * mPushIntervalMs) {
+        return false;
+    }
+
+    toEntries(mLatest, pkgname, (now - mReceivedUs) / 1000, entries);
+    ++mPushHits;
+    return true;
+}
+
+void AppStatsTable::toEntries(const cn::kylinos::kmre::kmrecore::AppStatsList &list, const std::string &pkgname,
+                              int64_t ageMs, std::vector<KmreAppStats> &entries)
+{
+    entries.clear();
+    entries.reserve(list.item_size());
+    for (const auto &item : list.item()) {
+        if (!pkgname.empty() && item.package_name() != pkgname) {
+            continue;
+        }
+
+        KmreAppStats entry;
+        memset(&entry, 0, sizeof(entry));
+        strncpy(entry.package_name, item.package_name().c_str(), APP_STATS_PKG_MAX - 1);
+        entry.pid = item.pid();
+        entry.cpu_permille = item.cpu_permille();
+        entry.rss_kb = item.rss_kb();
+        entry.pss_kb = item.pss_kb();
+        entry.foreground = item.foreground() ? 1 : 0;
+        entry.display_id = item.has_display_id() ? item.display_id() : -1;
+        entry.age_ms = ageMs;
+        entries.push_back(entry);
+    }
+
+    // 内存占用大的排在前面，调用方缓冲区不够时截掉的是占用小的应用
+    std::stable_sort(entries.begin(), entries.end(), [](const KmreAppStats &a, const KmreAppStats &b) {
+        return a.pss_kb > b.pss_kb;
+    });
+}
+
+std::string AppStatsTable::statsJson()
+{
+    const int64_t now = monotonic_us();
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::string json = "{\"push_interval_ms\":" + std::to_string(mPushIntervalMs);
+    json += ",\"pushes\":" + std::to_string(mPushes);
+    json += ",\"queries\":" + std::to_string(mQueries);
+    json += ",\"push_hits\":" + std::to_string(mPushHits);
+    json += ",\"last_push_age_ms\":" + std::to_string(mLastPushUs ? (now - mLastPushUs) / 1000 : -1);
+    if (mHasLatest) {
+        json += ",\"timestamp_ms\":" + std::to_string(mLatest.timestamp_ms());
+        json += ",\"apps\":" + std::to_string(mLatest.item_size());
+        json += ",\"mem_total_kb\":" + std::to_string(mLatest.mem_total_kb());
+        json += ",\"mem_available_kb\":" + std::to_string(mLatest.mem_available_kb());
+    }
+    json += "}";
+    return json;
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_APP_STATS_H__
+#define __KMRE_APP_STATS_H__
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "KmreCore.pb.h"
+
+#define APP_STATS_PKG_MAX 128
+
+// kmre_get_app_stats 返回的每个应用的资源占用，C接口直接使用
+typedef struct {
+    char package_name[APP_STATS_PKG_MAX];
+    int pid;
+    int cpu_permille;       // 上一个采样周期的cpu占用，千分比，单核满载为1000
+    long long rss_kb;
+    long long pss_kb;
+    int foreground;         // 1:前台
+    int display_id;         // 未知时为-1
+    long long age_ms;       // 本地收到该数据距今的时间
+}KmreAppStats;
+
+namespace KmreSocket {
+
+// 保存安卓最近一次上报的应用资源占用(查询回复或定时推送)，
+// 推送打开且数据未过期时查询直接使用本地数据，不再请求安卓
+class AppStatsTable
+{
+public:
+    static AppStatsTable& getInstance();
+
+    // 查询回复和推送的AppStatsList都经这里更新，pushed标记数据来源
+    void update(const cn::kylinos::kmre::kmrecore::AppStatsList &list, bool pushed);
+
+    // 推送间隔，0为关闭，由kmre_set_app_stats_push在命令发送成功后设置
+    void setPushInterval(int intervalMs);
+
+    // 推送打开且最近一次推送不超过两个间隔时返回true并填充entries(按pss从大到小排列)
+    bool freshPushed(const std::string &pkgname, std::vector<KmreAppStats> &entries);
+
+    // 把AppStatsList转换为按pss从大到小排列的表，pkgname不为空时只保留该应用
+    static void toEntries(const cn::kylinos::kmre::kmrecore::AppStatsList &list, const std::string &pkgname,
+                          int64_t ageMs, std::vector<KmreAppStats> &entries);
+
+    std::string statsJson();
+
+private:
+    AppStatsTable() = default;
+    AppStatsTable(const AppStatsTable&) = delete;
+    AppStatsTable& operator=(const AppStatsTable&) = delete;
+
+    std::mutex mMutex;
+    cn::kylinos::kmre::kmrecore::AppStatsList mLatest;
+    bool mHasLatest = false;
+    int64_t mReceivedUs = 0;        // 本地收到mLatest的时间
+    int mPushIntervalMs = 0;
+    int64_t mLastPushUs = 0;
+    uint64_t mPushes = 0;
+    uint64_t mQueries = 0;
+    uint64_t mPushHits = 0;
+};
+
+}
+
+#endif // __KMRE_APP_STATS_H__
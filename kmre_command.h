@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_COMMAND_H__
+#define __KMRE_COMMAND_H__
+
+#include <type_traits>
+
+#include "KmreCore.pb.h"
+#include "kmre_socket.h"
+#include "kmre_scheduler.h"
+
+namespace KmreSocket {
+
+namespace kmrecore = cn::kylinos::kmre::kmrecore;
+
+// 无回复的命令，服务端收到后直接关闭连接
+struct NoReply {};
+
+// 命令登记表，与 KmreCore.proto 中的 head 注释一一对应，新增命令只需在此添加一行
+// X(消息类型, 命令编号, 连接, 回复类型, 优先级, 收发超时(秒，0为不设置), 是否可走共享内存控制通道)
+#define KMRE_COMMAND_LIST(X) \
+    X(InstallApp,           1, eLink_Launcher, kmrecore::ActionResult,     ePriority_Bulk,        0, false) \
+    X(UninstallApp,         2, eLink_Launcher, kmrecore::ActionResult,     ePriority_Bulk,        0, false) \
+    X(LaunchApp,            3, eLink_Launcher, kmrecore::ActionResult,     ePriority_Interactive, 0, false) \
+    X(CloseApp,             4, eLink_Launcher, kmrecore::ActionResult,     ePriority_Interactive, 0, false) \
+    X(GetInstalledAppList,  5, eLink_Launcher, kmrecore::InstalledAppList, ePriority_Bulk,        0, false) \
+    X(GetRunningAppList,    6, eLink_Launcher, kmrecore::RunningAppList,   ePriority_Interactive, 0, false) \
+    X(SetClipboard,         7, eLink_Manager,  NoReply,                    ePriority_Interactive, 0, false) \
+    X(FocusWin,             8, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, true)  \
+    X(ControlApp,           9, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, true)  \
+    X(InsertFile,          10, eLink_Manager,  NoReply,                    ePriority_Bulk,        0, false) \
+    X(RemoveFile,          11, eLink_Manager,  NoReply,                    ePriority_Bulk,        0, false) \
+    X(RequestMediaFiles,   12, eLink_Manager,  NoReply,                    ePriority_Bulk,        0, false) \
+    X(DragFile,            13, eLink_Manager,  NoReply,                    ePriority_Interactive, 0, false) \
+    X(RotationChanged,     14, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, true)  \
+    X(SetSystemProp,       15, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, false) \
+    X(GetSystemProp,       16, eLink_Launcher, kmrecore::SendSystemProp,   ePriority_Interactive, 2, false) \
+    X(UpdateAppWindowSize, 17, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, true)  \
+    X(SetProxy,            18, eLink_Manager,  NoReply,                    ePriority_Interactive, 0, false) \
+    X(UpdateDisplaySize,   19, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, true)  \
+    X(AnswerCall,          20, eLink_Manager,  NoReply,                    ePriority_Interactive, 0, false) \
+    X(OpenControlRing,     21, eLink_Launcher, kmrecore::ActionResult,     ePriority_Interactive, 2, false) \
+    X(GetAppStats,         22, eLink_Launcher, kmrecore::AppStatsList,     ePriority_Interactive, 2, false) \
+    X(SetAppStatsPush,     23, eLink_Launcher, NoReply,                    ePriority_Interactive, 0, false)
+
+// 未登记的消息类型在编译期报错
+template <typename T>
+struct CommandTraits;
+
+#define KMRE_COMMAND_TRAITS(Message, Index, Link, Reply, Priority, TimeoutSec, ControlRing) \
+    template <> \
+    struct CommandTraits<kmrecore::Message> { \
+        typedef Reply ReplyType; \
+        static constexpr int kIndex = Index; \
+        static constexpr SocketLink kLink = Link; \
+        static constexpr RequestPriority kPriority = Priority; \
+        static constexpr bool kHasReply = !std::is_same<Reply, NoReply>::value; \
+        static constexpr int kTimeoutSec = TimeoutSec; \
+        static constexpr bool kControlRing = ControlRing; \
+    };
+
+KMRE_COMMAND_LIST(KMRE_COMMAND_TRAITS)
+
+#undef KMRE_COMMAND_TRAITS
+
+}
+
+#endif // __KMRE_COMMAND_H__
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_CONNECT_SOCKET_H__
+#define __KMRE_CONNECT_SOCKET_H__
+
+#include <string>
+#include <vector>
+#include <sys/syslog.h>
+
+#include "KmreCore.pb.h"
+#include "kmre_socket.h"
+#include "kmre_log.h"
+#include "kmre_scheduler.h"
+#include "kmre_command.h"
+#include "kmre_shm_ring.h"
+#include "kmre_trace.h"
+#include "kmre_list_stream.h"
+#include "kmre_probe.h"
+
+namespace KmreSocket {
+
+// 命令编号、连接、回复类型、优先级和超时均由 CommandTraits<T> 在编译期确定
+template <typename T>
+class ConnectSocket
+{
+public:
+    typedef CommandTraits<T> Traits;
+    typedef typename Traits::ReplyType R;
+
+    ConnectSocket() : mSocketPath(resolvePath()) {}
+
+    ~ConnectSocket() {
+        if (mSocketFd > 0) {
+            close(mSocketFd);
+        }
+        mSocketFd = -1;
+    }
+
+    bool connect() {
+        if (!file_is_exists(mSocketPath.c_str())) {
+            KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, eSpan_Resolve, errno);
+            KMRE_LOG(LOG_ERR, "[%s] Can't find socket file:'%s'!", __func__, mSocketPath.c_str());
+            return false;
+        }
+
+        // 批量命令在此排队等待交互命令完成; 名额在请求发出(或失败析构)时释放，不在读取回复期间占用
+        TraceSpan scheduleSpan(eSpan_Schedule, Traits::kIndex);
+        mTicket.acquire(Traits::kPriority);
+        scheduleSpan.end();
+
+        if (Traits::kLink == eLink_Launcher) {
+            mRingFence.enter(mSocketPath);
+        }
+
+        TraceSpan connectSpan(eSpan_Connect, Traits::kIndex);
+        KMRE_PROBE_CONNECT_START(Traits::kIndex, Traits::kLink);
+        mSocketFd = connect_socket(mSocketPath.c_str());
+        if (mSocketFd < 0) {
+            connectSpan.setFailed();
+            KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, eSpan_Connect, errno);
+            KMRE_LOG(LOG_ERR, "[%s] Create socket:'%s' or connect server failed!", __func__, mSocketPath.c_str());
+            return false;
+        }
+        KMRE_PROBE_CONNECT_DONE(Traits::kIndex, Traits::kLink, mSocketFd);
+        if (Traits::kTimeoutSec > 0) {
+            return setTimeout(Traits::kTimeoutSec, Traits::kTimeoutSec);
+        }
+        return true;
+    }
+
+    bool setTimeout(int sendTimeout = 2, int rcvTimeout = 2) {// default timeout: 2s
+        if (mSocketFd < 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
+            return false;
+        }
+        
+        if (set_timeout(mSocketFd, sendTimeout, rcvTimeout) != 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Set socket timeout failed!", __func__);
+            return false;
+        }
+        return true;
+    }
+
+    bool sendData(const T &data) {
+        if (mSocketFd < 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
+            return false;
+        }
+
+        // 只计算一次大小，序列化到本线程复用的缓冲区，命令头和消息体一次sendmsg发出
+        const size_t content_size = data.ByteSizeLong();
+        unsigned char header_bytes[4];
+        encode_cmd_header(Traits::kIndex, header_bytes);
+        std::string &send_buffer = thread_send_buffer();
+        TraceSpan serializeSpan(eSpan_Serialize, Traits::kIndex);
+        serializeSpan.setBytes(content_size);
+        send_buffer.resize(content_size);
+        data.SerializeWithCachedSizesToArray(reinterpret_cast<std::uint8_t *>(&send_buffer[0]));
+        serializeSpan.end();
+
+        TraceSpan writeSpan(eSpan_Write, Traits::kIndex);
+        writeSpan.setBytes(sizeof(header_bytes) + content_size);
+        int ret = write_fully_vectored(mSocketFd, header_bytes, sizeof(header_bytes), send_buffer.data(), content_size);
+        trim_thread_send_buffer();
+        if (ret < 0) {
+            writeSpan.setFailed();
+            KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, eSpan_Write, errno);
+            KMRE_LOG(LOG_ERR, "[%s] Write data to server failed!", __func__);            
+            return false;
+        }
+        KMRE_PROBE_SEND(Traits::kIndex, Traits::kLink, sizeof(header_bytes) + content_size);
+        mTicket.reset();
+        return true;
+    }
+
+    bool readData(R &data) {
+        if (mSocketFd < 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
+            return false;
+        }
+
+        // 服务端回复后关闭连接，读到EOF为止; 使用本线程复用的缓冲区，不逐块realloc
+        std::string &buf = thread_recv_buffer();
+        TraceSpan readSpan(eSpan_Read, Traits::kIndex);
+        ssize_t totalSize = read_until_eof(mSocketFd, buf);
+        readSpan.setBytes(totalSize);
+        if (totalSize < 0) {
+            readSpan.setFailed();
+            KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, eSpan_Read, errno);
+        }
+        else {
+            KMRE_PROBE_REPLY(Traits::kIndex, Traits::kLink, totalSize);
+        }
+        readSpan.end();
+
+        bool ok = false;
+        if (totalSize >= 0) {
+            TraceSpan parseSpan(eSpan_Parse, Traits::kIndex);
+            parseSpan.setBytes(totalSize);
+            ok = data.ParseFromArray(buf.data(), static_cast<int>(totalSize));
+            if (!ok) {
+                parseSpan.setFailed();
+                KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, eSpan_Parse, 0);
+            }
+            else {
+                KMRE_PROBE_PARSE_DONE(Traits::kIndex, Traits::kLink, totalSize);
+            }
+        }
+        trim_thread_recv_buffer();
+        if (!ok) {
+            KMRE_LOG(LOG_ERR, "[%s] Read or parse reply failed(%zd bytes)!", __func__, totalSize);
+        }
+        return ok;
+    }
+
+    // 边读边解析列表回复，每收到一个完整的item调用一次onItem，不等待整个回复，也不缓存整个回复
+    template <typename Item>
+    bool readStream(int itemField, R &envelope, const std::function<bool(const Item&)> &onItem) {
+        if (mSocketFd < 0) {
+            KMRE_LOG(LOG_ERR, "[%s] Invalid socket fd!", __func__);
+            return false;
+        }
+
+        TraceSpan readSpan(eSpan_Read, Traits::kIndex);
+        google::protobuf::io::FileInputStream stream(mSocketFd, LIST_STREAM_BLOCK_SIZE);
+        bool ok = parse_list_stream(&stream, itemField, envelope, onItem);
+        readSpan.setBytes(stream.ByteCount());
+        if (!ok) {
+            readSpan.setFailed();
+            KMRE_PROBE_ERROR(Traits::kIndex, Traits::kLink, stream.GetErrno() ? eSpan_Read : eSpan_Parse,
+                             stream.GetErrno());
+            KMRE_LOG(LOG_ERR, "[%s] Read or parse reply stream failed(%lld bytes, errno %d)!", __func__,
+                     static_cast<long long>(stream.ByteCount()), stream.GetErrno());
+            return false;
+        }
+        KMRE_PROBE_REPLY(Traits::kIndex, Traits::kLink, stream.ByteCount());
+        KMRE_PROBE_PARSE_DONE(Traits::kIndex, Traits::kLink, stream.ByteCount());
+        return true;
+    }
+
+private:
+    // 引用本线程缓存的路径，构造和发送都不复制字符串
+    static const std::string& resolvePath() {
+        TraceSpan span(eSpan_Resolve, Traits::kIndex);
+        return get_socket_path(Traits::kLink);
+    }
+
+    const std::string &mSocketPath;
+    int mSocketFd = -1;
+    ScheduleTicket mTicket;
+    ControlRingFence mRingFence;// 在socket关闭后释放
+};
+
+typedef enum {
+    eCommand_Ok = 0,
+    eCommand_SendFailed,    // 连接或发送失败
+    eCommand_ReadFailed,    // 已发出，读取回复失败
+}CommandStatus;
+
+// 发送无回复的命令，登记为可走控制通道的命令优先通过共享内存发送;
+// viaControlRing不为空时给出是否经控制通道发出(此时只是写入了缓冲区，对端尚未确认)
+template <typename T>
+CommandStatus send_command(const T &data, bool *viaControlRing = nullptr)
+{
+    static_assert(!CommandTraits<T>::kHasReply, "command has a reply, use send_command(data, reply)");
+    static_assert(!CommandTraits<T>::kControlRing || CommandTraits<T>::kLink == eLink_Launcher,
+                  "control ring only reaches the launcher");
+
+    TraceSpan span(eSpan_Command, CommandTraits<T>::kIndex);
+    const bool ring = CommandTraits<T>::kControlRing &&
+                      ControlRingManager::getInstance().send(CommandTraits<T>::kIndex, data);
+    if (viaControlRing) {
+        *viaControlRing = ring;
+    }
+    if (ring) {
+        return eCommand_Ok;
+    }
+
+    ConnectSocket<T> connectSocket;
+    if (!connectSocket.connect() || !connectSocket.sendData(data)) {
+        span.setFailed();
+        return eCommand_SendFailed;
+    }
+    return eCommand_Ok;
+}
+
+// 发送命令并读取回复
+template <typename T>
+CommandStatus send_command(const T &data, typename CommandTraits<T>::ReplyType &reply)
+{
+    static_assert(CommandTraits<T>::kHasReply, "command has no reply, use send_command(data)");
+
+    TraceSpan span(eSpan_Command, CommandTraits<T>::kIndex);
+    ConnectSocket<T> connectSocket;
+    if (!connectSocket.connect() || !connectSocket.sendData(data)) {
+        span.setFailed();
+        return eCommand_SendFailed;
+    }
+    if (!connectSocket.readData(reply)) {
+        span.setFailed();
+        return eCommand_ReadFailed;
+    }
+    return eCommand_Ok;
+}
+
+}
+
+#endif // __KMRE_CONNECT_SOCKET_H__
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_display_registry.h"
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+DisplayRegistry& DisplayRegistry::getInstance()
+{
+    static DisplayRegistry instance;
+    return instance;
+}
+
+void DisplayRegistry::setSuppressEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mSuppressMode = enabled ? eSuppress_On : eSuppress_Off;
+}
+
+DisplayRegistry::Container& DisplayRegistry::containerLocked()
+{
+    return mContainers[get_socket_path(eLink_Launcher)];
+}
+
+DisplayRegistry::Container* DisplayRegistry::findContainerLocked()
+{
+    auto it = mContainers.find(get_socket_path(eLink_Launcher));
+    return (it == mContainers.end()) ? nullptr : &it->second;
+}
+
+// 返回nullptr时该display没有记录，或当前容器不允许跳过更新
+const DisplayRegistry::DisplayState* DisplayRegistry::findDisplayLocked(int displayId)
+{
+    Container *container = findContainerLocked();
+    if (!container || mSuppressMode == eSuppress_Off || (mSuppressMode == eSuppress_Auto && !container->eventsFed)) {
+        return nullptr;
+    }
+    auto it = container->displays.find(displayId);
+    return (it == container->displays.end()) ? nullptr : &it->second;
+}
+
+bool DisplayRegistry::suppressLocked(bool redundant)
+{
+    if (redundant) {
+        ++mSuppressed;
+        return true;
+    }
+    return false;
+}
+
+bool DisplayRegistry::isRedundantRotation(int displayId, const std::string &pkgname, int width, int height, int rotation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const DisplayState *state = findDisplayLocked(displayId);
+    if (!state) {
+        return false;
+    }
+
+    Size size;
+    size.width = width;
+    size.height = height;
+    return suppressLocked(state->hasRotation && state->rotationPkg == pkgname &&
+                          state->rotationSize == size && state->rotation == rotation);
+}
+
+bool DisplayRegistry::isRedundantWindowSize(int displayId, const std::string &pkgname, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const DisplayState *state = findDisplayLocked(displayId);
+    if (!state) {
+        return false;
+    }
+
+    Size size;
+    size.width = width;
+    size.height = height;
+    return suppressLocked(state->hasWindowSize && state->windowSizePkg == pkgname && state->windowSize == size);
+}
+
+bool DisplayRegistry::isRedundantDisplaySize(int displayId, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    const DisplayState *state = findDisplayLocked(displayId);
+    if (!state) {
+        return false;
+    }
+
+    Size size;
+    size.width = width;
+    size.height = height;
+    return suppressLocked(state->hasDisplaySize && state->displaySize == size);
+}
+
+// 同一个应用只显示在一个display上
+void DisplayRegistry::bindPackageLocked(Container &container, int displayId, const std::string &pkgname)
+{
+    if (pkgname.empty()) {
+        return;
+    }
+    for (auto &item : container.displays) {
+        if (item.first != displayId && item.second.pkgname == pkgname) {
+            item.second.pkgname.clear();
+        }
+    }
+    container.displays[displayId].pkgname = pkgname;
+}
+
+void DisplayRegistry::forgetPackageLocked(Container &container, const std::string &pkgname)
+{
+    for (auto it = container.displays.begin(); it != container.displays.end();) {
+        if (it->second.pkgname == pkgname) {
+            it = container.displays.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    container.launches.erase(pkgname);
+}
+
+void DisplayRegistry::onRotationSent(int displayId, const std::string &pkgname, int width, int height, int rotation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container &container = containerLocked();
+    bindPackageLocked(container, displayId, pkgname);
+    DisplayState &state = container.displays[displayId];
+    state.hasRotation = true;
+    state.rotationPkg = pkgname;
+    state.rotationSize.width = width;
+    state.rotationSize.height = height;
+    state.rotation = rotation;
+}
+
+void DisplayRegistry::onWindowSizeSent(int displayId, const std::string &pkgname, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container &container = containerLocked();
+    bindPackageLocked(container, displayId, pkgname);
+    DisplayState &state = container.displays[displayId];
+    state.hasWindowSize = true;
+    state.windowSizePkg = pkgname;
+    state.windowSize.width = width;
+    state.windowSize.height = height;
+}
+
+void DisplayRegistry::onDisplaySizeSent(int displayId, int width, int height)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    DisplayState &state = containerLocked().displays[displayId];
+    state.hasDisplaySize = true;
+    state.displaySize.width = width;
+    state.displaySize.height = height;
+}
+
+void DisplayRegistry::onLaunchAcked(const std::string &pkgname, bool fullscreen, int width, int height, int density)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    LaunchParams &params = containerLocked().launches[pkgname];
+    params.fullscreen = fullscreen;
+    params.size.width = width;
+    params.size.height = height;
+    params.density = density;
+}
+
+void DisplayRegistry::onAppClosed(const std::string &pkgname)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container *container = findContainerLocked();
+    if (container) {
+        forgetPackageLocked(*container, pkgname);
+    }
+}
+
+void DisplayRegistry::onLaunchResult(const cn::kylinos::kmre::kmrecore::LaunchResult &result)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container &container = containerLocked();
+    container.eventsFed = true;
+    container.launches.erase(result.package_name());
+    if (!result.result()) {
+        return;
+    }
+
+    // 新窗口，之前发出的窗口参数不再可信，下一次更新必须发出
+    const int displayId = result.display_id();
+    container.displays.erase(displayId);
+    bindPackageLocked(container, displayId, result.package_name());
+    DisplayState &state = container.displays[displayId];
+    state.size.width = result.width();
+    state.size.height = result.height();
+    state.density = result.density();
+    state.fullscreen = result.fullscreen();
+}
+
+void DisplayRegistry::onCloseResult(const cn::kylinos::kmre::kmrecore::CloseResult &result)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container &container = containerLocked();
+    container.eventsFed = true;
+    if (result.result()) {
+        forgetPackageLocked(container, result.package_name());
+    }
+}
+
+bool DisplayRegistry::packageOnDisplay(int displayId, std::string &pkgname)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container *container = findContainerLocked();
+    if (!container) {
+        return false;
+    }
+    auto it = container->displays.find(displayId);
+    if (it == container->displays.end() || it->second.pkgname.empty()) {
+        return false;
+    }
+    pkgname = it->second.pkgname;
+    return true;
+}
+
+int DisplayRegistry::displayOfPackage(const std::string &pkgname)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    Container *container = findContainerLocked();
+    if (!container) {
+        return -1;
+    }
+    for (const auto &item : container->displays) {
+        if (item.second.pkgname == pkgname) {
+            return item.first;
+        }
+    }
+    return -1;
+}
+
+static std::string size_json(int width, int height)
+{
+    return "{\"width\":" + std::to_string(width) + ",\"height\":" + std::to_string(height) + "}";
+}
+
+std::string DisplayRegistry::toJson()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    static const Container empty;
+    const Container *container = findContainerLocked();
+    if (!container) {
+        container = &empty;
+    }
+    const bool suppressing = mSuppressMode == eSuppress_On || (mSuppressMode == eSuppress_Auto && container->eventsFed);
+
+    std::string json = "{\"suppressed\":" + std::to_string(mSuppressed);
+    json += std::string(",\"suppressing\":") + (suppressing ? "true" : "false") + ",\"displays\":[";
+    bool first = true;
+    for (const auto &item : container->displays) {
+        const DisplayState &state = item.second;
+        json += first ? "" : ",";
+        first = false;
+        json += "{\"display_id\":" + std::to_string(item.first);
+        json += ",\"package_name\":";
+        append_json_string(json, state.pkgname);
+        json += ",\"size\":" + size_json(state.size.width, state.size.height);
+        json += ",\"density\":" + std::to_string(state.density);
+        json += std::string(",\"fullscreen\":") + (state.fullscreen ? "true" : "false");
+        if (state.hasRotation) {
+            json += ",\"rotation\":" + std::to_string(state.rotation);
+            json += ",\"rotation_size\":" + size_json(state.rotationSize.width, state.rotationSize.height);
+        }
+        if (state.hasWindowSize) {
+            json += ",\"window_size\":" + size_json(state.windowSize.width, state.windowSize.height);
+        }
+        if (state.hasDisplaySize) {
+            json += ",\"display_size\":" + size_json(state.displaySize.width, state.displaySize.height);
+        }
+        json += "}";
+    }
+
+    json += "],\"launching\":[";
+    first = true;
+    for (const auto &item : container->launches) {
+        const LaunchParams &params = item.second;
+        json += first ? "" : ",";
+        first = false;
+        json += "{\"package_name\":";
+        append_json_string(json, item.first);
+        json += ",\"size\":" + size_json(params.size.width, params.size.height);
+        json += ",\"density\":" + std::to_string(params.density);
+        json += std::string(",\"fullscreen\":") + (params.fullscreen ? "true" : "false") + "}";
+    }
+    json += "]}";
+    return json;
+}
+
+void DisplayRegistry::clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mContainers.erase(get_socket_path(eLink_Launcher));
+    mSuppressed = 0;
+}
+
+}
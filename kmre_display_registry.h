@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_DISPLAY_REGISTRY_H__
+#define __KMRE_DISPLAY_REGISTRY_H__
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "KmreCore.pb.h"
+
+namespace KmreSocket {
+
+// 记录每个display上的应用及最近一次经socket成功发出的窗口参数，
+// 由发出的命令和安卓发来的LaunchResult/CloseResult更新，
+// 用于跳过与上次完全相同的RotationChanged/UpdateAppWindowSize/UpdateDisplaySize。
+// 各容器(调用线程当前选中的容器，以其launcher socket路径区分)分别记录，事件也记入调用线程当前的容器
+class DisplayRegistry
+{
+public:
+    static DisplayRegistry& getInstance();
+
+    // 默认只对收到过LaunchResult/CloseResult事件的容器跳过更新(没有事件时无法知道应用重启或安卓重启)，
+    // 调用后以enabled为准; 关闭时仍然记录状态
+    void setSuppressEnabled(bool enabled);
+
+    // 与上次成功发出的内容相同时返回true，调用方应跳过发送
+    bool isRedundantRotation(int displayId, const std::string &pkgname, int width, int height, int rotation);
+    bool isRedundantWindowSize(int displayId, const std::string &pkgname, int width, int height);
+    bool isRedundantDisplaySize(int displayId, int width, int height);
+
+    // 命令经socket发送成功后调用; 经控制通道发出时对端是否取走无法确认，不应调用
+    void onRotationSent(int displayId, const std::string &pkgname, int width, int height, int rotation);
+    void onWindowSizeSent(int displayId, const std::string &pkgname, int width, int height);
+    void onDisplaySizeSent(int displayId, int width, int height);
+    void onLaunchAcked(const std::string &pkgname, bool fullscreen, int width, int height, int density);
+    void onAppClosed(const std::string &pkgname);
+
+    void onLaunchResult(const cn::kylinos::kmre::kmrecore::LaunchResult &result);
+    void onCloseResult(const cn::kylinos::kmre::kmrecore::CloseResult &result);
+
+    // display上的应用包名，未知时返回false
+    bool packageOnDisplay(int displayId, std::string &pkgname);
+    int displayOfPackage(const std::string &pkgname);// 未知时返回-1
+
+    std::string toJson();
+    void clear();// 只清空调用线程当前容器的记录
+
+private:
+    DisplayRegistry() = default;
+    DisplayRegistry(const DisplayRegistry&) = delete;
+    DisplayRegistry& operator=(const DisplayRegistry&) = delete;
+
+    struct Size {
+        int width = 0;
+        int height = 0;
+        bool operator==(const Size &other) const { return width == other.width && height == other.height; }
+    };
+
+    struct DisplayState {
+        std::string pkgname;
+        Size size;                  // LaunchResult中的窗口大小
+        int density = 0;
+        bool fullscreen = false;
+
+        // 最近一次成功发出的参数，未发过时has*为false
+        bool hasRotation = false;
+        std::string rotationPkg;
+        Size rotationSize;
+        int rotation = 0;
+        bool hasWindowSize = false;
+        std::string windowSizePkg;
+        Size windowSize;
+        bool hasDisplaySize = false;
+        Size displaySize;
+    };
+
+    // launch_app请求的参数，LaunchResult到达前用于查询
+    struct LaunchParams {
+        bool fullscreen = false;
+        Size size;
+        int density = 0;
+    };
+
+    struct Container {
+        std::map<int, DisplayState> displays;
+        std::unordered_map<std::string, LaunchParams> launches;
+        bool eventsFed = false;     // 收到过LaunchResult/CloseResult
+    };
+
+    typedef enum {
+        eSuppress_Auto = 0,         // 收到过事件的容器才跳过
+        eSuppress_On,
+        eSuppress_Off,
+    }SuppressMode;
+
+    Container& containerLocked();
+    Container* findContainerLocked();
+    const DisplayState* findDisplayLocked(int displayId);
+    void bindPackageLocked(Container &container, int displayId, const std::string &pkgname);
+    void forgetPackageLocked(Container &container, const std::string &pkgname);
+    bool suppressLocked(bool redundant);
+
+    std::mutex mMutex;
+    SuppressMode mSuppressMode = eSuppress_Auto;
+    std::map<std::string, Container> mContainers;// key为launcher socket路径
+    uint64_t mSuppressed = 0;
+};
+
+}
+
+#endif // __KMRE_DISPLAY_REGISTRY_H__
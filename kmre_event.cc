@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_event.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "kmre_log.h"
+#include "kmre_launch_tracer.h"
+#include "kmre_display_registry.h"
+#include "kmre_app_cache.h"
+#include "kmre_app_stats.h"
+
+namespace KmreSocket {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+static const char *kEventNames[EVENT_FIELD_MAX] = {
+    nullptr,
+#define KMRE_EVENT_NAME(Message, Field) #Message,
+    KMRE_EVENT_LIST(KMRE_EVENT_NAME)
+#undef KMRE_EVENT_NAME
+};
+
+// 遍历EventSequence的顶层字段，对每个长度分隔的字段调用visit(field, data, len)，
+// visit返回false时停止; 其他类型的字段(未知字段)直接跳过。数据格式错误时返回false
+template <typename Visitor>
+static bool scan_event(const char *event, int eventLen, Visitor visit)
+{
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(event);
+    CodedInputStream input(base, eventLen);
+
+    for (;;) {
+        uint32_t tag = input.ReadTag();
+        if (tag == 0) {
+            return input.CurrentPosition() == eventLen;
+        }
+
+        if (WireFormatLite::GetTagWireType(tag) != WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+            if (!WireFormatLite::SkipField(&input, tag)) {
+                return false;
+            }
+            continue;
+        }
+
+        uint32_t len = 0;
+        if (!input.ReadVarint32(&len)) {
+            return false;
+        }
+        const int pos = input.CurrentPosition();
+        if (len > static_cast<uint32_t>(eventLen - pos)) {
+            return false;
+        }
+        if (!visit(static_cast<int>(WireFormatLite::GetTagFieldNumber(tag)), event + pos, static_cast<int>(len))) {
+            return true;
+        }
+        input.Skip(static_cast<int>(len));
+    }
+}
+
+bool find_event_field(const char *event, int eventLen, int field, const char *&data, int &len)
+{
+    bool found = false;
+    if (!event || eventLen < 0) {
+        return false;
+    }
+
+    scan_event(event, eventLen, [&](int current, const char *fieldData, int fieldLen) {
+        if (current != field) {
+            return true;
+        }
+        data = fieldData;
+        len = fieldLen;
+        found = true;
+        return false;// 同一字段出现多次时只取第一个
+    });
+    return found;
+}
+
+EventDispatcher& EventDispatcher::getInstance()
+{
+    static EventDispatcher instance;
+    return instance;
+}
+
+// 库内的本地状态(启动耗时、display记录、应用列表缓存、应用资源占用)统一由分发器更新;
+// 媒体索引只在有使用者时订阅FilesList，见MediaIndex::acquire
+EventDispatcher::EventDispatcher()
+    : mTable(std::make_shared<Table>())
+{
+    using namespace cn::kylinos::kmre::kmrecore;
+
+    subscribe(std::function<void(const LaunchResult&)>([](const LaunchResult &result) {
+        LaunchTracer::getInstance().onLaunchResult(result);
+        DisplayRegistry::getInstance().onLaunchResult(result);
+        AppListCache::getInstance().invalidate(eAppCache_Running);
+    }));
+    subscribe(std::function<void(const CloseResult&)>([](const CloseResult &result) {
+        DisplayRegistry::getInstance().onCloseResult(result);
+        AppListCache::getInstance().invalidate(eAppCache_Running);
+    }));
+    // 安卓内安装或卸载应用时通知，各进程共享的已安装列表随之失效
+    subscribe(EventTraits<UpdatePackageStatus>::kField, [](int, const char *, int) {
+        AppListCache::getInstance().invalidate(eAppCache_Installed);
+    });
+    subscribe(std::function<void(const AppStatsList&)>([](const AppStatsList &list) {
+        AppStatsTable::getInstance().update(list, true);
+    }));
+}
+
+std::shared_ptr<const EventDispatcher::Table> EventDispatcher::table()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mTable;
+}
+
+int EventDispatcher::subscribe(int field, EventHandler handler)
+{
+    if (field <= 0 || field >= EVENT_FIELD_MAX || !handler) {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<Table> table = std::make_shared<Table>(*mTable);
+    int id = mNextId++;
+    table->subscribers[field].push_back({id, std::move(handler)});
+    mTable = table;
+    return id;
+}
+
+bool EventDispatcher::unsubscribe(int id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<Table> table = std::make_shared<Table>(*mTable);
+    for (auto &subscribers : table->subscribers) {
+        for (auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+            if (it->id == id) {
+                subscribers.erase(it);
+                mTable = table;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int EventDispatcher::dispatch(const char *data, int len)
+{
+    if (!data || len < 0) {
+        return -1;
+    }
+
+    ++mEvents;
+    std::shared_ptr<const Table> current = table();
+    int delivered = 0;
+    bool ok = scan_event(data, len, [&](int field, const char *fieldData, int fieldLen) {
+        if (field <= 0 || field >= EVENT_FIELD_MAX || current->subscribers[field].empty()) {
+            if (field > 0 && field < EVENT_FIELD_MAX) {
+                ++mSkipped[field];
+            }
+            mSkippedBytes += fieldLen;
+            return true;
+        }
+
+        ++mDecoded[field];
+        ++delivered;
+        for (const auto &subscriber : current->subscribers[field]) {
+            subscriber.handler(field, fieldData, fieldLen);
+        }
+        return true;
+    });
+
+    if (!ok) {
+        ++mMalformed;
+        KMRE_LOG(LOG_ERR, "[%s] Malformed EventSequence(%d bytes)!", __func__, len);
+        return -1;
+    }
+    return delivered;
+}
+
+std::string EventDispatcher::statsJson()
+{
+    std::shared_ptr<const Table> current = table();
+
+    std::string json = "{\"events\":" + std::to_string(mEvents.load());
+    json += ",\"malformed\":" + std::to_string(mMalformed.load());
+    json += ",\"skipped_bytes\":" + std::to_string(mSkippedBytes.load());
+    json += ",\"fields\":{";
+    bool first = true;
+    for (int field = 1; field < EVENT_FIELD_MAX; field++) {
+        json += first ? "" : ",";
+        first = false;
+        json += std::string("\"") + kEventNames[field] + "\":{\"subscribers\":" +
+                std::to_string(current->subscribers[field].size()) +
+                ",\"decoded\":" + std::to_string(mDecoded[field].load()) +
+                ",\"skipped\":" + std::to_string(mSkipped[field].load()) + "}";
+    }
+    json += "}}";
+    return json;
+}
+
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_EVENT_H__
+#define __KMRE_EVENT_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "KmreCore.pb.h"
+
+namespace KmreSocket {
+
+// EventSequence中各子消息的字段编号及类型，与 KmreCore.proto 一致
+#define KMRE_EVENT_LIST(X) \
+    X(Notification,              1) \
+    X(EventInfo,                 2) \
+    X(LaunchResult,              3) \
+    X(CloseResult,               4) \
+    X(SetClipboard,              5) \
+    X(VirtualScreenFocusResult,  6) \
+    X(InputMethodRequest,        7) \
+    X(FilesList,                 8) \
+    X(MediaPlayStatus,           9) \
+    X(AppMultiplierList,        10) \
+    X(ResponseInfo,             11) \
+    X(MultiplierSwitch,         12) \
+    X(LinkOpen,                 13) \
+    X(UpdatePackageStatus,      14) \
+    X(AppStatsList,             15)
+
+#define EVENT_FIELD_MAX 16
+
+template <typename T>
+struct EventTraits;
+
+#define KMRE_EVENT_TRAITS(Message, Field) \
+    template <> \
+    struct EventTraits<cn::kylinos::kmre::kmrecore::Message> { \
+        static constexpr int kField = Field; \
+    };
+
+KMRE_EVENT_LIST(KMRE_EVENT_TRAITS)
+
+#undef KMRE_EVENT_TRAITS
+
+// 子消息的原始字节，指向调用方传入的缓冲区，只在回调期间有效
+typedef std::function<void(int field, const char *data, int len)> EventHandler;
+
+// 只扫描EventSequence的字段标签，没有订阅者的子消息直接跳过(不拷贝也不解析)，
+// 有订阅者的子消息把原始字节交给订阅者，由订阅者按需解析
+class EventDispatcher
+{
+public:
+    static EventDispatcher& getInstance();
+
+    // 返回订阅id(大于0)，field无效时返回-1
+    int subscribe(int field, EventHandler handler);
+    bool unsubscribe(int id);
+
+    template <typename T>
+    int subscribe(std::function<void(const T&)> handler) {
+        return subscribe(EventTraits<T>::kField, [handler](int, const char *data, int len) {
+            T message;
+            if (message.ParseFromArray(data, len)) {
+                handler(message);
+            }
+        });
+    }
+
+    // 返回交给订阅者的子消息个数，数据格式错误时返回-1
+    int dispatch(const char *data, int len);
+
+    std::string statsJson();
+
+private:
+    EventDispatcher();
+    EventDispatcher(const EventDispatcher&) = delete;
+    EventDispatcher& operator=(const EventDispatcher&) = delete;
+
+    struct Subscriber {
+        int id;
+        EventHandler handler;
+    };
+
+    // 订阅表写时复制，分发时不持锁，回调中可以再订阅或取消订阅
+    struct Table {
+        std::vector<Subscriber> subscribers[EVENT_FIELD_MAX];
+    };
+
+    std::shared_ptr<const Table> table();
+
+    std::mutex mMutex;
+    std::shared_ptr<const Table> mTable;
+    int mNextId = 1;
+
+    std::atomic<uint64_t> mEvents{0};
+    std::atomic<uint64_t> mMalformed{0};
+    std::atomic<uint64_t> mDecoded[EVENT_FIELD_MAX] = {};
+    std::atomic<uint64_t> mSkipped[EVENT_FIELD_MAX] = {};
+    std::atomic<uint64_t> mSkippedBytes{0};
+};
+
+// 在EventSequence中查找field对应的子消息(不解析其余字段)，找到时data/len指向其原始字节
+bool find_event_field(const char *event, int eventLen, int field, const char *&data, int &len);
+
+// 只解析EventSequence中类型为T的子消息
+template <typename T>
+bool decode_event_field(const char *event, int eventLen, T &message)
+{
+    const char *data = nullptr;
+    int len = 0;
+    return find_event_field(event, eventLen, EventTraits<T>::kField, data, len) && message.ParseFromArray(data, len);
+}
+
+}
+
+#endif // __KMRE_EVENT_H__
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_histogram.h"
+
+#include <stdio.h>
+
+namespace KmreSocket {
+
+void LatencyHistogram::add(int64_t us)
+{
+    if (us < 0) {
+        us = 0;
+    }
+
+    int bucket = 0;
+    while (bucket < kBuckets - 1 && (1LL << bucket) <= us) {
+        ++bucket;
+    }
+    ++mBuckets[bucket];
+    ++mCount;
+    mSum += us;
+    if (us > mMax) {
+        mMax = us;
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    *this = LatencyHistogram();
+}
+
+// 返回所在桶的上界，误差不超过一倍
+int64_t LatencyHistogram::percentile(double p) const
+{
+    if (mCount == 0) {
+        return 0;
+    }
+
+    uint64_t target = static_cast<uint64_t>(p * mCount);
+    if (target >= mCount) {
+        target = mCount - 1;
+    }
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < kBuckets; bucket++) {
+        seen += mBuckets[bucket];
+        if (seen > target) {
+            int64_t upper = (1LL << bucket);
+            return (upper < mMax) ? upper : mMax;
+        }
+    }
+    return mMax;
+}
+
+std::string LatencyHistogram::toJson() const
+{
+    char buf[256];
+    snprintf(buf, sizeof(buf),
+        "{\"count\":%llu,\"avg_ms\":%.3f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+        static_cast<unsigned long long>(mCount),
+        mCount ? (mSum / 1000.0 / mCount) : 0.0,
+        percentile(0.50) / 1000.0, percentile(0.90) / 1000.0,
+        percentile(0.99) / 1000.0, mMax / 1000.0);
+    return buf;
+}
+
+}
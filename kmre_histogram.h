@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_HISTOGRAM_H__
+#define __KMRE_HISTOGRAM_H__
+
+#include <stdint.h>
+#include <string>
+
+namespace KmreSocket {
+
+// 以2的幂分桶的耗时直方图(单位:微秒)
+class LatencyHistogram
+{
+public:
+    void add(int64_t us);
+    void reset();
+    int64_t percentile(double p) const;
+    std::string toJson() const;
+
+private:
+    static const int kBuckets = 40;
+    uint64_t mBuckets[kBuckets] = {0};
+    uint64_t mCount = 0;
+    int64_t mSum = 0;
+    int64_t mMax = 0;
+};
+
+}
+
+#endif // __KMRE_HISTOGRAM_H__
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_installer.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syslog.h>
+#include <linux/fs.h>
+
+#include "KmreCore.pb.h"
+#include "kmre_socket.h"
+#include "kmre_log.h"
+#include "kmre_pipeline.h"
+
+namespace KmreSocket {
+
+#define INSTALL_TIMEOUT_MS (5 * 60 * 1000)
+#define INSTALL_DEFAULT_CONCURRENCY 4
+
+static std::string base_name(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+static bool copy_fd(int in, int out, off_t size)
+{
+    if (ioctl(out, FICLONE, in) == 0) {
+        return true;
+    }
+
+    off_t left = size;
+    bool useSendfile = false;
+    while (left > 0) {
+        ssize_t n;
+        if (!useSendfile) {
+            n = copy_file_range(in, nullptr, out, nullptr, left, 0);
+            if (n < 0 && left == size && (errno == EXDEV || errno == ENOSYS ||
+                                          errno == EINVAL || errno == EOPNOTSUPP)) {
+                useSendfile = true;// 旧内核或不支持跨文件系统
+                continue;
+            }
+        }
+        else {
+            n = sendfile(out, in, nullptr, left);
+        }
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        left -= n;
+    }
+
+    return left == 0;
+}
+
+bool stage_file(const std::string &src, const std::string &dstDir, std::string &fileName)
+{
+    fileName = base_name(src);
+    const std::string dst = dstDir + "/" + fileName;
+
+    int in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Open '%s' failed: %s", __func__, src.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat srcStat, dstStat;
+    if (fstat(in, &srcStat) != 0) {
+        close(in);
+        return false;
+    }
+    if (stat(dst.c_str(), &dstStat) == 0 && dstStat.st_size == srcStat.st_size &&
+        dstStat.st_mtim.tv_sec == srcStat.st_mtim.tv_sec &&
+        dstStat.st_mtim.tv_nsec == srcStat.st_mtim.tv_nsec) {
+        close(in);
+        return true;
+    }
+
+    // 先写临时文件再改名，避免安卓读到不完整的apk; 临时文件名唯一，多个线程或进程同时拷贝也不会互相覆盖
+    std::string tmp = dstDir + "/." + fileName + ".XXXXXX";
+    int out = mkostemp(&tmp[0], O_CLOEXEC);
+    if (out < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Create '%s' failed: %s", __func__, tmp.c_str(), strerror(errno));
+        close(in);
+        return false;
+    }
+    fchmod(out, 0644);
+
+    bool ok = copy_fd(in, out, srcStat.st_size);
+    if (ok) {
+        struct timespec times[2] = {srcStat.st_atim, srcStat.st_mtim};
+        futimens(out, times);
+    }
+    close(in);
+    if (close(out) != 0) {
+        ok = false;
+    }
+
+    if (ok && rename(tmp.c_str(), dst.c_str()) != 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Rename to '%s' failed: %s", __func__, dst.c_str(), strerror(errno));
+        ok = false;
+    }
+    if (!ok) {
+        KMRE_LOG(LOG_ERR, "[%s] Copy '%s' failed!", __func__, src.c_str());
+        unlink(tmp.c_str());
+    }
+    return ok;
+}
+
+int bulk_install(const std::vector<InstallItem> &items, const std::string &stageDir,
+                 int concurrency, InstallCallback callback, void *userData)
+{
+    if (items.empty()) {
+        return 0;
+    }
+    if (concurrency <= 0) {
+        concurrency = INSTALL_DEFAULT_CONCURRENCY;
+    }
+
+    std::mutex callbackMutex;
+    auto notify = [&](size_t index, int stage, int result) {
+        if (callback) {
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            callback(static_cast<int>(index), items[index].pkgName.c_str(), stage, result, userData);
+        }
+    };
+
+    std::vector<std::string> fileNames(items.size());
+    std::vector<char> staged(items.size(), 1);
+
+    // 安卓按文件名取apk，文件名相同的项(来自不同目录)会拷贝到同一目标并提交同一个file_name，只保留第一项
+    std::map<std::string, size_t> firstByName;
+    for (size_t index = 0; index < items.size(); index++) {
+        fileNames[index] = base_name(items[index].apkPath);
+        auto result = firstByName.emplace(fileNames[index], index);
+        if (!result.second) {
+            KMRE_LOG(LOG_ERR, "[%s] '%s' has the same file name as item %zu, skip it!", __func__,
+                     items[index].apkPath.c_str(), result.first->second);
+            staged[index] = 0;
+        }
+    }
+
+    if (!stageDir.empty()) {
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t index = next++; index < items.size(); index = next++) {
+                if (!staged[index]) {
+                    notify(index, eInstall_Staged, 0);
+                    continue;
+                }
+                notify(index, eInstall_Staging, 0);
+                staged[index] = stage_file(items[index].apkPath, stageDir, fileNames[index]) ? 1 : 0;
+                notify(index, eInstall_Staged, staged[index]);
+            }
+        };
+
+        size_t threadCount = std::min(items.size(), static_cast<size_t>(concurrency));
+        std::vector<std::thread> threads;
+        for (size_t n = 1; n < threadCount; n++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    const std::string socketPath = get_socket_path(eLink_Launcher);
+    std::vector<PipelineRequest> requests;
+    std::vector<size_t> itemIndex;
+    for (size_t index = 0; index < items.size(); index++) {
+        if (!staged[index]) {
+            notify(index, eInstall_Finished, 0);
+            continue;
+        }
+
+        cn::kylinos::kmre::kmrecore::InstallApp obj;
+        obj.set_file_name(fileNames[index]);
+        obj.set_app_name(items[index].appName);
+        obj.set_package_name(items[index].pkgName);
+        requests.emplace_back();
+        make_pipeline_request(requests.back(), socketPath, obj);
+        itemIndex.push_back(index);
+    }
+
+    int succeeded = 0;
+    run_pipeline(requests, concurrency, INSTALL_TIMEOUT_MS, [&](size_t n, PipelineRequest &req) {
+        cn::kylinos::kmre::kmrecore::ActionResult reply;
+        bool ok = req.ok && reply.ParseFromString(req.reply) && reply.result();
+        if (ok) {
+            ++succeeded;
+        }
+        else if (req.ok) {
+            KMRE_LOG(LOG_ERR, "[%s] Install '%s' failed: %s", __func__, items[itemIndex[n]].pkgName.c_str(),
+                reply.has_err_info() ? reply.err_info().c_str() : "");
+        }
+        notify(itemIndex[n], eInstall_Finished, ok ? 1 : 0);
+    });
+
+    return succeeded;
+}
+
+}
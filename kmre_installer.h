@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_INSTALLER_H__
+#define __KMRE_INSTALLER_H__
+
+#include <string>
+#include <vector>
+
+namespace KmreSocket {
+
+typedef enum {
+    eInstall_Staging = 0,   // 开始拷贝apk
+    eInstall_Staged,        // 拷贝结束，result为1成功/0失败
+    eInstall_Finished,      // 安装结束，result为1成功/0失败
+}InstallStage;
+
+// index为安装项下标，回调可能来自不同线程，但不会并发调用
+typedef void (*InstallCallback)(int index, const char *pkgname, int stage, int result, void *user_data);
+
+struct InstallItem {
+    std::string apkPath;
+    std::string appName;
+    std::string pkgName;
+};
+
+// 将文件拷贝到dstDir，优先reflink，其次copy_file_range；
+// 目标已存在且大小、修改时间相同时不再拷贝
+bool stage_file(const std::string &src, const std::string &dstDir, std::string &fileName);
+
+// stageDir为空时不拷贝，直接以apk文件名提交安装; 文件名与前面的项相同的项不拷贝也不安装，视为失败;
+// 返回安装成功的个数
+int bulk_install(const std::vector<InstallItem> &items, const std::string &stageDir,
+                 int concurrency, InstallCallback callback, void *userData);
+
+}
+
+#endif // __KMRE_INSTALLER_H__
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_launch_tracer.h"
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+#define LAUNCH_PENDING_TIMEOUT_US (60LL * 1000 * 1000)
+#define LAUNCH_STATS_MAX_PACKAGES 256   // 统计的包名个数上限，安卓可能发来任意包名的LaunchResult
+
+static const char *kPhaseNames[ePhase_Count] = {"resolve", "connect", "send", "ack", "result"};
+
+LaunchTracer& LaunchTracer::getInstance()
+{
+    static LaunchTracer instance;
+    return instance;
+}
+
+void LaunchTracer::expirePendingLocked(int64_t now)
+{
+    for (auto it = mPending.begin(); it != mPending.end();) {
+        if (now - it->second.start > LAUNCH_PENDING_TIMEOUT_US) {
+            it = mPending.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+LaunchTracer::PackageStats &LaunchTracer::statsLocked(const std::string &pkgname, int64_t now)
+{
+    auto it = mStats.find(pkgname);
+    if (it == mStats.end() && mStats.size() >= LAUNCH_STATS_MAX_PACKAGES) {
+        auto oldest = mStats.end();
+        for (auto candidate = mStats.begin(); candidate != mStats.end(); ++candidate) {
+            if (mPending.count(candidate->first) == 0 &&
+                (oldest == mStats.end() || candidate->second.updated < oldest->second.updated)) {
+                oldest = candidate;
+            }
+        }
+        if (oldest != mStats.end()) {
+            mStats.erase(oldest);
+        }
+    }
+
+    PackageStats &stats = mStats[pkgname];
+    stats.updated = now;
+    return stats;
+}
+
+void LaunchTracer::onLaunchAcked(const std::string &pkgname, int64_t start, const int64_t timestamps[ePhase_Result])
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    PackageStats &stats = statsLocked(pkgname, timestamps[ePhase_Result - 1]);
+    int64_t prev = start;
+    for (int phase = 0; phase < ePhase_Result; phase++) {
+        stats.phases[phase].add(timestamps[phase] - prev);
+        prev = timestamps[phase];
+    }
+
+    expirePendingLocked(prev);
+    mPending[pkgname] = {start, prev};
+}
+
+void LaunchTracer::onLaunchResult(const cn::kylinos::kmre::kmrecore::LaunchResult &result)
+{
+    const int64_t now = monotonic_us();
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    PackageStats &stats = statsLocked(result.package_name(), now);
+    auto it = mPending.find(result.package_name());
+    if (it == mPending.end()) {
+        ++stats.unmatched;
+        return;
+    }
+
+    stats.displayId = result.display_id();
+    if (!result.result()) {
+        ++stats.failed;
+    }
+    else {
+        // 应用已在运行(窗口已存在或被恢复)时不算冷启动
+        stats.phases[ePhase_Result].add(now - it->second.acked);
+        if ((result.has_app_resumed() && result.app_resumed()) || (result.has_exists() && result.exists())) {
+            stats.resumed.add(now - it->second.start);
+        }
+        else {
+            stats.cold.add(now - it->second.start);
+        }
+    }
+    mPending.erase(it);
+}
+
+std::string LaunchTracer::packageJsonLocked(const std::string &pkgname, const PackageStats &stats)
+{
+    std::string json = "{\"package_name\":";
+    append_json_string(json, pkgname);
+    json += ",\"display_id\":" + std::to_string(stats.displayId);
+    json += ",\"cold\":" + stats.cold.toJson();
+    json += ",\"resumed\":" + stats.resumed.toJson();
+    json += ",\"failed\":" + std::to_string(stats.failed);
+    json += ",\"unmatched\":" + std::to_string(stats.unmatched);
+    json += ",\"phases\":{";
+    for (int phase = 0; phase < ePhase_Count; phase++) {
+        json += (phase > 0) ? "," : "";
+        json += std::string("\"") + kPhaseNames[phase] + "\":" + stats.phases[phase].toJson();
+    }
+    json += "}}";
+    return json;
+}
+
+std::string LaunchTracer::statsJson(const std::string &pkgname)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!pkgname.empty()) {
+        auto it = mStats.find(pkgname);
+        return (it != mStats.end()) ? packageJsonLocked(it->first, it->second) : "{}";
+    }
+
+    std::string json = "[";
+    for (const auto &stats : mStats) {
+        json += (json.size() > 1) ? "," : "";
+        json += packageJsonLocked(stats.first, stats.second);
+    }
+    json += "]";
+    return json;
+}
+
+void LaunchTracer::reset()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.clear();
+    mStats.clear();
+}
+
+}
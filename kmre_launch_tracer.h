@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_LAUNCH_TRACER_H__
+#define __KMRE_LAUNCH_TRACER_H__
+
+#include <mutex>
+#include <string>
+#include <map>
+#include <unordered_map>
+
+#include "KmreCore.pb.h"
+#include "kmre_histogram.h"
+
+namespace KmreSocket {
+
+typedef enum {
+    ePhase_Resolve = 0,     // 解析socket路径
+    ePhase_Connect,
+    ePhase_Send,
+    ePhase_Ack,             // launcher回复ActionResult
+    ePhase_Result,          // 收到LaunchResult(窗口已显示)
+    ePhase_Count,
+}LaunchPhase;
+
+// 将LaunchApp与之后到达的LaunchResult按包名关联，统计各阶段及冷启动/恢复的耗时
+class LaunchTracer
+{
+public:
+    static LaunchTracer& getInstance();
+
+    // timestamps[i]为第i阶段结束的时间(微秒)，start为调用launch_app的时间
+    void onLaunchAcked(const std::string &pkgname, int64_t start, const int64_t timestamps[ePhase_Result]);
+    void onLaunchResult(const cn::kylinos::kmre::kmrecore::LaunchResult &result);
+
+    std::string statsJson(const std::string &pkgname);// pkgname为空时返回全部
+    void reset();
+
+private:
+    LaunchTracer() = default;
+    LaunchTracer(const LaunchTracer&) = delete;
+    LaunchTracer& operator=(const LaunchTracer&) = delete;
+
+    struct PendingLaunch {
+        int64_t start;
+        int64_t acked;
+    };
+
+    struct PackageStats {
+        LatencyHistogram cold;
+        LatencyHistogram resumed;
+        LatencyHistogram phases[ePhase_Count];
+        int displayId = -1;
+        uint64_t failed = 0;
+        uint64_t unmatched = 0;// 收到LaunchResult但没有对应的LaunchApp
+        int64_t updated = 0;    // 最近一次更新的时间，表满时淘汰最久未更新的
+    };
+
+    void expirePendingLocked(int64_t now);
+    PackageStats &statsLocked(const std::string &pkgname, int64_t now);
+    std::string packageJsonLocked(const std::string &pkgname, const PackageStats &stats);
+
+    std::mutex mMutex;
+    std::unordered_map<std::string, PendingLaunch> mPending;
+    std::map<std::string, PackageStats> mStats;
+};
+
+}
+
+#endif // __KMRE_LAUNCH_TRACER_H__
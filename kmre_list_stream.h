@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_LIST_STREAM_H__
+#define __KMRE_LIST_STREAM_H__
+
+#include <functional>
+#include <string>
+#include <sys/syslog.h>
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include "kmre_log.h"
+
+namespace KmreSocket {
+
+#define LIST_STREAM_BLOCK_SIZE (16 * 1024)  // 从socket每次读取的大小
+
+// 流式解析列表消息(InstalledAppList/RunningAppList/FilesList等): repeated item字段每解析完一个就交给onItem，
+// 其余字段(size/type等)解析到envelope中，envelope的item为空。同一时间只保留一个item及一个读缓冲块;
+// onItem返回false时停止读取并返回false
+template <typename R, typename Item>
+bool parse_list_stream(google::protobuf::io::ZeroCopyInputStream *stream, int itemField, R &envelope,
+                       const std::function<bool(const Item&)> &onItem)
+{
+    using google::protobuf::io::CodedInputStream;
+    using google::protobuf::io::CodedOutputStream;
+    using google::protobuf::io::StringOutputStream;
+    using google::protobuf::internal::WireFormatLite;
+
+    CodedInputStream input(stream);
+    std::string rest;// item以外的字段，通常只有几个字节
+    Item item;
+    bool ok = true;
+    {
+        StringOutputStream restStream(&rest);
+        CodedOutputStream restOutput(&restStream);
+
+        for (;;) {
+            uint32_t tag = input.ReadTag();
+            if (tag == 0) {
+                ok = input.ConsumedEntireMessage();// 读到结尾时为true，读到非法的0标签时为false
+                break;
+            }
+
+            if (static_cast<int>(WireFormatLite::GetTagFieldNumber(tag)) == itemField &&
+                WireFormatLite::GetTagWireType(tag) == WireFormatLite::WIRETYPE_LENGTH_DELIMITED) {
+                uint32_t len = 0;
+                if (!input.ReadVarint32(&len)) {
+                    ok = false;
+                    break;
+                }
+                CodedInputStream::Limit limit = input.PushLimit(static_cast<int>(len));
+                item.Clear();
+                ok = item.MergePartialFromCodedStream(&input) && input.ConsumedEntireMessage() &&
+                     input.BytesUntilLimit() == 0 && item.IsInitialized();
+                input.PopLimit(limit);
+                if (!ok || !onItem(item)) {
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+
+            if (!WireFormatLite::SkipField(&input, tag, &restOutput)) {
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (!ok) {
+        return false;
+    }
+    if (!envelope.ParsePartialFromString(rest) || !envelope.IsInitialized()) {
+        KMRE_LOG(LOG_ERR, "[%s] Parse %s failed!", __func__, envelope.GetTypeName().c_str());
+        return false;
+    }
+    return true;
+}
+
+// 从内存中的数据流式解析，用于已在内存中的回复(如共享快照、事件)，不需要先构造整个消息
+template <typename R, typename Item>
+bool parse_list_stream(const char *data, int len, int itemField, R &envelope,
+                       const std::function<bool(const Item&)> &onItem)
+{
+    google::protobuf::io::ArrayInputStream stream(data, len);
+    return parse_list_stream(&stream, itemField, envelope, onItem);
+}
+
+}
+
+#endif // __KMRE_LIST_STREAM_H__
@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_log.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <new>
+#include <thread>
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+#define LOG_RING_SLOTS 1024             // 2的幂
+#define LOG_MSG_MAX 480
+#define LOG_SITE_WINDOW_US (1000 * 1000)
+#define LOG_SITE_BURST 10               // 每个调用点每秒最多输出的条数
+#define LOG_FLUSH_IDLE_MS 1000
+
+static int level_from_env()
+{
+    const char *value = getenv("KMRE_LOG_LEVEL");
+    return value ? atoi(value) : LOG_DEBUG;
+}
+
+std::atomic<int> gLogLevel{level_from_env()};
+
+struct LogSlot {
+    std::atomic<uint64_t> seq;
+    int priority;
+    char msg[LOG_MSG_MAX];
+};
+
+// 有界多生产者单消费者队列，每个槽位的序号表示它当前可写还是可读
+class LogRing
+{
+public:
+    LogRing() {
+        reset();
+    }
+
+    // 清空队列，只在没有其他线程访问时调用(构造及fork后的子进程)
+    void reset() {
+        for (uint64_t n = 0; n < LOG_RING_SLOTS; n++) {
+            mSlots[n].seq.store(n, std::memory_order_relaxed);
+        }
+        mEnqueuePos.store(0, std::memory_order_relaxed);
+        mDequeuePos = 0;
+    }
+
+    LogSlot *beginWrite() {
+        uint64_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            LogSlot &slot = mSlots[pos & (LOG_RING_SLOTS - 1)];
+            int64_t diff = static_cast<int64_t>(slot.seq.load(std::memory_order_acquire)) - static_cast<int64_t>(pos);
+            if (diff == 0) {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return &slot;
+                }
+            }
+            else if (diff < 0) {
+                return nullptr;// 队列已满
+            }
+            else {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void endWrite(LogSlot *slot) {
+        uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+        slot->seq.store(seq + 1, std::memory_order_release);
+    }
+
+    LogSlot *beginRead() {
+        LogSlot &slot = mSlots[mDequeuePos & (LOG_RING_SLOTS - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != mDequeuePos + 1) {
+            return nullptr;
+        }
+        return &slot;
+    }
+
+    void endRead(LogSlot *slot) {
+        slot->seq.store(mDequeuePos + LOG_RING_SLOTS, std::memory_order_release);
+        ++mDequeuePos;
+    }
+
+private:
+    LogSlot mSlots[LOG_RING_SLOTS];
+    alignas(64) std::atomic<uint64_t> mEnqueuePos{0};
+    alignas(64) uint64_t mDequeuePos = 0;
+};
+
+class LogFlusher
+{
+public:
+    static LogFlusher& getInstance() {
+        // 不析构: 进程退出时其他静态对象的析构函数仍可能写日志;
+        // 成员按缓存行对齐，构造在对齐的静态存储中而不是用new分配
+        alignas(LogFlusher) static unsigned char storage[sizeof(LogFlusher)];
+        static LogFlusher *instance = new (storage) LogFlusher();
+        return *instance;
+    }
+
+    // 返回nullptr时调用方应丢弃该条日志; stopped为true表示进程正在退出，应直接写syslog
+    LogSlot *reserve(bool &stopped) {
+        stopped = (mState.load(std::memory_order_acquire) == eState_Stopped);
+        if (stopped) {
+            return nullptr;
+        }
+        ensureStarted();
+        LogSlot *slot = mRing.beginWrite();
+        if (!slot) {
+            ++mDropped;
+        }
+        return slot;
+    }
+
+    void commit(LogSlot *slot) {
+        mRing.endWrite(slot);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (mSleeping.load(std::memory_order_relaxed)) {
+            wake();
+        }
+    }
+
+    void flush() {
+        if (mState.load() != eState_Running) {
+            return;
+        }
+        mFlushRequested = true;
+        wake();
+        for (int n = 0; n < 100 && mFlushRequested; n++) {
+            usleep(1000);
+        }
+    }
+
+    uint64_t dropped() const { return mDropped.load(); }
+    uint64_t written() const { return mWritten.load(); }
+    std::atomic<uint64_t> &suppressed() { return mSuppressed; }
+
+private:
+    enum {
+        eState_Idle = 0,
+        eState_Starting,
+        eState_Running,
+        eState_Stopped,
+    };
+
+    LogFlusher() {
+        mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        atexit([]() { LogFlusher::getInstance().stop(); });
+        pthread_atfork(nullptr, nullptr, []() {
+            // 子进程中没有后台线程，丢弃父进程的线程句柄，下次写日志时重新启动。
+            // fork时其他线程可能已占用槽位但还没有提交，这些线程在子进程中不存在，
+            // 队列必须清空重建，否则后台线程会一直等待这些槽位; 未写出的日志由父进程写出。
+            // eventfd与父进程共用，也要重新创建
+            LogFlusher &flusher = LogFlusher::getInstance();
+            new (&flusher.mThread) std::thread();
+            flusher.mThreadReady = false;
+            flusher.mRing.reset();
+            if (flusher.mEventFd >= 0) {
+                close(flusher.mEventFd);
+            }
+            flusher.mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            flusher.mSleeping = false;
+            flusher.mFlushRequested = false;
+            if (flusher.mState != eState_Stopped) {
+                flusher.mState = eState_Idle;
+            }
+        });
+    }
+    LogFlusher(const LogFlusher&) = delete;
+    LogFlusher& operator=(const LogFlusher&) = delete;
+
+    void ensureStarted() {
+        if (mState.load(std::memory_order_acquire) == eState_Running) {
+            return;
+        }
+        int expected = eState_Idle;
+        if (mState.compare_exchange_strong(expected, eState_Starting)) {
+            mThread = std::thread(&LogFlusher::run, this);
+            mThreadReady.store(true, std::memory_order_release);
+            // 期间stop已将状态改为Stopped时保持Stopped
+            expected = eState_Starting;
+            mState.compare_exchange_strong(expected, eState_Running);
+        }
+    }
+
+    void stop() {
+        int state = mState.exchange(eState_Stopped);
+        if (state == eState_Starting) {
+            // 等待ensureStarted给mThread赋值完成，之后才能读取mThread
+            while (!mThreadReady.load(std::memory_order_acquire)) {
+                usleep(1000);
+            }
+        }
+        if (mThread.joinable()) {
+            mStop = true;
+            wake();
+            mThread.join();
+        }
+        drain();
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        if (mEventFd >= 0 && write(mEventFd, &one, sizeof(one)) < 0) {
+            // eventfd计数溢出时对端必然会被唤醒，忽略即可
+        }
+    }
+
+    void drain() {
+        LogSlot *slot;
+        while ((slot = mRing.beginRead()) != nullptr) {
+            syslog(slot->priority, "%s", slot->msg);
+            mRing.endRead(slot);
+            ++mWritten;
+        }
+
+        uint64_t dropped = mDropped.load();
+        if (dropped != mReportedDropped) {
+            syslog(LOG_WARNING, "[libkylin-kmre] %llu log messages dropped, log queue is full.",
+                static_cast<unsigned long long>(dropped - mReportedDropped));
+            mReportedDropped = dropped;
+        }
+    }
+
+    void run() {
+        pthread_setname_np(pthread_self(), "kmre-log");
+        while (!mStop) {
+            drain();
+            mFlushRequested = false;
+
+            mSleeping = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!mRing.beginRead() && !mStop) {
+                struct pollfd pfd = {mEventFd, POLLIN, 0};
+                if (poll(&pfd, 1, LOG_FLUSH_IDLE_MS) > 0) {
+                    uint64_t count;
+                    if (read(mEventFd, &count, sizeof(count)) < 0) {
+                        // 已被其他唤醒读走
+                    }
+                }
+            }
+            mSleeping = false;
+        }
+    }
+
+    LogRing mRing;
+    int mEventFd = -1;
+    std::thread mThread;
+    std::atomic<bool> mThreadReady{false};// mThread已赋值(由ensureStarted设置)
+    std::atomic<int> mState{eState_Idle};
+    std::atomic<bool> mStop{false};
+    std::atomic<bool> mSleeping{false};
+    std::atomic<bool> mFlushRequested{false};
+    std::atomic<uint64_t> mDropped{0};
+    std::atomic<uint64_t> mWritten{0};
+    std::atomic<uint64_t> mSuppressed{0};
+    uint64_t mReportedDropped = 0;
+};
+
+// 每个调用点在一秒内最多输出LOG_SITE_BURST条，超出部分只计数，
+// 下一次输出时附带被抑制的条数
+static bool site_allow(LogSite &site, uint32_t &suppressed)
+{
+    const int64_t now = monotonic_us();
+    int64_t start = site.windowStart.load(std::memory_order_relaxed);
+    if (now - start >= LOG_SITE_WINDOW_US &&
+        site.windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+
+    if (site.count.fetch_add(1, std::memory_order_relaxed) >= LOG_SITE_BURST) {
+        site.suppressed.fetch_add(1, std::memory_order_relaxed);
+        ++LogFlusher::getInstance().suppressed();
+        return false;
+    }
+    suppressed = site.suppressed.exchange(0, std::memory_order_relaxed);
+    return true;
+}
+
+void log_write(LogSite &site, int priority, const char *format, ...)
+{
+    uint32_t suppressed = 0;
+    if (!site_allow(site, suppressed)) {
+        return;
+    }
+
+    LogFlusher &flusher = LogFlusher::getInstance();
+    bool stopped = false;
+    LogSlot *slot = flusher.reserve(stopped);
+    va_list args;
+    va_start(args, format);
+    if (!slot) {
+        if (stopped) {
+            vsyslog(priority, format, args);
+        }
+        va_end(args);
+        return;
+    }
+
+    // 直接格式化到队列槽位中，不分配内存
+    slot->priority = priority;
+    int len = vsnprintf(slot->msg, LOG_MSG_MAX, format, args);
+    va_end(args);
+    if (len < 0) {
+        slot->msg[0] = '\0';
+        len = 0;
+    }
+    else if (len >= LOG_MSG_MAX) {
+        len = LOG_MSG_MAX - 1;
+    }
+    if (suppressed > 0 && len < LOG_MSG_MAX - 1) {
+        snprintf(slot->msg + len, LOG_MSG_MAX - len, " (%u similar messages suppressed)", suppressed);
+    }
+    flusher.commit(slot);
+}
+
+void log_set_level(int priority)
+{
+    gLogLevel = priority;
+}
+
+void log_flush()
+{
+    LogFlusher::getInstance().flush();
+}
+
+std::string log_stats_json()
+{
+    LogFlusher &flusher = LogFlusher::getInstance();
+    return "{\"level\":" + std::to_string(gLogLevel.load()) +
+           ",\"written\":" + std::to_string(flusher.written()) +
+           ",\"dropped\":" + std::to_string(flusher.dropped()) +
+           ",\"suppressed\":" + std::to_string(flusher.suppressed().load()) + "}";
+}
+
+}
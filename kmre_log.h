@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_LOG_H__
+#define __KMRE_LOG_H__
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <sys/syslog.h>
+
+namespace KmreSocket {
+
+// 每个KMRE_LOG调用点一个，用于限速和统计被抑制的条数
+struct LogSite {
+    std::atomic<int64_t> windowStart{0};
+    std::atomic<uint32_t> count{0};
+    std::atomic<uint32_t> suppressed{0};
+};
+
+extern std::atomic<int> gLogLevel;
+
+inline bool log_enabled(int priority)
+{
+    return priority <= gLogLevel.load(std::memory_order_relaxed);
+}
+
+// 格式化后放入无锁环形队列，由后台线程写入syslog; 队列满时丢弃，从不阻塞调用者
+void log_write(LogSite &site, int priority, const char *format, ...) __attribute__((format(printf, 3, 4)));
+void log_set_level(int priority);
+void log_flush();
+std::string log_stats_json();
+
+}
+
+// 用法与syslog相同
+#define KMRE_LOG(priority, format, ...) \
+    do { \
+        if (KmreSocket::log_enabled(priority)) { \
+            static KmreSocket::LogSite kmreLogSite; \
+            KmreSocket::log_write(kmreLogSite, priority, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#endif // __KMRE_LOG_H__
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_media_index.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <sys/syslog.h>
+
+#include "kmre_event.h"
+#include "kmre_log.h"
+
+namespace KmreSocket {
+
+enum {
+    eFilesList_Dump = 0,
+    eFilesList_Insert = 1,
+    eFilesList_Delete = 2,
+};
+
+// request_media_files的类别: 0:全部,1:图片,2:视频,3:音频,4:文档
+static bool mime_in_request_type(const std::string &mimeType, int requestType)
+{
+    const char *mime = mimeType.c_str();
+    switch (requestType) {
+    case 1: return strncmp(mime, "image/", 6) == 0;
+    case 2: return strncmp(mime, "video/", 6) == 0;
+    case 3: return strncmp(mime, "audio/", 6) == 0;
+    case 4: return (strncmp(mime, "image/", 6) != 0) &&
+                   (strncmp(mime, "video/", 6) != 0) &&
+                   (strncmp(mime, "audio/", 6) != 0);
+    default: return true;
+    }
+}
+
+MediaIndex& MediaIndex::getInstance()
+{
+    static MediaIndex instance;
+    return instance;
+}
+
+void MediaIndex::expectDump(int requestType)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDumpRequestType = requestType;
+    mInDump = false;
+}
+
+void MediaIndex::clear()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mBuckets.clear();
+        mFiles.clear();
+        mDumpRequestType = 0;
+        mInDump = false;
+    }
+    unpin();
+}
+
+void MediaIndex::acquire()
+{
+    std::lock_guard<std::mutex> lock(mUseMutex);
+    if (mUsers++ == 0) {
+        mSubscription = EventDispatcher::getInstance().subscribe(
+            std::function<void(const cn::kylinos::kmre::kmrecore::FilesList&)>(
+                [this](const cn::kylinos::kmre::kmrecore::FilesList &list) {
+                    applyFilesList(list);
+                }));
+    }
+}
+
+void MediaIndex::release()
+{
+    std::lock_guard<std::mutex> lock(mUseMutex);
+    if (mUsers <= 0) {
+        return;
+    }
+    if (--mUsers == 0) {
+        EventDispatcher::getInstance().unsubscribe(mSubscription);
+        mSubscription = -1;
+    }
+}
+
+bool MediaIndex::pin()
+{
+    {
+        std::lock_guard<std::mutex> lock(mUseMutex);
+        if (mPinned) {
+            return false;
+        }
+        mPinned = true;
+    }
+    acquire();
+    return true;
+}
+
+void MediaIndex::unpin()
+{
+    {
+        std::lock_guard<std::mutex> lock(mUseMutex);
+        if (!mPinned) {
+            return;
+        }
+        mPinned = false;
+    }
+    release();
+}
+
+void MediaIndex::insertLocked(const std::string &path, const std::string &mimeType)
+{
+    auto it = mFiles.find(path);
+    if (it != mFiles.end()) {
+        if (it->second == mimeType) {
+            return;
+        }
+        eraseLocked(path);
+    }
+
+    it = mFiles.emplace(path, mimeType).first;
+    mBuckets[mimeType].insert(&it->first);
+}
+
+void MediaIndex::eraseLocked(const std::string &path)
+{
+    auto it = mFiles.find(path);
+    if (it == mFiles.end()) {
+        return;
+    }
+
+    auto bucket = mBuckets.find(it->second);
+    if (bucket != mBuckets.end()) {
+        bucket->second.erase(&it->first);
+        if (bucket->second.empty()) {
+            mBuckets.erase(bucket);
+        }
+    }
+    mFiles.erase(it);
+}
+
+// dump可能分多页到达，间隔不超过MEDIA_DUMP_SETTLE_MS的连续dump页属于同一次dump，只在第一页时清理旧记录
+void MediaIndex::beginDumpLocked()
+{
+    if (mDumpRequestType == 0) {
+        mBuckets.clear();
+        mFiles.clear();
+        return;
+    }
+
+    for (auto it = mFiles.begin(); it != mFiles.end();) {
+        if (mime_in_request_type(it->second, mDumpRequestType)) {
+            auto bucket = mBuckets.find(it->second);
+            if (bucket != mBuckets.end()) {
+                bucket->second.erase(&it->first);
+                if (bucket->second.empty()) {
+                    mBuckets.erase(bucket);
+                }
+            }
+            it = mFiles.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+bool MediaIndex::applyFilesList(const cn::kylinos::kmre::kmrecore::FilesList &list)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    switch (list.type()) {
+    case eFilesList_Dump: {
+        const auto now = std::chrono::steady_clock::now();
+        if (mInDump && now - mLastDumpPage > std::chrono::milliseconds(MEDIA_DUMP_SETTLE_MS)) {
+            // 上一次dump已经结束，这是安卓主动发来的新dump，按全量处理，否则已删除的文件不会被移除
+            mInDump = false;
+            mDumpRequestType = 0;
+        }
+        if (!mInDump) {
+            beginDumpLocked();
+            mInDump = true;
+        }
+        mLastDumpPage = now;
+        for (int n = 0; n < list.item_size(); n++) {
+            const auto &file = list.item(n);
+            insertLocked(file.data(), file.mime_type());
+        }
+        ++mDumpGeneration;
+        mDumpCond.notify_all();
+    }break;
+    case eFilesList_Insert: {
+        mInDump = false;
+        mDumpRequestType = 0;
+        for (int n = 0; n < list.item_size(); n++) {
+            const auto &file = list.item(n);
+            insertLocked(file.data(), file.mime_type());
+        }
+    }break;
+    case eFilesList_Delete: {
+        mInDump = false;
+        mDumpRequestType = 0;
+        for (int n = 0; n < list.item_size(); n++) {
+            eraseLocked(list.item(n).data());
+        }
+    }break;
+    default: {
+        KMRE_LOG(LOG_WARNING, "[%s] Unknown FilesList type: %d", __func__, list.type());
+        return false;
+    }
+    }
+
+    return true;
+}
+
+bool MediaIndex::lookup(const std::string &path, std::string &mimeType)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mFiles.find(path);
+    if (it == mFiles.end()) {
+        return false;
+    }
+    mimeType = it->second;
+    return true;
+}
+
+size_t MediaIndex::count(const std::string &mimeType)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mimeType.empty()) {
+        return mFiles.size();
+    }
+    auto bucket = mBuckets.find(mimeType);
+    return (bucket != mBuckets.end()) ? bucket->second.size() : 0;
+}
+
+std::vector<std::string> MediaIndex::list(const std::string &mimeType)
+{
+    std::vector<std::string> paths;
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mimeType.empty()) {
+        paths.reserve(mFiles.size());
+        for (const auto &file : mFiles) {
+            paths.push_back(file.first);
+        }
+        return paths;
+    }
+
+    auto bucket = mBuckets.find(mimeType);
+    if (bucket != mBuckets.end()) {
+        paths.reserve(bucket->second.size());
+        for (const std::string *path : bucket->second) {
+            paths.push_back(*path);
+        }
+    }
+    return paths;
+}
+
+std::vector<std::string> MediaIndex::listUnder(const std::string &dir)
+{
+    std::vector<std::string> paths;
+    std::string prefix = dir;
+    if (prefix.empty() || prefix.back() != '/') {
+        prefix += "/";
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto &file : mFiles) {
+        if (file.first.compare(0, prefix.size(), prefix) == 0) {
+            paths.push_back(file.first);
+        }
+    }
+    return paths;
+}
+
+std::vector<std::pair<std::string, std::string>> MediaIndex::entriesUnder(const std::string &dir)
+{
+    std::vector<std::pair<std::string, std::string>> entries;
+    std::string prefix = dir;
+    if (prefix.empty() || prefix.back() != '/') {
+        prefix += "/";
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    for (const auto &file : mFiles) {
+        if (file.first.compare(0, prefix.size(), prefix) == 0) {
+            entries.emplace_back(file.first, file.second);
+        }
+    }
+    return entries;
+}
+
+uint64_t MediaIndex::dumpGeneration()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDumpGeneration;
+}
+
+bool MediaIndex::applyEmptyDump(uint64_t generation)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mDumpGeneration != generation) {
+        return false;
+    }
+
+    beginDumpLocked();
+    mInDump = false;
+    mDumpRequestType = 0;
+    ++mDumpGeneration;
+    mDumpCond.notify_all();
+    return true;
+}
+
+// dump没有结束标记，以一段时间内不再有新页为准
+bool MediaIndex::waitDumpSettled(uint64_t generation, int settleMs, int timeoutMs)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (!mDumpCond.wait_until(lock, deadline, [&]() { return mDumpGeneration != generation; })) {
+        return false;
+    }
+    for (;;) {
+        uint64_t current = mDumpGeneration;
+        auto settled = std::chrono::steady_clock::now() + std::chrono::milliseconds(settleMs);
+        if (!mDumpCond.wait_until(lock, std::min(settled, deadline), [&]() { return mDumpGeneration != current; })) {
+            return std::chrono::steady_clock::now() >= settled;
+        }
+    }
+}
+
+}
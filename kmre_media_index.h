@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_MEDIA_INDEX_H__
+#define __KMRE_MEDIA_INDEX_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "KmreCore.pb.h"
+
+namespace KmreSocket {
+
+#define MEDIA_DUMP_SETTLE_MS 500    // dump页之间的间隔超过该值视为dump结束
+
+// 安卓媒体库在本地的索引，由FilesList(0:全量dump,1:插入,2:删除)维护
+class MediaIndex
+{
+public:
+    static MediaIndex& getInstance();
+
+    // request_media_files(type)发出前调用，下一次dump只替换该类别的记录; 发送失败时以0调用撤销
+    void expectDump(int requestType);
+    void clear();
+
+    bool applyFilesList(const cn::kylinos::kmre::kmrecore::FilesList &list);
+
+    bool lookup(const std::string &path, std::string &mimeType);
+    size_t count(const std::string &mimeType);// mimeType为空时返回总数
+    std::vector<std::string> list(const std::string &mimeType);
+    std::vector<std::string> listUnder(const std::string &dir);// 目录下(含子目录)的全部文件
+    // 目录下的全部文件及其mime类型
+    std::vector<std::pair<std::string, std::string>> entriesUnder(const std::string &dir);
+
+    // 每收到一页dump加一，用于等待request_media_files的结果
+    uint64_t dumpGeneration();
+    // 等到generation之后的dump开始到达，且settleMs内没有新的dump页; 超时返回false
+    bool waitDumpSettled(uint64_t generation, int settleMs, int timeoutMs);
+    // 安卓媒体库为空时不发送任何dump页; generation之后仍没有dump页到达时按一次空的dump处理并返回true
+    bool applyEmptyDump(uint64_t generation);
+
+    // 索引有使用者(媒体监视、全量比较、request_media_files)时才向事件分发器订阅FilesList，
+    // 没有使用者时kmre_event_dispatch不解析FilesList
+    void acquire();
+    void release();
+    // request_media_files发出后一直保持订阅，直到clear; 本次调用新保持订阅时返回true
+    bool pin();
+    // 撤销pin，用于request_media_files发送失败
+    void unpin();
+
+private:
+    MediaIndex() = default;
+    MediaIndex(const MediaIndex&) = delete;
+    MediaIndex& operator=(const MediaIndex&) = delete;
+
+    void insertLocked(const std::string &path, const std::string &mimeType);
+    void eraseLocked(const std::string &path);
+    void beginDumpLocked();
+
+    std::mutex mMutex;
+    // key为路径，value为mime类型; 分桶中保存的是map中key的地址(节点地址稳定)
+    std::unordered_map<std::string, std::string> mFiles;
+    std::unordered_map<std::string, std::unordered_set<const std::string*>> mBuckets;
+    int mDumpRequestType = 0;
+    bool mInDump = false;
+    std::chrono::steady_clock::time_point mLastDumpPage;
+    uint64_t mDumpGeneration = 0;
+    std::condition_variable mDumpCond;
+
+    std::mutex mUseMutex;
+    int mUsers = 0;
+    bool mPinned = false;
+    int mSubscription = -1;
+};
+
+// 作用域内保持媒体索引的订阅
+class MediaIndexUser
+{
+public:
+    MediaIndexUser() { MediaIndex::getInstance().acquire(); }
+    ~MediaIndexUser() { MediaIndex::getInstance().release(); }
+
+private:
+    MediaIndexUser(const MediaIndexUser&) = delete;
+    MediaIndexUser& operator=(const MediaIndexUser&) = delete;
+};
+
+}
+
+#endif // __KMRE_MEDIA_INDEX_H__
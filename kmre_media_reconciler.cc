@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_media_reconciler.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syslog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "KmreCore.pb.h"
+#include "kmre_log.h"
+#include "kmre_socket.h"
+#include "kmre_pipeline.h"
+#include "kmre_connect_socket.h"
+#include "kmre_media_index.h"
+#include "kmre_media_watcher.h"
+
+namespace KmreSocket {
+
+#define RECONCILE_MAX_THREADS 32
+#define RECONCILE_PROGRESS_MS 200
+#define RECONCILE_SEND_TIMEOUT_MS 5000
+
+typedef std::pair<std::string, std::string> MediaEntry;// 路径, mime类型
+
+std::string ReconcileResult::toJson() const
+{
+    std::string json = std::string("{\"complete\":") + (complete ? "true" : "false");
+    json += std::string(",\"empty_dump\":") + (emptyDump ? "true" : "false");
+    json += ",\"dirs\":" + std::to_string(dirs);
+    json += ",\"host_files\":" + std::to_string(hostFiles);
+    json += ",\"android_files\":" + std::to_string(androidFiles);
+    json += ",\"inserts\":" + std::to_string(inserts);
+    json += ",\"removes\":" + std::to_string(removes);
+    json += ",\"inserts_sent\":" + std::to_string(insertsSent);
+    json += ",\"removes_sent\":" + std::to_string(removesSent);
+    json += ",\"scan_ms\":" + std::to_string(scanMs);
+    json += ",\"fetch_ms\":" + std::to_string(fetchMs);
+    json += ",\"send_ms\":" + std::to_string(sendMs) + "}";
+    return json;
+}
+
+// 每个工作线程从自己队列的尾部取目录(深度优先，局部性好)，空闲时从其他线程队列的头部窃取(较浅的大目录)
+class ScanPool
+{
+public:
+    explicit ScanPool(int threads)
+        : mWorkers(threads) {
+        for (auto &worker : mWorkers) {
+            worker.reset(new Worker());
+        }
+    }
+
+    void push(size_t worker, std::string dir) {
+        ++mPendingDirs;
+        std::lock_guard<std::mutex> lock(mWorkers[worker]->mutex);
+        mWorkers[worker]->dirs.push_back(std::move(dir));
+    }
+
+    void run(const std::function<void(uint64_t)> &progress) {
+        std::vector<std::thread> threads;
+        for (size_t n = 0; n < mWorkers.size(); n++) {
+            threads.emplace_back(&ScanPool::work, this, n);
+        }
+
+        std::unique_lock<std::mutex> lock(mDoneMutex);
+        while (!mDoneCond.wait_for(lock, std::chrono::milliseconds(RECONCILE_PROGRESS_MS),
+                                   [this]() { return mPendingDirs == 0; })) {
+            if (progress) {
+                progress(mScannedDirs);
+            }
+        }
+        lock.unlock();
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint64_t scannedDirs() const { return mScannedDirs; }
+
+    std::vector<MediaEntry> takeFiles() {
+        size_t total = 0;
+        for (const auto &worker : mWorkers) {
+            total += worker->files.size();
+        }
+
+        std::vector<MediaEntry> files;
+        files.reserve(total);
+        for (auto &worker : mWorkers) {
+            std::move(worker->files.begin(), worker->files.end(), std::back_inserter(files));
+            worker->files.clear();
+        }
+        return files;
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::string> dirs;
+        std::vector<MediaEntry> files;// 只有所属线程访问
+    };
+
+    bool take(size_t self, std::string &dir) {
+        {
+            Worker &own = *mWorkers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.dirs.empty()) {
+                dir = std::move(own.dirs.back());
+                own.dirs.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t n = 1; n < mWorkers.size(); n++) {
+            Worker &victim = *mWorkers[(self + n) % mWorkers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.dirs.empty()) {
+                dir = std::move(victim.dirs.front());
+                victim.dirs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t self) {
+        std::string dir;
+        int idle = 0;
+
+        // 队列都为空但还有目录在扫描时，它们可能产生新的子目录，不能退出
+        while (mPendingDirs > 0) {
+            if (!take(self, dir)) {
+                if (++idle < 64) {
+                    std::this_thread::yield();
+                }
+                else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+                continue;
+            }
+            idle = 0;
+
+            scanDir(self, dir);
+            ++mScannedDirs;
+            if (--mPendingDirs == 0) {
+                std::lock_guard<std::mutex> lock(mDoneMutex);
+                mDoneCond.notify_all();
+            }
+        }
+    }
+
+    void scanDir(size_t self, const std::string &dir) {
+        DIR *dp = opendir(dir.c_str());
+        if (!dp) {
+            return;
+        }
+
+        Worker &own = *mWorkers[self];
+        struct dirent *entry;
+        while ((entry = readdir(dp)) != nullptr) {
+            if (entry->d_name[0] == '.') {// 跳过隐藏文件及 . ..，与MediaWatcher一致
+                continue;
+            }
+
+            std::string path = dir + "/" + entry->d_name;
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (lstat(path.c_str(), &st) != 0) {
+                    continue;
+                }
+                type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+            }
+
+            if (type == DT_DIR) {
+                push(self, std::move(path));
+            }
+            else if (type == DT_REG) {
+                std::string mimeType = guess_mime_type(path);
+                if (!mimeType.empty()) {
+                    own.files.emplace_back(std::move(path), std::move(mimeType));
+                }
+            }
+        }
+        closedir(dp);
+    }
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<int64_t> mPendingDirs{0};
+    std::atomic<uint64_t> mScannedDirs{0};
+    std::mutex mDoneMutex;
+    std::condition_variable mDoneCond;
+};
+
+std::vector<MediaEntry> scan_media_files(const std::vector<std::string> &roots, int threads,
+                                         uint64_t *dirCount, const std::function<void(uint64_t)> &progress)
+{
+    if (threads <= 0) {
+        threads = 4;
+    }
+    threads = std::min(threads, RECONCILE_MAX_THREADS);
+
+    ScanPool pool(threads);
+    for (size_t n = 0; n < roots.size(); n++) {
+        pool.push(n % threads, roots[n]);
+    }
+    if (!roots.empty()) {
+        pool.run(progress);
+    }
+
+    if (dirCount) {
+        *dirCount = pool.scannedDirs();
+    }
+    return pool.takeFiles();
+}
+
+static int64_t elapsed_ms(int64_t startUs)
+{
+    return (monotonic_us() - startUs) / 1000;
+}
+
+// 以主机文件建哈希表，用安卓的记录逐个探测: 探测不到的是多余的记录，
+// 探测结束后主机表中未被匹配的是缺少的记录。同一路径mime类型不同时以安卓为准，不重复插入
+static void diff_media(const std::vector<MediaEntry> &hostFiles, const std::vector<MediaEntry> &androidFiles,
+                       std::vector<const MediaEntry *> &inserts, std::vector<const MediaEntry *> &removes)
+{
+    struct HostSlot {
+        const MediaEntry *entry;
+        bool matched;
+    };
+
+    std::unordered_map<std::string, HostSlot> table;
+    table.reserve(hostFiles.size());
+    for (const auto &file : hostFiles) {
+        table.emplace(file.first, HostSlot{&file, false});
+    }
+
+    for (const auto &file : androidFiles) {
+        auto it = table.find(file.first);
+        if (it == table.end()) {
+            removes.push_back(&file);
+        }
+        else {
+            it->second.matched = true;
+        }
+    }
+
+    for (const auto &item : table) {
+        if (!item.second.matched) {
+            inserts.push_back(item.second.entry);
+        }
+    }
+}
+
+template <typename T>
+static uint64_t send_media_batches(const std::vector<const MediaEntry *> &entries, const std::string &socketPath,
+                                   const ReconcileOptions &options, int stage,
+                                   ReconcileCallback callback, void *userData)
+{
+    const size_t batchSize = options.batchSize > 0 ? options.batchSize : 256;
+    uint64_t sent = 0;
+
+    for (size_t begin = 0; begin < entries.size(); begin += batchSize) {
+        const size_t end = std::min(entries.size(), begin + batchSize);
+        std::vector<PipelineRequest> requests(end - begin);
+        for (size_t n = begin; n < end; n++) {
+            T obj;
+            obj.set_data(entries[n]->first);
+            obj.set_mime_type(entries[n]->second);
+            make_pipeline_request(requests[n - begin], socketPath, obj);
+        }
+
+        sent += run_pipeline(requests, options.maxInflight > 0 ? options.maxInflight : 16, RECONCILE_SEND_TIMEOUT_MS);
+        if (callback) {
+            callback(stage, static_cast<long long>(end), static_cast<long long>(entries.size()), userData);
+        }
+    }
+    return sent;
+}
+
+// 去掉包含在其他目录中的目录，避免重复扫描
+static std::vector<std::string> outermost_dirs(std::vector<std::string> dirs)
+{
+    std::sort(dirs.begin(), dirs.end());
+    std::vector<std::string> roots;
+    for (const auto &dir : dirs) {
+        if (!roots.empty()) {
+            const std::string &last = roots.back();
+            if (dir == last || (dir.compare(0, last.size(), last) == 0 &&
+                                (last.back() == '/' || dir[last.size()] == '/'))) {
+                continue;
+            }
+        }
+        roots.push_back(dir);
+    }
+    return roots;
+}
+
+bool reconcile_media(const std::vector<std::string> &dirs, const ReconcileOptions &options,
+                     ReconcileCallback callback, void *userData, ReconcileResult &result)
+{
+    result = ReconcileResult();
+    const std::vector<std::string> roots = outermost_dirs(dirs);
+    const std::string managerSocketPath = get_socket_path(eLink_Manager);
+
+    // 先请求dump，扫描主机目录的同时等待安卓回复
+    MediaIndexUser indexUser;
+    int64_t start = monotonic_us();
+    uint64_t generation = 0;
+    bool dumpRequested = false;
+    if (options.dumpTimeoutMs >= 0) {
+        cn::kylinos::kmre::kmrecore::RequestMediaFiles obj;
+        obj.set_type(0);
+        MediaIndex::getInstance().expectDump(0);
+        generation = MediaIndex::getInstance().dumpGeneration();
+        if (send_command(obj) != eCommand_Ok) {
+            KMRE_LOG(LOG_ERR, "[%s] Request media files failed!", __func__);
+            return false;
+        }
+        dumpRequested = true;
+    }
+
+    std::vector<MediaEntry> hostFiles = scan_media_files(roots, options.threads, &result.dirs, [&](uint64_t dirs) {
+        if (callback) {
+            callback(eReconcile_Scanning, static_cast<long long>(dirs), -1, userData);
+        }
+    });
+    result.hostFiles = hostFiles.size();
+    result.scanMs = elapsed_ms(start);
+    if (callback) {
+        callback(eReconcile_Scanning, static_cast<long long>(result.dirs), static_cast<long long>(result.dirs), userData);
+    }
+
+    int64_t fetchStart = monotonic_us();
+    if (dumpRequested) {
+        if (callback) {
+            callback(eReconcile_Fetching, 0, -1, userData);
+        }
+        int remainingMs = static_cast<int>(std::max<int64_t>(0, options.dumpTimeoutMs - elapsed_ms(start)));
+        if (!MediaIndex::getInstance().waitDumpSettled(generation, MEDIA_DUMP_SETTLE_MS, remainingMs)) {
+            // 媒体库为空时安卓不发送dump页，本地索引中的旧记录不能再用
+            if (!MediaIndex::getInstance().applyEmptyDump(generation)) {
+                KMRE_LOG(LOG_ERR, "[%s] Media dump from android not finished in %d ms!", __func__,
+                         options.dumpTimeoutMs);
+                return false;
+            }
+            KMRE_LOG(LOG_WARNING, "[%s] No media dump from android in %d ms, treat media db as empty.", __func__,
+                     options.dumpTimeoutMs);
+            result.emptyDump = true;
+        }
+    }
+
+    std::vector<MediaEntry> androidFiles;
+    for (const auto &root : roots) {
+        std::vector<MediaEntry> entries = MediaIndex::getInstance().entriesUnder(root);
+        std::move(entries.begin(), entries.end(), std::back_inserter(androidFiles));
+    }
+    result.androidFiles = androidFiles.size();
+    result.fetchMs = elapsed_ms(fetchStart);
+
+    std::vector<const MediaEntry *> inserts;
+    std::vector<const MediaEntry *> removes;
+    diff_media(hostFiles, androidFiles, inserts, removes);
+    result.inserts = inserts.size();
+    result.removes = removes.size();
+
+    int64_t sendStart = monotonic_us();
+    result.removesSent = send_media_batches<cn::kylinos::kmre::kmrecore::RemoveFile>(
+        removes, managerSocketPath, options, eReconcile_Removing, callback, userData);
+    result.insertsSent = send_media_batches<cn::kylinos::kmre::kmrecore::InsertFile>(
+        inserts, managerSocketPath, options, eReconcile_Inserting, callback, userData);
+    result.sendMs = elapsed_ms(sendStart);
+
+    result.complete = (result.removesSent == result.removes) && (result.insertsSent == result.inserts);
+    if (callback) {
+        callback(eReconcile_Finished, static_cast<long long>(result.removesSent + result.insertsSent),
+                 static_cast<long long>(result.removes + result.inserts), userData);
+    }
+    KMRE_LOG(LOG_INFO, "[%s] %s", __func__, result.toJson().c_str());
+    return true;
+}
+
+}
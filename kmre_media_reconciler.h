@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_MEDIA_RECONCILER_H__
+#define __KMRE_MEDIA_RECONCILER_H__
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace KmreSocket {
+
+typedef enum {
+    eReconcile_Scanning = 0,    // 扫描主机目录，done为已扫描的目录数
+    eReconcile_Fetching,        // 等待安卓的媒体库dump
+    eReconcile_Removing,        // 发送RemoveFile，done/total为已发送/需发送的个数
+    eReconcile_Inserting,       // 发送InsertFile
+    eReconcile_Finished,
+}ReconcileStage;
+
+// 回调在调用reconcile_media的线程中执行
+typedef void (*ReconcileCallback)(int stage, long long done, long long total, void *user_data);
+
+struct ReconcileOptions {
+    int threads = 4;            // 扫描线程数
+    int dumpTimeoutMs = 10000;  // 小于0时不请求dump，直接与本地索引比较
+    int batchSize = 256;        // 每批发送的请求数，每批结束后回调一次进度
+    int maxInflight = 16;
+};
+
+struct ReconcileResult {
+    bool complete = false;      // 需要发送的请求全部发送成功
+    bool emptyDump = false;     // 等待超时仍没有收到dump页，按安卓媒体库为空处理
+    uint64_t dirs = 0;          // 扫描的目录数
+    uint64_t hostFiles = 0;
+    uint64_t androidFiles = 0;
+    uint64_t inserts = 0;       // 需要插入的个数
+    uint64_t removes = 0;
+    uint64_t insertsSent = 0;
+    uint64_t removesSent = 0;
+    int64_t scanMs = 0;
+    int64_t fetchMs = 0;
+    int64_t sendMs = 0;
+
+    std::string toJson() const;
+};
+
+// 多线程扫描目录(含子目录)，返回能识别mime类型的文件; 工作线程各有自己的目录队列，空闲时从其他线程窃取
+// progress在调用线程中约每200毫秒调用一次，参数为已扫描的目录数
+std::vector<std::pair<std::string, std::string>> scan_media_files(const std::vector<std::string> &roots, int threads,
+                                                                  uint64_t *dirCount,
+                                                                  const std::function<void(uint64_t)> &progress = nullptr);
+
+// 扫描主机目录(互相包含的只扫描最外层)并取得安卓当前的媒体库，比较后只发送缺少的InsertFile和多余的RemoveFile;
+// 请求dump失败，或dump页持续到达直到超时仍未结束时返回false，此时不发送任何请求;
+// 超时前一页dump都没有收到时视为安卓媒体库为空(如媒体库重置后)，全部补发
+bool reconcile_media(const std::vector<std::string> &dirs, const ReconcileOptions &options,
+                     ReconcileCallback callback, void *userData, ReconcileResult &result);
+
+}
+
+#endif // __KMRE_MEDIA_RECONCILER_H__
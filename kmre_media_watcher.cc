@@ -0,0 +1,450 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_media_watcher.h"
+
+#include <poll.h>
+#include <time.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/syslog.h>
+#include <algorithm>
+
+#include "KmreCore.pb.h"
+#include "kmre_socket.h"
+#include "kmre_log.h"
+#include "kmre_pipeline.h"
+#include "kmre_media_index.h"
+
+namespace KmreSocket {
+
+#define WATCHER_MAX_DELAY_MS 3000     // 持续有事件时，最早的记录最多等待多久
+#define WATCHER_SEND_TIMEOUT_MS 5000
+#define WATCHER_RETRY_MIN_MS 1000     // 发送失败(如容器未启动或正在重启)后的退避时间，每次失败加倍
+#define WATCHER_RETRY_MAX_MS 30000
+#define WATCHER_FILE_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF)
+
+struct MimeEntry {
+    const char *ext;
+    const char *mime;
+};
+
+static const MimeEntry kMimeTable[] = {
+    {"jpg", "image/jpeg"}, {"jpeg", "image/jpeg"}, {"png", "image/png"}, {"gif", "image/gif"},
+    {"bmp", "image/bmp"}, {"webp", "image/webp"}, {"heic", "image/heic"}, {"svg", "image/svg+xml"},
+    {"mp4", "video/mp4"}, {"mkv", "video/x-matroska"}, {"avi", "video/x-msvideo"}, {"mov", "video/quicktime"},
+    {"3gp", "video/3gpp"}, {"webm", "video/webm"}, {"flv", "video/x-flv"}, {"wmv", "video/x-ms-wmv"},
+    {"mp3", "audio/mpeg"}, {"wav", "audio/x-wav"}, {"flac", "audio/flac"}, {"aac", "audio/aac"},
+    {"ogg", "audio/ogg"}, {"m4a", "audio/mp4"}, {"wma", "audio/x-ms-wma"}, {"amr", "audio/amr"},
+    {"pdf", "application/pdf"}, {"txt", "text/plain"}, {"rtf", "application/rtf"},
+    {"doc", "application/msword"},
+    {"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+    {"xls", "application/vnd.ms-excel"},
+    {"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+    {"ppt", "application/vnd.ms-powerpoint"},
+    {"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+    {"odt", "application/vnd.oasis.opendocument.text"},
+    {"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+    {"odp", "application/vnd.oasis.opendocument.presentation"},
+    {"wps", "application/vnd.ms-works"},
+};
+
+std::string guess_mime_type(const std::string &path)
+{
+    size_t slash = path.rfind('/');
+    size_t dot = path.rfind('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return "";
+    }
+
+    const char *ext = path.c_str() + dot + 1;
+    for (const auto &entry : kMimeTable) {
+        if (strcasecmp(ext, entry.ext) == 0) {
+            return entry.mime;
+        }
+    }
+    return "";
+}
+
+static int64_t monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+MediaWatcher& MediaWatcher::getInstance()
+{
+    static MediaWatcher instance;
+    return instance;
+}
+
+MediaWatcher::~MediaWatcher()
+{
+    stop();
+}
+
+void MediaWatcher::setOptions(int debounceMs, int maxPending, int maxInflight)
+{
+    if (debounceMs >= 0) {
+        mDebounceMs = debounceMs;
+    }
+    if (maxPending > 0) {
+        mMaxPending = maxPending;
+    }
+    if (maxInflight > 0) {
+        mMaxInflight = maxInflight;
+    }
+}
+
+bool MediaWatcher::start(const std::vector<std::string> &dirs)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mRunning) {
+        KMRE_LOG(LOG_WARNING, "[%s] Media watcher is already running!", __func__);
+        return false;
+    }
+
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (mInotifyFd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] inotify_init1 failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    mWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mWakeFd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] eventfd failed: %s", __func__, strerror(errno));
+        close(mInotifyFd);
+        mInotifyFd = -1;
+        return false;
+    }
+
+    mManagerSocketPath = get_socket_path(eLink_Manager);
+    mWatchDirs.clear();
+    mPending.clear();
+    mPendingCount = 0;
+    mRetryAtMs = 0;
+    mBackoffMs = 0;
+    mDropped = 0;
+
+    for (const auto &dir : dirs) {
+        addWatchRecursive(dir, false);
+    }
+    if (mWatchDirs.empty()) {
+        KMRE_LOG(LOG_ERR, "[%s] No directory can be watched!", __func__);
+        close(mWakeFd);
+        close(mInotifyFd);
+        mWakeFd = mInotifyFd = -1;
+        return false;
+    }
+
+    MediaIndex::getInstance().acquire();// 插入前需要查询索引，运行期间由事件保持更新
+    mRunning = true;
+    mThread = std::thread(&MediaWatcher::run, this);
+    return true;
+}
+
+void MediaWatcher::stop()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mRunning) {
+        return;
+    }
+
+    mRunning = false;
+    uint64_t one = 1;
+    if (write(mWakeFd, &one, sizeof(one)) < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Wake up media watcher failed: %s", __func__, strerror(errno));
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    close(mWakeFd);
+    close(mInotifyFd);
+    mWakeFd = mInotifyFd = -1;
+    mWatchDirs.clear();
+    MediaIndex::getInstance().release();
+}
+
+void MediaWatcher::addWatchRecursive(const std::string &dir, bool enqueueFiles)
+{
+    int wd = inotify_add_watch(mInotifyFd, dir.c_str(), WATCHER_FILE_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Watch '%s' failed: %s", __func__, dir.c_str(), strerror(errno));
+        return;
+    }
+    mWatchDirs[wd] = dir;
+
+    DIR *dp = opendir(dir.c_str());
+    if (!dp) {
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dp)) != nullptr) {
+        if (entry->d_name[0] == '.') {// 跳过隐藏文件及 . ..
+            continue;
+        }
+
+        std::string path = dir + "/" + entry->d_name;
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (lstat(path.c_str(), &st) != 0) {
+                continue;
+            }
+            type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+        }
+
+        if (type == DT_DIR) {
+            addWatchRecursive(path, enqueueFiles);
+        }
+        else if (type == DT_REG && enqueueFiles) {
+            // 目录是新建或移入的，其中已有的文件不会再产生事件
+            enqueue(path, true);
+        }
+    }
+    closedir(dp);
+}
+
+void MediaWatcher::removeWatchesUnder(const std::string &dir)
+{
+    const std::string prefix = dir + "/";
+    for (auto it = mWatchDirs.begin(); it != mWatchDirs.end();) {
+        if (it->second == dir || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(mInotifyFd, it->first);
+            it = mWatchDirs.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+
+    for (auto it = mPending.begin(); it != mPending.end();) {
+        if (it->second.insert && it->first.compare(0, prefix.size(), prefix) == 0) {
+            it = mPending.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    mPendingCount = mPending.size();
+
+    for (const auto &path : MediaIndex::getInstance().listUnder(dir)) {
+        enqueue(path, false);
+    }
+}
+
+// 同一路径只保留最后一次操作
+void MediaWatcher::enqueue(const std::string &path, bool insert)
+{
+    std::string mimeType;
+    if (insert || !MediaIndex::getInstance().lookup(path, mimeType)) {
+        mimeType = guess_mime_type(path);
+    }
+    if (mimeType.empty()) {
+        return;
+    }
+
+    int64_t now = monotonic_ms();
+    if (mPending.empty()) {
+        mFirstPendingMs = now;
+    }
+    mLastEventMs = now;
+
+    const size_t maxPending = static_cast<size_t>(mMaxPending.load());
+    if (mPending.size() >= maxPending && now < mRetryAtMs && mPending.find(path) == mPending.end()) {
+        // 退避期间不读取inotify，只有同一批事件或新目录的扫描会走到这里
+        if (mDropped++ == 0) {
+            KMRE_LOG(LOG_WARNING, "[%s] Pending media changes reach %zu while backing off, drop new ones!",
+                     __func__, maxPending);
+        }
+        return;
+    }
+
+    PendingOp &op = mPending[path];
+    op.insert = insert;
+    op.mimeType = mimeType;
+    mPendingCount = mPending.size();
+
+    if (mPending.size() >= maxPending) {
+        flush();
+    }
+}
+
+void MediaWatcher::handleEvent(const struct inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW) {
+        KMRE_LOG(LOG_WARNING, "[%s] inotify queue overflow, some changes are lost!", __func__);
+        return;
+    }
+    if (event->mask & IN_IGNORED) {
+        mWatchDirs.erase(event->wd);
+        return;
+    }
+
+    auto dir = mWatchDirs.find(event->wd);
+    if (dir == mWatchDirs.end() || event->len == 0 || event->name[0] == '.') {
+        return;
+    }
+    const std::string path = dir->second + "/" + event->name;
+
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            addWatchRecursive(path, true);
+        }
+        else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            removeWatchesUnder(path);
+        }
+        return;
+    }
+
+    if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        enqueue(path, true);
+    }
+    else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        enqueue(path, false);
+    }
+}
+
+void MediaWatcher::flush()
+{
+    if (mPending.empty() || monotonic_ms() < mRetryAtMs) {
+        return;
+    }
+
+    std::vector<std::pair<std::string, PendingOp>> batch(mPending.begin(), mPending.end());
+    std::vector<PipelineRequest> requests(batch.size());
+    size_t n = 0;
+    for (const auto &item : batch) {
+        if (item.second.insert) {
+            cn::kylinos::kmre::kmrecore::InsertFile obj;
+            obj.set_data(item.first);
+            obj.set_mime_type(item.second.mimeType);
+            make_pipeline_request(requests[n++], mManagerSocketPath, obj);
+        }
+        else {
+            cn::kylinos::kmre::kmrecore::RemoveFile obj;
+            obj.set_data(item.first);
+            obj.set_mime_type(item.second.mimeType);
+            make_pipeline_request(requests[n++], mManagerSocketPath, obj);
+        }
+    }
+    mPending.clear();
+    mPendingCount = 0;
+
+    int succeeded = run_pipeline(requests, mMaxInflight, WATCHER_SEND_TIMEOUT_MS);
+    if (succeeded == static_cast<int>(requests.size())) {
+        mRetryAtMs = 0;
+        mBackoffMs = 0;
+        mDropped = 0;
+        return;
+    }
+
+    // 失败(包括调度排队已满)的记录放回待发送表(已有同一路径更新的操作时以新的为准)，退避后再发送
+    const int64_t now = monotonic_ms();
+    if (mPending.empty()) {
+        mFirstPendingMs = now;
+    }
+    for (size_t i = 0; i < requests.size(); i++) {
+        if (!requests[i].ok) {
+            mPending.emplace(std::move(batch[i].first), std::move(batch[i].second));
+        }
+    }
+    mPendingCount = mPending.size();
+    mBackoffMs = (mBackoffMs == 0) ? WATCHER_RETRY_MIN_MS : std::min(mBackoffMs * 2, WATCHER_RETRY_MAX_MS);
+    mRetryAtMs = now + mBackoffMs;
+    KMRE_LOG(LOG_ERR, "[%s] %zu media changes, %d sent, retry %zu in %d ms!", __func__, requests.size(),
+             succeeded, mPending.size(), mBackoffMs);
+}
+
+void MediaWatcher::run()
+{
+    while (mRunning) {
+        int timeout = -1;
+        if (!mPending.empty()) {
+            int64_t due = mLastEventMs + mDebounceMs;
+            if (mFirstPendingMs + WATCHER_MAX_DELAY_MS < due) {
+                due = mFirstPendingMs + WATCHER_MAX_DELAY_MS;
+            }
+            if (due < mRetryAtMs) {
+                due = mRetryAtMs;
+            }
+            int64_t wait = due - monotonic_ms();
+            timeout = (wait > 0) ? static_cast<int>(wait) : 0;
+        }
+
+        // 退避期间待发送表已满时不读取inotify，事件暂存在内核队列中
+        const bool full = mPending.size() >= static_cast<size_t>(mMaxPending.load());
+        struct pollfd fds[2] = {
+            {full ? -1 : mInotifyFd, POLLIN, 0},
+            {mWakeFd, POLLIN, 0},
+        };
+        int ret = poll(fds, 2, timeout);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            KMRE_LOG(LOG_ERR, "[%s] poll failed: %s", __func__, strerror(errno));
+            break;
+        }
+        if (ret == 0) {
+            flush();
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            readEvents();
+        }
+    }
+
+    // 停止前处理已经产生的事件，不再等待退避
+    readEvents();
+    mRetryAtMs = 0;
+    flush();
+    if (!mPending.empty()) {
+        KMRE_LOG(LOG_ERR, "[%s] %zu media changes are not sent before stop!", __func__, mPending.size());
+    }
+}
+
+void MediaWatcher::readEvents()
+{
+    alignas(struct inotify_event) char buf[16 * 1024];
+
+    for (;;) {
+        ssize_t len = read(mInotifyFd, buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+        for (char *ptr = buf; ptr < buf + len;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            handleEvent(event);
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_MEDIA_WATCHER_H__
+#define __KMRE_MEDIA_WATCHER_H__
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+struct inotify_event;
+
+namespace KmreSocket {
+
+// 根据文件扩展名推断mime类型，非媒体/文档文件返回空字符串
+std::string guess_mime_type(const std::string &path);
+
+// 监听主机目录的文件变化，去重合并后批量向安卓发送InsertFile/RemoveFile
+class MediaWatcher
+{
+public:
+    static MediaWatcher& getInstance();
+
+    bool start(const std::vector<std::string> &dirs);
+    void stop();
+    bool isRunning() { return mRunning; }
+
+    // debounceMs: 最后一个事件后等待多久再发送
+    // maxPending: 待发送记录上限，达到上限时立即发送; 发送失败的记录放回待发送表，
+    //             退避期间表满则暂停读取inotify
+    // maxInflight: 发送时同时在途的连接数
+    void setOptions(int debounceMs, int maxPending, int maxInflight);
+    size_t pendingCount() { return mPendingCount; }
+
+private:
+    MediaWatcher() = default;
+    ~MediaWatcher();
+    MediaWatcher(const MediaWatcher&) = delete;
+    MediaWatcher& operator=(const MediaWatcher&) = delete;
+
+    struct PendingOp {
+        bool insert;
+        std::string mimeType;
+    };
+
+    void run();
+    void readEvents();
+    void addWatchRecursive(const std::string &dir, bool enqueueFiles);
+    void removeWatchesUnder(const std::string &dir);
+    void handleEvent(const struct inotify_event *event);
+    void enqueue(const std::string &path, bool insert);
+    void flush();
+
+    std::mutex mMutex;// 保护start/stop
+    std::thread mThread;
+    std::atomic<bool> mRunning{false};
+    int mInotifyFd = -1;
+    int mWakeFd = -1;
+    std::string mManagerSocketPath;
+
+    std::unordered_map<int, std::string> mWatchDirs;
+    std::unordered_map<std::string, PendingOp> mPending;
+    std::atomic<size_t> mPendingCount{0};
+    int64_t mFirstPendingMs = 0;
+    int64_t mLastEventMs = 0;
+    int64_t mRetryAtMs = 0;     // 上次发送有失败时，在此之前不再发送
+    int mBackoffMs = 0;
+    size_t mDropped = 0;        // 退避期间表满而丢弃的记录数
+
+    std::atomic<int> mDebounceMs{500};
+    std::atomic<int> mMaxPending{4096};
+    std::atomic<int> mMaxInflight{16};
+};
+
+}
+
+#endif // __KMRE_MEDIA_WATCHER_H__
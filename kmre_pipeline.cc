@@ -0,0 +1,907 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_pipeline.h"
+
+#include <deque>
+#include <list>
+#include <set>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syslog.h>
+
+#include "kmre_uring.h"
+#include "kmre_scheduler.h"
+#include "kmre_log.h"
+#include "kmre_trace.h"
+#include "kmre_probe.h"
+#include "kmre_shm_ring.h"
+
+namespace KmreSocket {
+
+#define PIPELINE_MAX_EVENTS 64
+#define PIPELINE_RETRY_DELAY_MS 5
+#define URING_SLOT_BUF_SIZE (16 * 1024)
+#define PIPELINE_GATE_WAIT_MS 100
+#define PIPELINE_GATE_POLL_MS 5
+
+typedef enum {
+    eSlot_Idle = 0,
+    eSlot_Sending,
+    eSlot_Reading,
+}SlotState;
+
+struct PipelineSlot {
+    size_t req = 0;
+    int fd = -1;
+    SlotState state = eSlot_Idle;
+    size_t sent = 0;
+    int64_t deadline = 0;
+    unsigned char header[4] = {0};
+    ScheduleTicket ticket;      // 连接和发送期间占用批量名额
+};
+
+struct PipelineRetry {
+    size_t req;
+    int64_t notBefore;
+};
+
+static int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 流水线中的请求都属于批量命令: 有交互命令在途或批量名额用完时暂不发起新连接，已发出的请求照常完成;
+// 每个请求在连接和发送期间占用一个批量名额，与ConnectSocket共用同一上限
+static bool bulk_turn(bool hasPending, int64_t now, int64_t &gatedSince)
+{
+    if (!hasPending) {
+        return true;
+    }
+
+    bool turn = RequestScheduler::getInstance().waitBulkTurn(0);
+    if (!turn && gatedSince == 0) {
+        gatedSince = now;
+    }
+    else if (turn && gatedSince != 0) {
+        RequestScheduler::getInstance().recordBulkWait((now - gatedSince) * 1000);
+        gatedSince = 0;
+    }
+    return turn;
+}
+
+static void complete_request(size_t index, PipelineRequest &req, bool ok, int err,
+                             const PipelineCallback &onComplete)
+{
+    req.ok = ok;
+    req.err = err;
+    if (ok && req.expectReply) {
+        KMRE_PROBE_REPLY(req.index, req.link, req.reply.size());
+    }
+    if (!ok) {
+        KMRE_PROBE_ERROR(req.index, req.link, eSpan_Command, err);
+        KMRE_LOG(LOG_ERR, "[%s] Request(head:%04d) to '%s' failed: %s",
+            __func__, req.index, req.socketPath.c_str(), strerror(err));
+    }
+    if (onComplete) {
+        onComplete(index, req);
+    }
+}
+
+static void finish_slot(int epfd, PipelineSlot &slot, PipelineRequest &req, bool ok, int err,
+                        const PipelineCallback &onComplete)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, slot.fd, nullptr);
+    close(slot.fd);
+    slot.fd = -1;
+    slot.state = eSlot_Idle;
+    slot.ticket.reset();
+    complete_request(slot.req, req, ok, err, onComplete);
+}
+
+static bool make_socket_addr(const std::string &path, struct sockaddr_un &un, socklen_t &len)
+{
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(un.sun_path)) {
+        return false;
+    }
+    memcpy(un.sun_path, path.c_str(), path.size());
+    len = offsetof(struct sockaddr_un, sun_path) + path.size();
+    return true;
+}
+
+// 返回 1:已发起连接 0:服务端backlog已满，稍后重试 -1:失败
+static int start_request(int epfd, PipelineSlot &slot, size_t slotIndex, PipelineRequest &req)
+{
+    struct sockaddr_un un;
+    socklen_t len;
+    if (!make_socket_addr(req.socketPath, un, len)) {
+        req.err = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        req.err = errno;
+        return -1;
+    }
+
+    KMRE_PROBE_CONNECT_START(req.index, req.link);
+    if (connect(fd, (struct sockaddr*)&un, len) < 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(fd);
+        if (err == EAGAIN) {
+            return 0;
+        }
+        req.err = err;
+        return -1;
+    }
+    KMRE_PROBE_CONNECT_DONE(req.index, req.link, fd);// unix socket的connect不会真正异步完成
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLOUT;
+    ev.data.u64 = slotIndex;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        req.err = errno;
+        close(fd);
+        return -1;
+    }
+
+    slot.fd = fd;
+    slot.state = eSlot_Sending;
+    slot.sent = 0;
+    encode_cmd_header(req.index, slot.header);
+    return 1;
+}
+
+// 返回 1:发送完成 0:需等待可写 -1:失败
+static int pump_send(PipelineSlot &slot, PipelineRequest &req)
+{
+    const size_t total = sizeof(slot.header) + req.payload.size();
+
+    while (slot.sent < total) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (slot.sent < sizeof(slot.header)) {
+            iov[iovcnt].iov_base = slot.header + slot.sent;
+            iov[iovcnt].iov_len = sizeof(slot.header) - slot.sent;
+            ++iovcnt;
+            iov[iovcnt].iov_base = const_cast<char *>(req.payload.data());
+            iov[iovcnt].iov_len = req.payload.size();
+            ++iovcnt;
+        }
+        else {
+            size_t offset = slot.sent - sizeof(slot.header);
+            iov[iovcnt].iov_base = const_cast<char *>(req.payload.data()) + offset;
+            iov[iovcnt].iov_len = req.payload.size() - offset;
+            ++iovcnt;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t n = sendmsg(slot.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            req.err = errno;
+            return -1;
+        }
+        slot.sent += n;
+    }
+
+    return 1;
+}
+
+// 返回 1:服务端已关闭连接(回复完整) 0:需等待可读 -1:失败
+static int pump_read(PipelineSlot &slot, PipelineRequest &req)
+{
+    char buf[BUF_SIZE];
+
+    for (;;) {
+        ssize_t n = recv(slot.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) {
+            req.reply.append(buf, n);
+            continue;
+        }
+        if (n == 0) {
+            return 1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        req.err = errno;
+        return -1;
+    }
+}
+
+static int run_pipeline_epoll(std::vector<PipelineRequest> &requests, int maxInflight, int timeoutMs,
+                              const PipelineCallback &onComplete)
+{
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] epoll_create1 failed: %s", __func__, strerror(errno));
+        for (auto &req : requests) {
+            req.ok = false;
+            req.err = errno;
+        }
+        return 0;
+    }
+
+    std::vector<PipelineSlot> slots(maxInflight);
+    std::vector<int64_t> startTime(requests.size(), 0);
+    std::deque<size_t> pending;
+    std::deque<PipelineRetry> retries;
+    int active = 0;
+    int succeeded = 0;
+    int64_t gatedSince = 0;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending.push_back(i);
+    }
+
+    while (!pending.empty() || !retries.empty() || active > 0) {
+        int64_t now = now_ms();
+
+        while (!retries.empty() && retries.front().notBefore <= now) {
+            pending.push_front(retries.front().req);
+            retries.pop_front();
+        }
+
+        // 没有在途请求时在acquireFor中排队等待，否则只在可以放行时发起新连接
+        bool bulkTurn = bulk_turn(!pending.empty(), now, gatedSince);
+        for (size_t s = 0; s < slots.size() && !pending.empty() && (bulkTurn || active == 0); s++) {
+            if (slots[s].state != eSlot_Idle) {
+                continue;
+            }
+
+            size_t index = pending.front();
+            pending.pop_front();
+            PipelineRequest &req = requests[index];
+            if (startTime[index] == 0) {
+                startTime[index] = now;
+            }
+            if (now - startTime[index] > timeoutMs) {
+                req.err = ETIMEDOUT;
+                if (onComplete) {
+                    onComplete(index, req);
+                }
+                continue;
+            }
+
+            AdmitResult admit = slots[s].ticket.acquireFor(ePriority_Bulk, bulkTurn ? 0 : PIPELINE_GATE_WAIT_MS);
+            if (admit == eAdmit_QueueFull) {
+                // 排队已满，由调用方决定稍后重试(如媒体监听放回待发送表并退避)
+                complete_request(index, req, false, EBUSY, onComplete);
+                continue;
+            }
+            if (admit != eAdmit_Ok) {
+                pending.push_front(index);// 名额被其他调用者占用，稍后再试
+                bulkTurn = false;
+                break;
+            }
+
+            slots[s].req = index;
+            int ret = start_request(epfd, slots[s], s, req);
+            if (ret > 0) {
+                slots[s].deadline = startTime[index] + timeoutMs;
+                ++active;
+            }
+            else if (ret == 0) {
+                slots[s].ticket.reset();
+                retries.push_back({index, now + PIPELINE_RETRY_DELAY_MS});
+            }
+            else {
+                slots[s].ticket.reset();
+                KMRE_LOG(LOG_ERR, "[%s] Connect '%s' failed: %s",
+                    __func__, req.socketPath.c_str(), strerror(req.err));
+                if (onComplete) {
+                    onComplete(index, req);
+                }
+            }
+        }
+
+        if (active == 0) {
+            if (!bulkTurn) {
+                continue;// 已在acquireFor中等待过
+            }
+            if (retries.empty()) {
+                continue;
+            }
+            int64_t wait = retries.front().notBefore - now_ms();
+            if (wait > 0) {
+                struct timespec ts = {static_cast<time_t>(wait / 1000), static_cast<long>((wait % 1000) * 1000000)};
+                nanosleep(&ts, nullptr);
+            }
+            continue;
+        }
+
+        int64_t wait = timeoutMs;
+        for (const auto &slot : slots) {
+            if (slot.state != eSlot_Idle && slot.deadline - now < wait) {
+                wait = slot.deadline - now;
+            }
+        }
+        if (!retries.empty() && retries.front().notBefore - now < wait) {
+            wait = retries.front().notBefore - now;
+        }
+        if (!bulkTurn && wait > PIPELINE_GATE_POLL_MS) {
+            wait = PIPELINE_GATE_POLL_MS;
+        }
+        if (wait < 0) {
+            wait = 0;
+        }
+
+        struct epoll_event events[PIPELINE_MAX_EVENTS];
+        int n = epoll_wait(epfd, events, PIPELINE_MAX_EVENTS, static_cast<int>(wait));
+        if (n < 0 && errno != EINTR) {
+            KMRE_LOG(LOG_ERR, "[%s] epoll_wait failed: %s", __func__, strerror(errno));
+            break;
+        }
+
+        for (int e = 0; e < n; e++) {
+            PipelineSlot &slot = slots[events[e].data.u64];
+            if (slot.state == eSlot_Idle) {
+                continue;
+            }
+            PipelineRequest &req = requests[slot.req];
+
+            if (slot.state == eSlot_Sending) {
+                int ret = pump_send(slot, req);
+                if (ret < 0) {
+                    finish_slot(epfd, slot, req, false, req.err, onComplete);
+                    --active;
+                }
+                else if (ret > 0) {
+                    req.sent = true;
+                    slot.ticket.reset();
+                    KMRE_PROBE_SEND(req.index, req.link, sizeof(slot.header) + req.payload.size());
+                    if (!req.expectReply) {
+                        finish_slot(epfd, slot, req, true, 0, onComplete);
+                        ++succeeded;
+                        --active;
+                    }
+                    else {
+                        struct epoll_event ev;
+                        memset(&ev, 0, sizeof(ev));
+                        ev.events = EPOLLIN | EPOLLRDHUP;
+                        ev.data.u64 = events[e].data.u64;
+                        epoll_ctl(epfd, EPOLL_CTL_MOD, slot.fd, &ev);
+                        slot.state = eSlot_Reading;
+                    }
+                }
+                continue;
+            }
+
+            int ret = pump_read(slot, req);
+            if (ret != 0) {
+                finish_slot(epfd, slot, req, ret > 0, ret > 0 ? 0 : req.err, onComplete);
+                if (ret > 0) {
+                    ++succeeded;
+                }
+                --active;
+            }
+        }
+
+        now = now_ms();
+        for (auto &slot : slots) {
+            if (slot.state != eSlot_Idle && now >= slot.deadline) {
+                finish_slot(epfd, slot, requests[slot.req], false, ETIMEDOUT, onComplete);
+                --active;
+            }
+        }
+    }
+
+    for (auto &slot : slots) {
+        if (slot.state != eSlot_Idle) {
+            finish_slot(epfd, slot, requests[slot.req], false, EIO, onComplete);
+        }
+    }
+    for (const auto &retry : retries) {
+        pending.push_back(retry.req);
+    }
+    for (size_t index : pending) {
+        requests[index].err = EIO;
+        if (onComplete) {
+            onComplete(index, requests[index]);
+        }
+    }
+    close(epfd);
+
+    return succeeded;
+}
+
+typedef enum {
+    eUringOp_Connect = 0,
+    eUringOp_Send,
+    eUringOp_Read,
+    eUringOp_Cancel,
+}UringOp;
+
+// 每个在途请求的状态; msghdr、地址等在操作完成前须保持有效
+struct UringSlot {
+    size_t req = 0;
+    int fd = -1;
+    bool busy = false;
+    int outstanding = 0;        // 已提交未完成的操作数
+    int err = 0;
+    bool retry = false;         // 服务端backlog已满，稍后重试
+    bool canceled = false;      // 已超时并取消
+    bool done = false;
+    size_t sent = 0;
+    int64_t deadline = 0;
+    unsigned char header[4] = {0};
+    struct sockaddr_un addr;
+    socklen_t addrLen = 0;
+    struct iovec iov[2];
+    struct msghdr msg;
+    char *buf = nullptr;        // 注册给io_uring的接收缓冲区
+    ScheduleTicket ticket;      // 连接和发送期间占用批量名额
+};
+
+static uint64_t uring_user_data(size_t slotIndex, UringOp op)
+{
+    return (static_cast<uint64_t>(slotIndex) << 2) | op;
+}
+
+static bool queue_uring_send(IoUring &ring, UringSlot &slot, size_t slotIndex, PipelineRequest &req)
+{
+    struct io_uring_sqe *sqe = ring.getSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    int iovcnt = 0;
+    if (slot.sent < sizeof(slot.header)) {
+        slot.iov[iovcnt].iov_base = slot.header + slot.sent;
+        slot.iov[iovcnt].iov_len = sizeof(slot.header) - slot.sent;
+        ++iovcnt;
+        slot.iov[iovcnt].iov_base = const_cast<char *>(req.payload.data());
+        slot.iov[iovcnt].iov_len = req.payload.size();
+        ++iovcnt;
+    }
+    else {
+        size_t offset = slot.sent - sizeof(slot.header);
+        slot.iov[iovcnt].iov_base = const_cast<char *>(req.payload.data()) + offset;
+        slot.iov[iovcnt].iov_len = req.payload.size() - offset;
+        ++iovcnt;
+    }
+    memset(&slot.msg, 0, sizeof(slot.msg));
+    slot.msg.msg_iov = slot.iov;
+    slot.msg.msg_iovlen = iovcnt;
+
+    // 用sendmsg而不是WRITE_FIXED，因为后者无法指定MSG_NOSIGNAL
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_user_data(slotIndex, eUringOp_Send);
+    ++slot.outstanding;
+    return true;
+}
+
+static bool queue_uring_read(IoUring &ring, UringSlot &slot, size_t slotIndex)
+{
+    struct io_uring_sqe *sqe = ring.getSqe();
+    if (!sqe) {
+        return false;
+    }
+
+    sqe->opcode = ring.buffersRegistered() ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = slot.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(slot.buf);
+    sqe->len = URING_SLOT_BUF_SIZE;
+    sqe->off = 0;// socket不支持偏移
+    sqe->buf_index = static_cast<uint16_t>(slotIndex);
+    sqe->user_data = uring_user_data(slotIndex, eUringOp_Read);
+    ++slot.outstanding;
+    return true;
+}
+
+static void cancel_uring_slot(IoUring &ring, UringSlot &slot, size_t slotIndex)
+{
+    slot.canceled = true;
+    shutdown(slot.fd, SHUT_RDWR);
+
+    const UringOp ops[] = {eUringOp_Connect, eUringOp_Send, eUringOp_Read};
+    for (UringOp op : ops) {
+        struct io_uring_sqe *sqe = ring.getSqe();
+        if (!sqe) {
+            break;
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = uring_user_data(slotIndex, op);
+        sqe->user_data = uring_user_data(slotIndex, eUringOp_Cancel);
+    }
+}
+
+// 连接和发送作为链接的两个操作一次提交; 返回 1:已提交 -1:失败
+static int start_uring_request(IoUring &ring, UringSlot &slot, size_t slotIndex, PipelineRequest &req)
+{
+    if (!make_socket_addr(req.socketPath, slot.addr, slot.addrLen)) {
+        req.err = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        req.err = errno;
+        return -1;
+    }
+
+    struct io_uring_sqe *sqe = ring.getSqe();
+    if (!sqe) {
+        close(fd);
+        req.err = EBUSY;
+        return -1;
+    }
+    KMRE_PROBE_CONNECT_START(req.index, req.link);
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.addr);
+    sqe->off = slot.addrLen;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = uring_user_data(slotIndex, eUringOp_Connect);
+
+    slot.fd = fd;
+    slot.busy = true;
+    slot.outstanding = 1;
+    slot.err = 0;
+    slot.retry = false;
+    slot.canceled = false;
+    slot.done = false;
+    slot.sent = 0;
+    encode_cmd_header(req.index, slot.header);
+
+    // 链接中的sqe必须紧跟在connect之后，getSqe失败时connect已无法撤回，
+    // 只能让它单独完成后按失败处理
+    if (!queue_uring_send(ring, slot, slotIndex, req)) {
+        slot.err = EBUSY;
+    }
+    return 1;
+}
+
+static void handle_uring_completion(IoUring &ring, UringSlot &slot, size_t slotIndex, UringOp op, int res,
+                                    PipelineRequest &req)
+{
+    --slot.outstanding;
+    bool failed = (slot.err != 0 || slot.retry || slot.canceled);
+
+    switch (op) {
+    case eUringOp_Connect:
+        if (res == -EAGAIN) {
+            slot.retry = true;
+        }
+        else if (res < 0 && slot.err == 0) {
+            slot.err = -res;
+        }
+        else if (res >= 0) {
+            KMRE_PROBE_CONNECT_DONE(req.index, req.link, slot.fd);
+        }
+        break;
+    case eUringOp_Send:
+        if (failed) {
+            break;// connect失败时send以ECANCELED结束
+        }
+        if (res == -EINTR || res == -EAGAIN) {
+            res = 0;
+        }
+        if (res < 0) {
+            slot.err = -res;
+            break;
+        }
+        slot.sent += res;
+        if (slot.sent < sizeof(slot.header) + req.payload.size()) {
+            if (!queue_uring_send(ring, slot, slotIndex, req)) {
+                slot.err = EBUSY;
+            }
+            break;
+        }
+        req.sent = true;
+        slot.ticket.reset();
+        KMRE_PROBE_SEND(req.index, req.link, slot.sent);
+        if (!req.expectReply) {
+            slot.done = true;
+        }
+        else if (!queue_uring_read(ring, slot, slotIndex)) {
+            slot.err = EBUSY;
+        }
+        break;
+    case eUringOp_Read:
+        if (failed) {
+            break;
+        }
+        if (res > 0) {
+            req.reply.append(slot.buf, res);
+        }
+        else if (res == 0) {
+            slot.done = true;
+            break;
+        }
+        else if (res != -EINTR && res != -EAGAIN) {
+            slot.err = -res;
+            break;
+        }
+        if (!queue_uring_read(ring, slot, slotIndex)) {
+            slot.err = EBUSY;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+// 与epoll版本语义相同，但连接、发送、接收都通过io_uring批量提交，每轮循环只需一次系统调用;
+// 初始化失败时返回-1且不改动任何请求，由调用方回退到epoll
+static int run_pipeline_uring(std::vector<PipelineRequest> &requests, int maxInflight, int timeoutMs,
+                              const PipelineCallback &onComplete)
+{
+    IoUring ring;
+    // 每个请求最多同时占用connect+send或read加三个取消操作
+    if (!ring.init(static_cast<unsigned>(maxInflight) * 5)) {
+        return -1;
+    }
+
+    const size_t bufSize = static_cast<size_t>(maxInflight) * URING_SLOT_BUF_SIZE;
+    void *bufs = mmap(nullptr, bufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED) {
+        KMRE_LOG(LOG_ERR, "[%s] Map buffers failed: %s", __func__, strerror(errno));
+        return -1;
+    }
+
+    std::vector<UringSlot> slots(maxInflight);
+    std::vector<struct iovec> iovs(maxInflight);
+    for (int s = 0; s < maxInflight; s++) {
+        slots[s].buf = static_cast<char *>(bufs) + static_cast<size_t>(s) * URING_SLOT_BUF_SIZE;
+        iovs[s].iov_base = slots[s].buf;
+        iovs[s].iov_len = URING_SLOT_BUF_SIZE;
+    }
+    ring.registerBuffers(iovs.data(), static_cast<unsigned>(iovs.size()));// 失败时使用普通read
+
+    std::vector<int64_t> startTime(requests.size(), 0);
+    std::deque<size_t> pending;
+    std::deque<PipelineRetry> retries;
+    int active = 0;
+    int succeeded = 0;
+    int64_t gatedSince = 0;
+
+    for (size_t i = 0; i < requests.size(); i++) {
+        pending.push_back(i);
+    }
+
+    auto finish = [&](UringSlot &slot, bool ok, int err) {
+        close(slot.fd);
+        slot.fd = -1;
+        slot.busy = false;
+        slot.ticket.reset();
+        --active;
+        if (ok) {
+            ++succeeded;
+        }
+        complete_request(slot.req, requests[slot.req], ok, err, onComplete);
+    };
+
+    while (!pending.empty() || !retries.empty() || active > 0) {
+        int64_t now = now_ms();
+
+        while (!retries.empty() && retries.front().notBefore <= now) {
+            pending.push_front(retries.front().req);
+            retries.pop_front();
+        }
+
+        // 没有在途请求时在acquireFor中排队等待，否则只在可以放行时发起新连接
+        bool bulkTurn = bulk_turn(!pending.empty(), now, gatedSince);
+        for (size_t s = 0; s < slots.size() && !pending.empty() && (bulkTurn || active == 0); s++) {
+            if (slots[s].busy) {
+                continue;
+            }
+
+            size_t index = pending.front();
+            pending.pop_front();
+            PipelineRequest &req = requests[index];
+            if (startTime[index] == 0) {
+                startTime[index] = now;
+            }
+            if (now - startTime[index] > timeoutMs) {
+                req.err = ETIMEDOUT;
+                if (onComplete) {
+                    onComplete(index, req);
+                }
+                continue;
+            }
+
+            AdmitResult admit = slots[s].ticket.acquireFor(ePriority_Bulk, bulkTurn ? 0 : PIPELINE_GATE_WAIT_MS);
+            if (admit == eAdmit_QueueFull) {
+                // 排队已满，由调用方决定稍后重试(如媒体监听放回待发送表并退避)
+                complete_request(index, req, false, EBUSY, onComplete);
+                continue;
+            }
+            if (admit != eAdmit_Ok) {
+                pending.push_front(index);// 名额被其他调用者占用，稍后再试
+                bulkTurn = false;
+                break;
+            }
+
+            slots[s].req = index;
+            if (start_uring_request(ring, slots[s], s, req) > 0) {
+                slots[s].deadline = startTime[index] + timeoutMs;
+                ++active;
+            }
+            else {
+                slots[s].ticket.reset();
+                KMRE_LOG(LOG_ERR, "[%s] Connect '%s' failed: %s",
+                    __func__, req.socketPath.c_str(), strerror(req.err));
+                if (onComplete) {
+                    onComplete(index, req);
+                }
+            }
+        }
+
+        if (active == 0) {
+            if (!bulkTurn) {
+                continue;// 已在acquireFor中等待过
+            }
+            if (retries.empty()) {
+                continue;
+            }
+            int64_t wait = retries.front().notBefore - now_ms();
+            if (wait > 0) {
+                struct timespec ts = {static_cast<time_t>(wait / 1000), static_cast<long>((wait % 1000) * 1000000)};
+                nanosleep(&ts, nullptr);
+            }
+            continue;
+        }
+
+        int64_t wait = timeoutMs;
+        for (const auto &slot : slots) {
+            if (slot.busy && !slot.canceled && slot.deadline - now < wait) {
+                wait = slot.deadline - now;
+            }
+        }
+        if (!retries.empty() && retries.front().notBefore - now < wait) {
+            wait = retries.front().notBefore - now;
+        }
+        if (!bulkTurn && wait > PIPELINE_GATE_POLL_MS) {
+            wait = PIPELINE_GATE_POLL_MS;
+        }
+        if (wait < 0) {
+            wait = 0;
+        }
+
+        if (ring.submitAndWait(wait) < 0) {
+            KMRE_LOG(LOG_ERR, "[%s] io_uring_enter failed: %s", __func__, strerror(errno));
+            break;
+        }
+
+        ring.forEachCqe([&](uint64_t userData, int res) {
+            UringOp op = static_cast<UringOp>(userData & 3);
+            if (op == eUringOp_Cancel) {
+                return;
+            }
+            UringSlot &slot = slots[userData >> 2];
+            handle_uring_completion(ring, slot, userData >> 2, op, res, requests[slot.req]);
+            if (slot.outstanding > 0) {
+                return;
+            }
+
+            if (slot.canceled) {
+                finish(slot, false, ETIMEDOUT);
+            }
+            else if (slot.retry) {
+                close(slot.fd);
+                slot.fd = -1;
+                slot.busy = false;
+                slot.ticket.reset();
+                --active;
+                requests[slot.req].sent = false;
+                retries.push_back({slot.req, now_ms() + PIPELINE_RETRY_DELAY_MS});
+            }
+            else if (slot.err != 0) {
+                finish(slot, false, slot.err);
+            }
+            else {
+                finish(slot, slot.done, slot.done ? 0 : EIO);
+            }
+        });
+
+        now = now_ms();
+        for (size_t s = 0; s < slots.size(); s++) {
+            if (slots[s].busy && !slots[s].canceled && now >= slots[s].deadline) {
+                cancel_uring_slot(ring, slots[s], s);
+            }
+        }
+    }
+
+    // 只有io_uring_enter出错时才会走到这里，关闭socket后由内核取消剩余操作
+    for (auto &slot : slots) {
+        if (slot.busy) {
+            shutdown(slot.fd, SHUT_RDWR);
+            finish(slot, false, EIO);
+        }
+    }
+    for (const auto &retry : retries) {
+        pending.push_back(retry.req);
+    }
+    for (size_t index : pending) {
+        requests[index].err = EIO;
+        if (onComplete) {
+            onComplete(index, requests[index]);
+        }
+    }
+    munmap(bufs, bufSize);
+
+    return succeeded;
+}
+
+int run_pipeline(std::vector<PipelineRequest> &requests, int maxInflight, int timeoutMs,
+                 const PipelineCallback &onComplete)
+{
+    if (requests.empty()) {
+        return 0;
+    }
+    if (maxInflight <= 0) {
+        maxInflight = 1;
+    }
+    if (static_cast<size_t>(maxInflight) > requests.size()) {
+        maxInflight = static_cast<int>(requests.size());
+    }
+
+    // 与ConnectSocket相同，发往launcher的请求结束前不使用控制通道
+    std::list<ControlRingFence> ringFences;
+    std::set<std::string> fencedPaths;
+    for (auto &req : requests) {
+        req.sent = false;
+        req.ok = false;
+        req.err = 0;
+        req.reply.clear();
+        if (ControlRingManager::getInstance().enabled() && req.link == eLink_Launcher &&
+            fencedPaths.insert(req.socketPath).second) {
+            ringFences.emplace_back();
+            ringFences.back().enter(req.socketPath);
+        }
+    }
+
+    if (get_io_backend() == eIoBackend_Uring && uring_available()) {
+        int ret = run_pipeline_uring(requests, maxInflight, timeoutMs, onComplete);
+        if (ret >= 0) {
+            return ret;
+        }
+    }
+    return run_pipeline_epoll(requests, maxInflight, timeoutMs, onComplete);
+}
+
+}
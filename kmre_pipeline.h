@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_PIPELINE_H__
+#define __KMRE_PIPELINE_H__
+
+#include <string>
+#include <functional>
+#include <vector>
+
+#include "kmre_socket.h"
+#include "kmre_command.h"
+
+namespace KmreSocket {
+
+// 服务端每个连接只处理一条命令，并在回复后关闭连接，
+// 因此批量请求通过多个非阻塞连接并发发送，而不是在同一连接上串行等待
+struct PipelineRequest {
+    std::string socketPath;
+    int index = 0;              // 命令头编号
+    SocketLink link = eLink_Launcher;// 命令所走的连接，探针参数直接取用，不在热路径上查表
+    std::string payload;        // 已序列化的消息体
+    bool expectReply = false;   // 是否读取回复(读到服务端关闭连接为止)
+
+    bool sent = false;          // 请求已完整发出
+    bool ok = false;
+    int err = 0;
+    std::string reply;
+};
+
+// 命令编号及是否读取回复由 CommandTraits<T> 确定
+template <typename T>
+void make_pipeline_request(PipelineRequest &req, const std::string &socketPath, const T &data)
+{
+    req.socketPath = socketPath;
+    req.index = CommandTraits<T>::kIndex;
+    req.link = CommandTraits<T>::kLink;
+    req.expectReply = CommandTraits<T>::kHasReply;
+    req.sent = false;
+    req.ok = false;
+    req.err = 0;
+    req.reply.clear();
+    data.SerializeToString(&req.payload);
+}
+
+// 单个请求结束(成功或失败)时调用，参数为请求在数组中的下标
+typedef std::function<void(size_t index, PipelineRequest &req)> PipelineCallback;
+
+// 并发执行一批请求，同时在途的连接数不超过maxInflight，
+// 每个请求从建立连接开始计时，超过timeoutMs视为失败; 返回成功的请求数
+int run_pipeline(std::vector<PipelineRequest> &requests, int maxInflight, int timeoutMs,
+                 const PipelineCallback &onComplete = nullptr);
+
+}
+
+#endif // __KMRE_PIPELINE_H__
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_PROBE_H__
+#define __KMRE_PROBE_H__
+
+// 请求路径上的USDT静态探针，provider为kmre，未挂载时每个探针只是一条nop，不读取任何状态:
+//   connect__start(cmd, link)
+//   connect__done(cmd, link, fd)
+//   send(cmd, link, bytes)               命令头和消息体已写出
+//   reply(cmd, link, bytes)              回复读取完毕(流式读取时为整个回复)
+//   parse__done(cmd, link, bytes)
+//   error(cmd, link, stage, errno)       stage为kmre_trace.h中的SpanKind，不是系统调用失败时errno为0
+// 流水线请求(批量安装/卸载、媒体文件等)不在库内解析回复，没有parse__done，error的stage为eSpan_Command。
+// cmd为命令编号(head)，link为SocketLink。例如:
+//   bpftrace -e 'usdt:/usr/lib/libkmre.so:kmre:reply { @bytes[arg0] = hist(arg2); }'
+// 编译时没有<sys/sdt.h>(systemtap-sdt-dev)或定义了KMRE_NO_SDT时探针为空
+
+#if !defined(KMRE_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define KMRE_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef KMRE_HAVE_SDT
+#define KMRE_PROBE_CONNECT_START(cmd, link) \
+    STAP_PROBE2(kmre, connect__start, (int)(cmd), (int)(link))
+#define KMRE_PROBE_CONNECT_DONE(cmd, link, fd) \
+    STAP_PROBE3(kmre, connect__done, (int)(cmd), (int)(link), (int)(fd))
+#define KMRE_PROBE_SEND(cmd, link, bytes) \
+    STAP_PROBE3(kmre, send, (int)(cmd), (int)(link), (long long)(bytes))
+#define KMRE_PROBE_REPLY(cmd, link, bytes) \
+    STAP_PROBE3(kmre, reply, (int)(cmd), (int)(link), (long long)(bytes))
+#define KMRE_PROBE_PARSE_DONE(cmd, link, bytes) \
+    STAP_PROBE3(kmre, parse__done, (int)(cmd), (int)(link), (long long)(bytes))
+#define KMRE_PROBE_ERROR(cmd, link, stage, err) \
+    STAP_PROBE4(kmre, error, (int)(cmd), (int)(link), (int)(stage), (int)(err))
+#else
+#define KMRE_PROBE_CONNECT_START(cmd, link) do {} while (0)
+#define KMRE_PROBE_CONNECT_DONE(cmd, link, fd) do {} while (0)
+#define KMRE_PROBE_SEND(cmd, link, bytes) do {} while (0)
+#define KMRE_PROBE_REPLY(cmd, link, bytes) do {} while (0)
+#define KMRE_PROBE_PARSE_DONE(cmd, link, bytes) do {} while (0)
+#define KMRE_PROBE_ERROR(cmd, link, stage, err) do {} while (0)
+#endif
+
+#endif // __KMRE_PROBE_H__
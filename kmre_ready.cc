@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_ready.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/syslog.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <system_error>
+#include <thread>
+
+#include "KmreCore.pb.h"
+#include "kmre_command.h"
+#include "kmre_log.h"
+
+namespace KmreSocket {
+
+#define READY_PROBE_TIMEOUT_MS 1000
+// socket文件在bind时创建，listen稍晚，这段时间没有inotify事件，只能短暂重试
+#define READY_RETRY_MIN_MS 10
+#define READY_RETRY_MAX_MS 200
+#define READY_WATCH_EVENTS (IN_CREATE | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+static int quiet_connect(const std::string &socketPath, int timeoutMs)
+{
+    struct sockaddr_un un;
+    if (socketPath.size() >= sizeof(un.sun_path)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct timeval tv;
+    tv.tv_sec = timeoutMs / 1000;
+    tv.tv_usec = (timeoutMs % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    memcpy(un.sun_path, socketPath.c_str(), socketPath.size());
+    socklen_t len = offsetof(struct sockaddr_un, sun_path) + socketPath.size();
+    if (connect(fd, (struct sockaddr *)&un, len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool probe_container_link(SocketLink link, const std::string &socketPath, int timeoutMs)
+{
+    int fd = quiet_connect(socketPath, timeoutMs);
+    if (fd < 0) {
+        return false;
+    }
+    if (link != eLink_Launcher) {
+        close(fd);
+        return true;
+    }
+
+    // 发送合法的GetRunningAppList(with_thumbnail为必填字段)，能解析出回复才算就绪
+    cn::kylinos::kmre::kmrecore::GetRunningAppList request;
+    request.set_with_thumbnail(false);
+    std::string body;
+    request.SerializeToString(&body);
+    unsigned char header[4];
+    encode_cmd_header(CommandTraits<cn::kylinos::kmre::kmrecore::GetRunningAppList>::kIndex, header);
+    bool ok = false;
+    if (write_fully_vectored(fd, header, sizeof(header), body.data(), body.size()) == 0) {
+        std::string buf;
+        ssize_t size = read_until_eof(fd, buf);
+        cn::kylinos::kmre::kmrecore::RunningAppList reply;
+        ok = size >= 0 && reply.ParseFromArray(buf.data(), static_cast<int>(size));
+    }
+    close(fd);
+    return ok;
+}
+
+// 监视sockets目录; 目录还不存在时监视最近的已存在的上级目录，目录出现后再移到下一级
+class ReadyWatch
+{
+public:
+    explicit ReadyWatch(const std::string &dir)
+        : mDir(dir) {
+        mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (mFd < 0) {
+            KMRE_LOG(LOG_WARNING, "[%s] inotify_init1 failed: %s, fall back to polling", __func__, strerror(errno));
+        }
+    }
+
+    ~ReadyWatch() {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+
+    // 每次检查socket文件前调用，保证检查之后的变化都会产生事件
+    void arm() {
+        if (mFd < 0) {
+            return;
+        }
+
+        std::string target = mDir;
+        while (target.size() > 1 && !file_is_exists(target.c_str())) {
+            std::string::size_type pos = target.find_last_of('/', target.size() - 2);
+            target = (pos == std::string::npos || pos == 0) ? "/" : target.substr(0, pos);
+        }
+        if (mWd >= 0 && target == mWatched) {
+            return;
+        }
+
+        if (mWd >= 0) {
+            inotify_rm_watch(mFd, mWd);
+        }
+        mWd = inotify_add_watch(mFd, target.c_str(), READY_WATCH_EVENTS);
+        mWatched = mWd >= 0 ? target : "";
+    }
+
+    // 有事件或超时后返回; 无法监视时相当于sleep，由调用方控制间隔
+    void wait(int timeoutMs) {
+        if (mFd < 0 || mWd < 0) {
+            if (timeoutMs > READY_RETRY_MAX_MS || timeoutMs < 0) {
+                timeoutMs = READY_RETRY_MAX_MS;
+            }
+            poll(nullptr, 0, timeoutMs);
+            return;
+        }
+
+        struct pollfd pfd = {mFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) > 0) {
+            alignas(struct inotify_event) char buf[4096];
+            while (read(mFd, buf, sizeof(buf)) > 0) {
+                // 只用来唤醒，事件内容由调用方重新检查
+            }
+            // 被删除或移走的目录会自动移除监视
+            if (mWatched != "/" && !file_is_exists(mWatched.c_str())) {
+                mWd = -1;
+            }
+        }
+    }
+
+private:
+    std::string mDir;
+    std::string mWatched;
+    int mFd = -1;
+    int mWd = -1;
+};
+
+static std::string dir_of(const std::string &path)
+{
+    std::string::size_type pos = path.find_last_of('/');
+    return pos == std::string::npos ? "." : path.substr(0, pos);
+}
+
+bool wait_container_ready(const std::string &launcherPath, const std::string &managerPath, int timeoutMs)
+{
+    const int64_t start = monotonic_us();
+    const int64_t deadline = timeoutMs < 0 ? -1 : start + static_cast<int64_t>(timeoutMs) * 1000;
+    ReadyWatch watch(dir_of(launcherPath));
+    bool launcherReady = false;
+    bool managerReady = false;
+    int retryMs = READY_RETRY_MIN_MS;
+
+    for (;;) {
+        watch.arm();
+
+        int remainingMs = -1;
+        if (deadline >= 0) {
+            remainingMs = static_cast<int>(std::max<int64_t>(0, (deadline - monotonic_us()) / 1000));
+        }
+        const int probeMs = (remainingMs < 0 || remainingMs > READY_PROBE_TIMEOUT_MS) ? READY_PROBE_TIMEOUT_MS :
+                            std::max(remainingMs, 1);
+
+        int waitMs = remainingMs;
+        if (file_is_exists(launcherPath.c_str()) && file_is_exists(managerPath.c_str())) {
+            launcherReady = launcherReady || probe_container_link(eLink_Launcher, launcherPath, probeMs);
+            managerReady = managerReady || probe_container_link(eLink_Manager, managerPath, probeMs);
+            if (launcherReady && managerReady) {
+                KMRE_LOG(LOG_INFO, "[%s] Container ready after %lld ms", __func__,
+                         static_cast<long long>((monotonic_us() - start) / 1000));
+                return true;
+            }
+            waitMs = (remainingMs < 0 || remainingMs > retryMs) ? retryMs : remainingMs;
+            retryMs = std::min(retryMs * 2, READY_RETRY_MAX_MS);
+        }
+        else {
+            // 文件被删除(容器重启)后已探测成功的连接不再可信
+            launcherReady = managerReady = false;
+            retryMs = READY_RETRY_MIN_MS;
+        }
+
+        if (remainingMs == 0) {
+            KMRE_LOG(LOG_WARNING, "[%s] Container not ready in %d ms (launcher:%d manager:%d)", __func__,
+                     timeoutMs, launcherReady, managerReady);
+            return false;
+        }
+        watch.wait(waitMs);
+    }
+}
+
+bool wait_container_ready_async(const std::string &launcherPath, const std::string &managerPath, int timeoutMs,
+                                ReadyCallback callback, void *userData)
+{
+    try {
+        std::thread([launcherPath, managerPath, timeoutMs, callback, userData]() {
+            const int64_t start = monotonic_us();
+            bool ready = wait_container_ready(launcherPath, managerPath, timeoutMs);
+            if (callback) {
+                callback(ready, static_cast<int>((monotonic_us() - start) / 1000), userData);
+            }
+        }).detach();
+    }
+    catch (const std::system_error &e) {
+        KMRE_LOG(LOG_ERR, "[%s] Create thread failed: %s", __func__, e.what());
+        return false;
+    }
+    return true;
+}
+
+}
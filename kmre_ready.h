@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_READY_H__
+#define __KMRE_READY_H__
+
+#include <string>
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+// ready为true时两个连接均已可用，elapsed_ms为等待耗时; 回调在单独的线程中执行
+typedef void (*ReadyCallback)(bool ready, int elapsed_ms, void *user_data);
+
+// 连接link并做一次握手(launcher发GetRunningAppList并解析回复，manager没有无副作用的
+// 查询命令，只确认已在监听)，失败时不打印日志，供等待时反复调用
+bool probe_container_link(SocketLink link, const std::string &socketPath, int timeoutMs);
+
+// 等待launcher和manager都能正常服务: sockets目录无变化时阻塞在inotify上，
+// socket文件出现后才连接探测。timeoutMs<0时一直等待，0时只探测一次
+bool wait_container_ready(const std::string &launcherPath, const std::string &managerPath, int timeoutMs);
+
+// 在新线程中等待，返回线程是否启动成功
+bool wait_container_ready_async(const std::string &launcherPath, const std::string &managerPath, int timeoutMs,
+                                ReadyCallback callback, void *userData);
+
+}
+
+#endif // __KMRE_READY_H__
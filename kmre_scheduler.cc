@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_scheduler.h"
+
+#include <chrono>
+#include <sys/syslog.h>
+
+#include "kmre_socket.h"
+#include "kmre_log.h"
+
+namespace KmreSocket {
+
+RequestScheduler& RequestScheduler::getInstance()
+{
+    static RequestScheduler instance;
+    return instance;
+}
+
+void RequestScheduler::setLimits(int maxBulkInflight, int maxBulkQueue)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (maxBulkInflight > 0) {
+        mMaxBulkInflight = maxBulkInflight;
+    }
+    if (maxBulkQueue >= 0) {
+        mMaxBulkQueue = maxBulkQueue;
+    }
+    mCond.notify_all();
+}
+
+void RequestScheduler::acquire(RequestPriority priority)
+{
+    const int64_t start = monotonic_us();
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (priority == ePriority_Interactive) {
+        ++mActive[ePriority_Interactive];
+        mWait[ePriority_Interactive].add(0);
+        return;
+    }
+
+    if (mBulkQueued == mMaxBulkQueue) {// 只在越过上限时告警一次
+        KMRE_LOG(LOG_WARNING, "[%s] %d bulk requests are waiting.", __func__, mBulkQueued);
+    }
+    if (mBulkQueued >= mMaxBulkQueue) {
+        ++mBulkOverQueue;
+    }
+
+    ++mBulkQueued;
+    mCond.wait(lock, [this]() { return bulkAdmissibleLocked(); });
+    --mBulkQueued;
+
+    ++mActive[ePriority_Bulk];
+    mWait[ePriority_Bulk].add(monotonic_us() - start);
+}
+
+bool RequestScheduler::tryAcquire(RequestPriority priority)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (priority == ePriority_Bulk && !bulkAdmissibleLocked()) {
+        return false;
+    }
+    ++mActive[priority];
+    return true;
+}
+
+AdmitResult RequestScheduler::acquireFor(RequestPriority priority, int waitMs)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (priority == ePriority_Interactive || bulkAdmissibleLocked()) {
+        ++mActive[priority];
+        return eAdmit_Ok;
+    }
+    if (mBulkQueued >= mMaxBulkQueue) {
+        ++mBulkRejected;
+        return eAdmit_QueueFull;
+    }
+    if (waitMs <= 0) {
+        return eAdmit_Timeout;
+    }
+
+    ++mBulkQueued;
+    bool admitted = mCond.wait_for(lock, std::chrono::milliseconds(waitMs),
+                                   [this]() { return bulkAdmissibleLocked(); });
+    --mBulkQueued;
+    if (!admitted) {
+        return eAdmit_Timeout;
+    }
+    ++mActive[ePriority_Bulk];
+    return eAdmit_Ok;
+}
+
+void RequestScheduler::release(RequestPriority priority)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (mActive[priority] > 0) {
+        --mActive[priority];
+    }
+    mCond.notify_all();
+}
+
+bool RequestScheduler::waitBulkTurn(int waitMs)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    return mCond.wait_for(lock, std::chrono::milliseconds(waitMs), [this]() { return bulkAdmissibleLocked(); });
+}
+
+void RequestScheduler::recordBulkWait(int64_t us)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mWait[ePriority_Bulk].add(us);
+}
+
+std::string RequestScheduler::statsJson()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    std::string json = "{\"interactive\":{\"active\":" + std::to_string(mActive[ePriority_Interactive]);
+    json += ",\"wait\":" + mWait[ePriority_Interactive].toJson();
+    json += "},\"bulk\":{\"active\":" + std::to_string(mActive[ePriority_Bulk]);
+    json += ",\"queued\":" + std::to_string(mBulkQueued);
+    json += ",\"over_queue\":" + std::to_string(mBulkOverQueue);
+    json += ",\"rejected\":" + std::to_string(mBulkRejected);
+    json += ",\"max_inflight\":" + std::to_string(mMaxBulkInflight);
+    json += ",\"max_queue\":" + std::to_string(mMaxBulkQueue);
+    json += ",\"wait\":" + mWait[ePriority_Bulk].toJson();
+    json += "}}";
+    return json;
+}
+
+void ScheduleTicket::acquire(RequestPriority priority)
+{
+    reset();
+    RequestScheduler::getInstance().acquire(priority);
+    mHeld = true;
+    mPriority = priority;
+}
+
+bool ScheduleTicket::tryAcquire(RequestPriority priority)
+{
+    reset();
+    mHeld = RequestScheduler::getInstance().tryAcquire(priority);
+    mPriority = priority;
+    return mHeld;
+}
+
+AdmitResult ScheduleTicket::acquireFor(RequestPriority priority, int waitMs)
+{
+    reset();
+    AdmitResult result = RequestScheduler::getInstance().acquireFor(priority, waitMs);
+    mHeld = (result == eAdmit_Ok);
+    mPriority = priority;
+    return result;
+}
+
+void ScheduleTicket::reset()
+{
+    if (mHeld) {
+        RequestScheduler::getInstance().release(mPriority);
+        mHeld = false;
+    }
+}
+
+}
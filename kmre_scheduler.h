@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_SCHEDULER_H__
+#define __KMRE_SCHEDULER_H__
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "kmre_histogram.h"
+
+namespace KmreSocket {
+
+typedef enum {
+    ePriority_Interactive = 0,  // 窗口焦点、启动、控制等用户可感知的命令
+    ePriority_Bulk,             // 媒体同步、批量安装卸载等可以延后的命令
+    ePriority_Count,
+}RequestPriority;
+
+typedef enum {
+    eAdmit_Ok = 0,
+    eAdmit_QueueFull,           // 排队的批量命令已达上限，没有排队
+    eAdmit_Timeout,             // 排队等待超时，没有取得名额
+}AdmitResult;
+
+// 交互命令从不等待; 有交互命令在途时不放行新的批量命令(严格优先)，同时在途的批量命令数有上限。
+// 名额只覆盖连接和发送，请求发出后即释放，等待回复不占名额; 同步接口(acquire)排队时一直等待，
+// 排队数超过上限时只记录告警; 批量生产者(流水线、媒体监听)使用acquireFor，排队已满时立即得到eAdmit_QueueFull
+class RequestScheduler
+{
+public:
+    static RequestScheduler& getInstance();
+
+    void setLimits(int maxBulkInflight, int maxBulkQueue);
+
+    void acquire(RequestPriority priority);
+    // 不等待，批量命令暂时不能放行时返回false
+    bool tryAcquire(RequestPriority priority);
+    // 批量命令不能立即放行时: 排队数已达上限返回eAdmit_QueueFull，否则排队最多等待waitMs
+    AdmitResult acquireFor(RequestPriority priority, int waitMs);
+    void release(RequestPriority priority);
+
+    // 供批量流水线使用: 可以放行批量命令时返回true，否则最多等待waitMs
+    bool waitBulkTurn(int waitMs);
+    void recordBulkWait(int64_t us);
+
+    std::string statsJson();
+
+private:
+    RequestScheduler() = default;
+    RequestScheduler(const RequestScheduler&) = delete;
+    RequestScheduler& operator=(const RequestScheduler&) = delete;
+
+    bool bulkAdmissibleLocked() const {
+        return mActive[ePriority_Interactive] == 0 && mActive[ePriority_Bulk] < mMaxBulkInflight;
+    }
+
+    std::mutex mMutex;
+    std::condition_variable mCond;
+    int mActive[ePriority_Count] = {0};
+    int mBulkQueued = 0;
+    int mMaxBulkInflight = 4;
+    int mMaxBulkQueue = 64;
+    uint64_t mBulkOverQueue = 0;     // 同步接口排队时已超过上限的次数
+    uint64_t mBulkRejected = 0;      // acquireFor因排队已满返回的次数
+    LatencyHistogram mWait[ePriority_Count];
+};
+
+// 在作用域内占用一个调度名额
+class ScheduleTicket
+{
+public:
+    ScheduleTicket() = default;
+    ~ScheduleTicket() { reset(); }
+
+    void acquire(RequestPriority priority);
+    bool tryAcquire(RequestPriority priority);
+    AdmitResult acquireFor(RequestPriority priority, int waitMs);
+    void reset();
+    bool held() const { return mHeld; }
+
+private:
+    ScheduleTicket(const ScheduleTicket&) = delete;
+    ScheduleTicket& operator=(const ScheduleTicket&) = delete;
+
+    bool mHeld = false;
+    RequestPriority mPriority = ePriority_Interactive;
+};
+
+}
+
+#endif // __KMRE_SCHEDULER_H__
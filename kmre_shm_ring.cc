@@ -0,0 +1,465 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_shm_ring.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syslog.h>
+#include <unistd.h>
+#include <system_error>
+#include <thread>
+
+#include "KmreCore.pb.h"
+#include "kmre_socket.h"
+#include "kmre_log.h"
+#include "kmre_command.h"
+
+namespace KmreSocket {
+
+#define SHM_RING_PAD_RECORD 0xffffffffu
+#define SHM_RING_DATA_OFFSET ((sizeof(ShmRingHeader) + 63) & ~static_cast<size_t>(63))
+#define CONTROL_RING_STALL_MS 2000      // 消费者超过该时间没有心跳，视为对端已不在
+#define CONTROL_RING_RETRY_MS 5000
+#define CONTROL_RING_DRAIN_MS 100       // socket命令前等待控制通道取空的最长时间
+#define CONTROL_RING_DRAIN_POLL_US 200
+
+static size_t record_size(size_t bodySize)
+{
+    return (4 + 4 + bodySize + 7) & ~static_cast<size_t>(7);
+}
+
+ShmRing::~ShmRing()
+{
+    if (mHeader) {
+        munmap(mHeader, mMapLength);
+    }
+    if (mMemFd >= 0) {
+        close(mMemFd);
+    }
+    if (mEventFd >= 0) {
+        close(mEventFd);
+    }
+}
+
+bool ShmRing::map(size_t length)
+{
+    void *addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, mMemFd, 0);
+    if (addr == MAP_FAILED) {
+        KMRE_LOG(LOG_ERR, "[%s] Map ring failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    mHeader = static_cast<ShmRingHeader *>(addr);
+    mData = static_cast<char *>(addr) + SHM_RING_DATA_OFFSET;
+    mMapLength = length;
+    return true;
+}
+
+bool ShmRing::create(uint32_t size)
+{
+    if (size == 0 || (size & (size - 1)) != 0) {
+        return false;
+    }
+
+    mMemFd = memfd_create("kmre-control-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    mEventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mMemFd < 0 || mEventFd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Create memfd/eventfd failed: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    const size_t length = SHM_RING_DATA_OFFSET + size;
+    if (ftruncate(mMemFd, length) != 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Resize memfd failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    // 固定大小，防止对端缩小文件导致本端访问越界
+    fcntl(mMemFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL);
+
+    if (!map(length)) {
+        return false;
+    }
+    mHeader->magic = SHM_RING_MAGIC;
+    mHeader->version = SHM_RING_VERSION;
+    mHeader->size = size;
+    mHeader->head.store(0, std::memory_order_relaxed);
+    mHeader->tail.store(0, std::memory_order_relaxed);
+    mHeader->waiting.store(0, std::memory_order_relaxed);
+    beat();// 协商期间对端还没有开始取数据
+    return true;
+}
+
+bool ShmRing::attach(int memFd, int eventFd)
+{
+    mMemFd = memFd;
+    mEventFd = eventFd;
+
+    struct stat st;
+    if (fstat(mMemFd, &st) != 0 || static_cast<size_t>(st.st_size) <= SHM_RING_DATA_OFFSET) {
+        return false;
+    }
+    if (!map(st.st_size)) {
+        return false;
+    }
+
+    const uint32_t size = mHeader->size;
+    if (mHeader->magic != SHM_RING_MAGIC || mHeader->version != SHM_RING_VERSION ||
+        size == 0 || (size & (size - 1)) != 0 || SHM_RING_DATA_OFFSET + size > mMapLength) {
+        KMRE_LOG(LOG_ERR, "[%s] Invalid ring header!", __func__);
+        return false;
+    }
+    beat();
+    return true;
+}
+
+void ShmRing::beat()
+{
+    mHeader->heartbeat.store(static_cast<uint64_t>(monotonic_us() / 1000), std::memory_order_relaxed);
+}
+
+bool ShmRing::empty() const
+{
+    return mHeader->head.load(std::memory_order_acquire) == mHeader->tail.load(std::memory_order_acquire);
+}
+
+int64_t ShmRing::heartbeatAgeMs() const
+{
+    return monotonic_us() / 1000 - static_cast<int64_t>(mHeader->heartbeat.load(std::memory_order_relaxed));
+}
+
+bool ShmRing::push(int index, const void *body, size_t bodySize)
+{
+    const uint32_t size = mHeader->size;
+    const size_t need = record_size(bodySize);
+    if (bodySize > maxBodySize()) {
+        return false;// 大消息走socket，避免长时间占满缓冲区
+    }
+
+    uint64_t head = mHeader->head.load(std::memory_order_relaxed);
+    const uint64_t tail = mHeader->tail.load(std::memory_order_acquire);
+    size_t pos = head & (size - 1);
+    const size_t contiguous = size - pos;
+    const size_t total = (need > contiguous) ? contiguous + need : need;
+    if (size - (head - tail) < total) {
+        return false;
+    }
+
+    if (need > contiguous) {
+        // 剩余的连续空间放不下，用填充记录跳到数据区开头
+        const uint32_t pad = SHM_RING_PAD_RECORD;
+        memcpy(mData + pos, &pad, sizeof(pad));
+        head += contiguous;
+        pos = 0;
+    }
+
+    const uint32_t length = static_cast<uint32_t>(4 + bodySize);
+    unsigned char header[4];
+    encode_cmd_header(index, header);
+    memcpy(mData + pos, &length, sizeof(length));
+    memcpy(mData + pos + 4, header, sizeof(header));
+    if (bodySize > 0) {
+        memcpy(mData + pos + 8, body, bodySize);
+    }
+    mHeader->head.store(head + need, std::memory_order_release);
+
+    // 与消费者设置waiting后再检查head的顺序配对，保证不会漏掉唤醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mHeader->waiting.load(std::memory_order_relaxed)) {
+        uint64_t one = 1;
+        if (write(mEventFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            KMRE_LOG(LOG_ERR, "[%s] Ring doorbell failed: %s", __func__, strerror(errno));
+        }
+    }
+    return true;
+}
+
+bool ShmRing::pop(int &index, std::string &body)
+{
+    const uint32_t size = mHeader->size;
+    uint64_t tail = mHeader->tail.load(std::memory_order_relaxed);
+
+    for (;;) {
+        const uint64_t head = mHeader->head.load(std::memory_order_acquire);
+        if (tail == head) {
+            return false;
+        }
+
+        const size_t pos = tail & (size - 1);
+        uint32_t length;
+        memcpy(&length, mData + pos, sizeof(length));
+        if (length == SHM_RING_PAD_RECORD) {
+            tail += size - pos;
+            mHeader->tail.store(tail, std::memory_order_release);
+            continue;
+        }
+        if (length < 4 || record_size(length - 4) > size - pos || record_size(length - 4) > head - tail) {
+            // 对端写坏了数据，丢弃已有内容
+            KMRE_LOG(LOG_ERR, "[%s] Corrupted ring record, length=%u", __func__, length);
+            mHeader->tail.store(head, std::memory_order_release);
+            return false;
+        }
+
+        const unsigned char *header = reinterpret_cast<const unsigned char *>(mData + pos + 4);
+        index = header[0] * 1000 + header[1] * 100 + header[2] * 10 + header[3];
+        body.assign(mData + pos + 8, length - 4);
+        mHeader->tail.store(tail + record_size(length - 4), std::memory_order_release);
+        beat();
+        return true;
+    }
+}
+
+void ShmRing::wait(int timeoutMs)
+{
+    if (timeoutMs < 0 || timeoutMs > SHM_RING_HEARTBEAT_MS) {
+        timeoutMs = SHM_RING_HEARTBEAT_MS;
+    }
+    beat();
+    mHeader->waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mHeader->head.load(std::memory_order_relaxed) == mHeader->tail.load(std::memory_order_relaxed)) {
+        struct pollfd pfd = {mEventFd, POLLIN, 0};
+        if (poll(&pfd, 1, timeoutMs) > 0) {
+            uint64_t count;
+            if (read(mEventFd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                KMRE_LOG(LOG_ERR, "[%s] Read doorbell failed: %s", __func__, strerror(errno));
+            }
+        }
+    }
+    mHeader->waiting.store(0, std::memory_order_relaxed);
+    beat();
+}
+
+ControlRingManager& ControlRingManager::getInstance()
+{
+    static ControlRingManager instance;
+    return instance;
+}
+
+void ControlRingManager::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEnabled = enabled;
+    if (!enabled) {
+        mChannels.clear();
+    }
+}
+
+std::shared_ptr<ControlRingManager::Channel> ControlRingManager::channelFor(const std::string &socketPath)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    std::shared_ptr<Channel> &channel = mChannels[socketPath];
+    if (!channel) {
+        channel = std::make_shared<Channel>();
+    }
+    return channel;
+}
+
+// 在一次普通连接上发送OpenControlRing，memfd和eventfd作为附属数据随命令头一起发出
+ControlRingManager::NegotiateResult ControlRingManager::negotiate(const std::string &socketPath,
+                                                                  std::shared_ptr<ShmRing> &result)
+{
+    std::shared_ptr<ShmRing> ring = std::make_shared<ShmRing>();
+    if (!ring->create(SHM_RING_DEFAULT_SIZE)) {
+        return eNegotiate_Retry;
+    }
+
+    int fd = connect_socket(socketPath.c_str());
+    if (fd < 0) {
+        return eNegotiate_Retry;
+    }
+    typedef CommandTraits<kmrecore::OpenControlRing> Traits;
+    set_timeout(fd, Traits::kTimeoutSec, Traits::kTimeoutSec);
+
+    cn::kylinos::kmre::kmrecore::OpenControlRing obj;
+    obj.set_version(SHM_RING_VERSION);
+    obj.set_size(static_cast<int>(ring->size()));
+    std::string body;
+    obj.SerializeToString(&body);
+
+    unsigned char header[4];
+    encode_cmd_header(Traits::kIndex, header);
+    struct iovec iov[2] = {{header, sizeof(header)}, {&body[0], body.size()}};
+
+    int fds[2] = {ring->memFd(), ring->eventFd()};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header) + body.size())) {
+        close(fd);
+        return eNegotiate_Retry;
+    }
+
+    std::string reply;
+    char buf[BUF_SIZE];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        reply.append(buf, n);
+    }
+    close(fd);
+
+    // 不认识该命令的旧版本服务端会直接关闭连接、不回复或回复失败
+    cn::kylinos::kmre::kmrecore::ActionResult reply_result;
+    if (reply.empty() || !reply_result.ParseFromString(reply) || !reply_result.result()) {
+        return eNegotiate_Unsupported;
+    }
+    result = std::move(ring);
+    return eNegotiate_Ok;
+}
+
+void ControlRingManager::startNegotiateLocked(const std::string &socketPath, const std::shared_ptr<Channel> &channel)
+{
+    channel->negotiating = true;
+    try {
+        std::thread([socketPath, channel]() {
+            std::shared_ptr<ShmRing> ring;
+            NegotiateResult result = negotiate(socketPath, ring);
+
+            std::lock_guard<std::mutex> lock(channel->mutex);
+            channel->negotiating = false;
+            if (result == eNegotiate_Ok) {
+                channel->ring = std::move(ring);
+                KMRE_LOG(LOG_INFO, "[%s] Control ring to '%s' established.", __func__, socketPath.c_str());
+            }
+            else if (result == eNegotiate_Unsupported) {
+                channel->unsupported = true;
+                KMRE_LOG(LOG_INFO, "[%s] '%s' doesn't support control ring, use socket.", __func__,
+                         socketPath.c_str());
+            }
+            else {
+                channel->retryAfter = monotonic_us() / 1000 + CONTROL_RING_RETRY_MS;
+            }
+        }).detach();
+    }
+    catch (const std::system_error &e) {
+        KMRE_LOG(LOG_ERR, "[%s] Create thread failed: %s", __func__, e.what());
+        channel->negotiating = false;
+        channel->retryAfter = monotonic_us() / 1000 + CONTROL_RING_RETRY_MS;
+    }
+}
+
+bool ControlRingManager::aliveLocked(Channel &channel, int64_t now)
+{
+    if (channel.ring->heartbeatAgeMs() <= CONTROL_RING_STALL_MS) {
+        return true;
+    }
+    KMRE_LOG(LOG_WARNING, "[%s] Control ring consumer stopped, fall back to socket.", __func__);
+    channel.ring.reset();
+    channel.retryAfter = now + CONTROL_RING_RETRY_MS;
+    return false;
+}
+
+bool ControlRingManager::send(int index, const google::protobuf::MessageLite &msg)
+{
+    if (!mEnabled) {
+        return false;
+    }
+
+    // 走控制通道的命令都发往launcher
+    const std::string &socketPath = get_socket_path(eLink_Launcher);
+    std::shared_ptr<Channel> channel = channelFor(socketPath);
+    if (channel->socketCommands.load() > 0) {
+        return false;// 与进行中的socket命令走同一条通道，保持先后顺序
+    }
+    std::lock_guard<std::mutex> lock(channel->mutex);
+
+    const int64_t now = monotonic_us() / 1000;
+    if (!channel->ring) {
+        // 协商完成前本条及之后的命令走socket
+        if (!channel->negotiating && !channel->unsupported && now >= channel->retryAfter) {
+            startNegotiateLocked(socketPath, channel);
+        }
+        return false;
+    }
+    if (!aliveLocked(*channel, now)) {
+        return false;
+    }
+
+    const size_t bodySize = msg.ByteSizeLong();
+    if (bodySize > channel->ring->maxBodySize()) {
+        return false;
+    }
+    std::string &buffer = thread_send_buffer();
+    buffer.resize(bodySize);
+    msg.SerializeWithCachedSizesToArray(reinterpret_cast<uint8_t *>(&buffer[0]));
+    // 缓冲区满时对端仍有心跳，只是本条改走socket
+    return channel->ring->push(index, buffer.data(), buffer.size());
+}
+
+void ControlRingFence::enter(const std::string &socketPath)
+{
+    ControlRingManager &manager = ControlRingManager::getInstance();
+    if (!manager.enabled() || mChannel) {
+        return;
+    }
+
+    mChannel = manager.channelFor(socketPath);
+    ++mChannel->socketCommands;// 先挡住新的控制通道命令，再等已写入的被取走
+
+    std::shared_ptr<ShmRing> ring;
+    {
+        std::lock_guard<std::mutex> lock(mChannel->mutex);
+        ring = mChannel->ring;
+    }
+    if (!ring) {
+        return;
+    }
+
+    // 此时只有消费者在取，不持有通道锁等待，其他线程的控制通道命令直接改走socket而不是排队;
+    // 消费者停止心跳时不再等满CONTROL_RING_DRAIN_MS
+    const int64_t start = monotonic_us() / 1000;
+    int64_t now = start;
+    while (!ring->empty() && now - start < CONTROL_RING_DRAIN_MS &&
+           ring->heartbeatAgeMs() <= CONTROL_RING_STALL_MS) {
+        usleep(CONTROL_RING_DRAIN_POLL_US);
+        now = monotonic_us() / 1000;
+    }
+    if (ring->empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mChannel->mutex);
+    if (mChannel->ring == ring && manager.aliveLocked(*mChannel, now)) {
+        KMRE_LOG(LOG_WARNING, "[%s] Control ring not drained in %d ms before socket command!", __func__,
+                 CONTROL_RING_DRAIN_MS);
+    }
+}
+
+void ControlRingFence::leave()
+{
+    if (mChannel) {
+        --mChannel->socketCommands;
+        mChannel.reset();
+    }
+}
+
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_SHM_RING_H__
+#define __KMRE_SHM_RING_H__
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <google/protobuf/message_lite.h>
+
+namespace KmreSocket {
+
+#define SHM_RING_MAGIC 0x4b4d5247  // "KMRG"
+#define SHM_RING_VERSION 2
+#define SHM_RING_DEFAULT_SIZE (64 * 1024)
+#define SHM_RING_HEARTBEAT_MS 500   // 消费者至少以该间隔更新heartbeat
+
+// memfd中的布局: 头部 + 数据区; 生产者和消费者的位置各占一个cache line，避免伪共享
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                                  // 数据区大小，2的幂
+    uint32_t reserved;
+    alignas(64) std::atomic<uint64_t> head;         // 生产者写入位置(单调递增)
+    alignas(64) std::atomic<uint64_t> tail;         // 消费者读取位置(单调递增)
+    std::atomic<uint64_t> heartbeat;                // 消费者最近一次取数据或等待的CLOCK_MONOTONIC时间(毫秒)
+    alignas(64) std::atomic<uint32_t> waiting;      // 消费者即将休眠，生产者需要敲门(eventfd)
+};
+
+// 单生产者单消费者环形缓冲区，每条记录为 长度(4字节) + 命令头(4字节) + 消息体，按8字节对齐
+class ShmRing
+{
+public:
+    ShmRing() = default;
+    ~ShmRing();
+
+    // 生产者: 创建memfd和eventfd
+    bool create(uint32_t size);
+    // 消费者: 映射对端发来的memfd和eventfd，成功后接管这两个fd
+    bool attach(int memFd, int eventFd);
+
+    int memFd() const { return mMemFd; }
+    int eventFd() const { return mEventFd; }
+    uint32_t size() const { return mHeader ? mHeader->size : 0; }
+    size_t maxBodySize() const { return size() / 4 - 8; }
+
+    // 空间不足时返回false，由调用方改走socket
+    bool push(int index, const void *body, size_t bodySize);
+    // 没有数据时返回false
+    bool pop(int &index, std::string &body);
+    // 消费者等待新数据，最多等待SHM_RING_HEARTBEAT_MS(timeoutMs<0或更大时)，需要循环调用以保持心跳
+    void wait(int timeoutMs);
+
+    bool empty() const;
+    // 生产者: 消费者超过该时间(毫秒)没有心跳
+    int64_t heartbeatAgeMs() const;
+
+private:
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    bool map(size_t length);
+    void beat();
+
+    int mMemFd = -1;
+    int mEventFd = -1;
+    ShmRingHeader *mHeader = nullptr;
+    char *mData = nullptr;
+    size_t mMapLength = 0;
+};
+
+// 按launcher socket路径维护控制通道，首次使用时在后台线程协商，协商完成前及失败的容器走socket
+class ControlRingManager
+{
+public:
+    static ControlRingManager& getInstance();
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return mEnabled; }
+
+    // 通过本线程当前容器的控制通道发送命令; 返回false时调用方应改走socket
+    bool send(int index, const google::protobuf::MessageLite &msg);
+
+private:
+    friend class ControlRingFence;
+
+    ControlRingManager() = default;
+    ControlRingManager(const ControlRingManager&) = delete;
+    ControlRingManager& operator=(const ControlRingManager&) = delete;
+
+    struct Channel {
+        std::mutex mutex;               // 多个调用线程共用同一个生产者
+        std::shared_ptr<ShmRing> ring;  // ControlRingFence在锁外等待时也持有
+        int64_t retryAfter = 0;         // 连接失败或对端停止心跳后暂不重试的截止时间(毫秒)
+        bool negotiating = false;
+        bool unsupported = false;       // 对端不认识OpenControlRing，不再重试
+        std::atomic<int> socketCommands{0};// 本进程发往该launcher、尚未结束的socket命令数
+    };
+
+    typedef enum {
+        eNegotiate_Ok = 0,
+        eNegotiate_Retry,               // 连接不上等，稍后重试
+        eNegotiate_Unsupported,         // 已发出但对端关闭连接、不回复或回复失败
+    }NegotiateResult;
+
+    std::shared_ptr<Channel> channelFor(const std::string &socketPath);
+    // 需持有channel.mutex，在后台线程中协商，不阻塞调用线程
+    void startNegotiateLocked(const std::string &socketPath, const std::shared_ptr<Channel> &channel);
+    static NegotiateResult negotiate(const std::string &socketPath, std::shared_ptr<ShmRing> &ring);
+    // 对端超过CONTROL_RING_STALL_MS没有心跳时丢弃控制通道，之后改走socket; 需持有channel.mutex
+    bool aliveLocked(Channel &channel, int64_t now);
+
+    std::atomic<bool> mEnabled{false};
+    std::mutex mMutex;
+    std::map<std::string, std::shared_ptr<Channel>> mChannels;
+};
+
+// 控制通道与socket是两条独立的通道，对端不保证两者之间的先后顺序:
+// 发往launcher的socket命令开始前等待控制通道中已写入的命令被取走，
+// 在本对象析构(socket命令结束)前，本进程发往该launcher的控制通道命令都改走socket
+class ControlRingFence
+{
+public:
+    ControlRingFence() = default;
+    ~ControlRingFence() { leave(); }
+
+    // 控制通道未开启时不做任何事
+    void enter(const std::string &socketPath);
+    void leave();
+
+private:
+    ControlRingFence(const ControlRingFence&) = delete;
+    ControlRingFence& operator=(const ControlRingFence&) = delete;
+
+    std::shared_ptr<ControlRingManager::Channel> mChannel;
+};
+
+}
+
+#endif // __KMRE_SHM_RING_H__
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_singleflight.h"
+
+namespace KmreSocket {
+
+SingleFlight& SingleFlight::getInstance()
+{
+    static SingleFlight instance;
+    return instance;
+}
+
+std::shared_ptr<SingleFlight::Call> SingleFlight::join(const std::string &key, bool &leader)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    auto it = mCalls.find(key);
+    if (it != mCalls.end()) {
+        leader = false;
+        const uint64_t waiters = static_cast<uint64_t>(++it->second->waiters);
+        if (waiters > mMaxWaiters) {
+            mMaxWaiters = waiters;
+        }
+        return it->second;
+    }
+
+    leader = true;
+    ++mLeaders;
+    std::shared_ptr<Call> call = std::make_shared<Call>();
+    mCalls.emplace(key, call);
+    return call;
+}
+
+bool SingleFlight::wait(const std::shared_ptr<Call> &call, int timeoutMs, CommandStatus &status,
+                        std::shared_ptr<const google::protobuf::Message> &reply)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (!call->cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&call]() { return call->done; })) {
+        --call->waiters;// 不再需要leader复制回复
+        ++mExpired;
+        return false;
+    }
+    ++mShared;
+    status = call->status;
+    reply = call->reply;
+    return true;
+}
+
+void SingleFlight::finish(const std::string &key, const std::shared_ptr<Call> &call, CommandStatus status,
+                          const google::protobuf::Message &reply)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCalls.erase(key);// 之后到达的相同请求重新发送，不会拿到已经过时的回复
+    if (call->waiters > 0 && status == eCommand_Ok) {
+        try {
+            std::shared_ptr<google::protobuf::Message> copy(reply.New());
+            copy->CopyFrom(reply);
+            call->reply = copy;
+        } catch (...) {// 在析构中调用，不能抛出; 等待者按失败处理
+            status = eCommand_SendFailed;
+        }
+    }
+    call->status = status;
+    call->done = true;
+    call->cond.notify_all();
+}
+
+std::string SingleFlight::statsJson()
+{
+    std::string json = std::string("{\"enabled\":") + (mEnabled ? "true" : "false");
+    json += ",\"leaders\":" + std::to_string(mLeaders.load());
+    json += ",\"shared\":" + std::to_string(mShared.load());
+    json += ",\"max_waiters\":" + std::to_string(mMaxWaiters.load());
+    json += ",\"expired\":" + std::to_string(mExpired.load());
+    json += "}";
+    return json;
+}
+
+}
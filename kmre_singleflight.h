@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_SINGLEFLIGHT_H__
+#define __KMRE_SINGLEFLIGHT_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include <google/protobuf/message.h>
+
+#include "kmre_connect_socket.h"
+
+namespace KmreSocket {
+
+// 命令没有登记收发超时时，等待者最多等待先到者的时间(毫秒)，超过后自己发送
+#define SINGLEFLIGHT_WAIT_MS 5000
+
+// 本进程内同时发出的相同查询(命令编号、目标socket和序列化后的参数都相同)只发送一次，
+// 后到的调用者等待先到者的请求完成后复制其解析好的回复，不再各自连接容器
+class SingleFlight
+{
+public:
+    static SingleFlight& getInstance();
+
+    struct Call {
+        std::condition_variable cond;
+        bool done = false;
+        int waiters = 0;
+        CommandStatus status = eCommand_SendFailed;
+        std::shared_ptr<const google::protobuf::Message> reply;// 有等待者时才保存
+    };
+
+    // 同一key已有请求在进行时返回该请求(leader为false)，否则登记新请求并由调用者发送(leader为true)
+    std::shared_ptr<Call> join(const std::string &key, bool &leader);
+    // 最多等待timeoutMs毫秒，leader完成时返回true并给出其状态，成功时reply指向共享的回复;
+    // 超时返回false，调用者不再等待，自己发送
+    bool wait(const std::shared_ptr<Call> &call, int timeoutMs, CommandStatus &status,
+              std::shared_ptr<const google::protobuf::Message> &reply);
+    // leader完成后调用(含异常退出)，唤醒全部等待者; 有等待者时复制一份回复给等待者
+    void finish(const std::string &key, const std::shared_ptr<Call> &call, CommandStatus status,
+                const google::protobuf::Message &reply);
+
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    bool enabled() const { return mEnabled; }
+    std::string statsJson();
+
+private:
+    SingleFlight() = default;
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_ptr<Call>> mCalls;
+    std::atomic<bool> mEnabled{true};
+
+    std::atomic<uint64_t> mLeaders{0};
+    std::atomic<uint64_t> mShared{0};      // 等待并复用了其他调用者的回复
+    std::atomic<uint64_t> mMaxWaiters{0};
+    std::atomic<uint64_t> mExpired{0};     // 等待超时后自己发送
+};
+
+// leader在离开作用域时调用finish，send_command抛出异常时等待者也会被唤醒
+class SingleFlightLeader
+{
+public:
+    SingleFlightLeader(SingleFlight &flight, const std::string &key, const std::shared_ptr<SingleFlight::Call> &call,
+                       const google::protobuf::Message &reply)
+        : mFlight(flight), mKey(key), mCall(call), mReply(reply) {}
+    ~SingleFlightLeader() { mFlight.finish(mKey, mCall, mStatus, mReply); }
+
+    void setStatus(CommandStatus status) { mStatus = status; }
+
+private:
+    SingleFlightLeader(const SingleFlightLeader&) = delete;
+    SingleFlightLeader& operator=(const SingleFlightLeader&) = delete;
+
+    SingleFlight &mFlight;
+    const std::string &mKey;
+    std::shared_ptr<SingleFlight::Call> mCall;
+    const google::protobuf::Message &mReply;
+    CommandStatus mStatus = eCommand_SendFailed;
+};
+
+// 与send_command(data, reply)相同，但会与本进程中正在进行的相同请求合并
+template <typename T>
+CommandStatus send_command_shared(const T &data, typename CommandTraits<T>::ReplyType &reply)
+{
+    typedef typename CommandTraits<T>::ReplyType R;
+
+    SingleFlight &flight = SingleFlight::getInstance();
+    std::string args;
+    if (!flight.enabled() || !data.SerializeToString(&args)) {
+        return send_command(data, reply);
+    }
+
+    // 不同用户的容器socket不同，不会合并
+    std::string key = std::to_string(CommandTraits<T>::kIndex) + '\0' + get_socket_path(CommandTraits<T>::kLink) +
+                      '\0' + args;
+    bool leader = false;
+    std::shared_ptr<SingleFlight::Call> call = flight.join(key, leader);
+    if (leader) {
+        SingleFlightLeader guard(flight, key, call, reply);
+        CommandStatus status = send_command(data, reply);
+        guard.setStatus(status);
+        return status;
+    }
+
+    // leader连接、发送和接收各自最多用去登记的超时时间
+    const int timeoutMs = CommandTraits<T>::kTimeoutSec > 0 ? CommandTraits<T>::kTimeoutSec * 3000
+                                                            : SINGLEFLIGHT_WAIT_MS;
+    std::shared_ptr<const google::protobuf::Message> shared;
+    CommandStatus status = eCommand_SendFailed;
+    if (!flight.wait(call, timeoutMs, status, shared)) {
+        return send_command(data, reply);
+    }
+    if (status == eCommand_Ok) {
+        reply.CopyFrom(static_cast<const R&>(*shared));
+    }
+    return status;
+}
+
+}
+
+#endif // __KMRE_SINGLEFLIGHT_H__
@@ -23,16 +23,296 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <sys/syslog.h>
+#include <pwd.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "kmre_log.h"
+#include "kmre_command.h"
 
 namespace KmreSocket {
 
+bool file_is_exists(const char *filepath)
+{
+    struct stat statbuf;
+    return stat(filepath, &statbuf) == 0;
+}
+
+std::string get_user_name()
+{
+    std::string user_name = "";
+    struct passwd  pwd;
+    struct passwd *result = nullptr;
+    char *buf = nullptr;
+
+    int bufSize = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (bufSize == -1) {
+        bufSize = 16384;
+    }
+    buf = new char[bufSize]();
+
+    getpwuid_r(getuid(), &pwd, buf, bufSize, &result);
+    if (result && pwd.pw_name) {
+        user_name = pwd.pw_name;
+    }
+    else {
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] getpwuid_r error!", __func__);
+
+        // 环境变量可能不存在，不能直接用nullptr构造std::string
+        const char *env = std::getenv("USER");
+        if (!env || !*env) {
+            env = std::getenv("USERNAME");
+        }
+        if (env && *env) {
+            user_name = env;
+        }
+        else {
+            char name[16];
+            snprintf(name, sizeof(name), "%u", getuid());
+            user_name = std::string(name);
+        }
+    }
+
+    if (buf) {
+        delete[] buf;
+    }
+
+    return user_name;
+}
+
+std::string get_uid()
+{
+    uid_t uid = getuid();
+    static char uidstr[12] = {0};
+    snprintf(uidstr, sizeof(uidstr), "%d", uid);
+
+    return std::string(uidstr);
+}
+
+std::string convertUserNameToPath(const std::string& userName)
+{
+    char buffer[BUF_SIZE] = {0};
+    std::string path = userName;
+    unsigned int i = 0;
+    const char* str = nullptr;
+
+    str = userName.c_str();
+    if (str && strstr(str, "\\")) {
+        snprintf(buffer, sizeof(buffer), "%s", str);
+        for (i = 0; i < sizeof(buffer); ++i) {
+            if ('\0' == buffer[i]) {
+                break;
+            }
+
+            if ('\\' == buffer[i]) {
+                buffer[i] = '_';
+            }
+        }
+
+        path = buffer;
+    }
+
+    return path;
+}
+
+static const char *socket_name(SocketLink link)
+{
+    switch (link) {
+    case eLink_Launcher: return "kmre_launcher";
+    case eLink_Manager: return "kmre_manager";
+    default: return "";
+    }
+}
+
+const std::string& get_socket_root()
+{
+    static const std::string root = []() {
+        const char *value = getenv("KMRE_SOCKET_ROOT");
+        std::string dir = (value && value[0]) ? value : "/var/lib/kmre";
+        if (dir.back() != '/') {
+            dir += '/';
+        }
+        return dir;
+    }();
+    return root;
+}
+
+std::string get_container_socket_dir(uid_t uid, const std::string &userName)
+{
+    return get_socket_root() + "kmre-" + std::to_string(uid) + "-" + convertUserNameToPath(userName) + "/sockets/";
+}
+
+std::string get_user_name_by_uid(uid_t uid)
+{
+    std::string user_name = "";
+    struct passwd  pwd;
+    struct passwd *result = nullptr;
+
+    long bufSize = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (bufSize == -1) {
+        bufSize = 16384;
+    }
+    std::vector<char> buf(bufSize);
+
+    if (getpwuid_r(uid, &pwd, buf.data(), buf.size(), &result) == 0 && result && pwd.pw_name) {
+        user_name = pwd.pw_name;
+    }
+    return user_name;
+}
+
+struct ContainerTarget {
+    uid_t uid;
+    std::string userName;
+    std::string socketDir;
+    int refCount;
+};
+
+static std::mutex gTargetMutex;
+static std::map<int, ContainerTarget> gTargets;
+static int gNextTargetHandle = 1;
+static thread_local std::string tlsSocketDir;// 为空时访问本进程用户的容器
+static thread_local std::string tlsSocketPaths[eLink_Count];// 由tlsSocketDir拼接，发送命令时不再重复拼接
+static thread_local bool tlsSocketPathsValid = false;
+
+static const std::string& self_socket_dir()
+{
+    static const std::string dir = get_socket_root() + "kmre-" + get_uid() + "-" + convertUserNameToPath(get_user_name()) + "/sockets/";
+    return dir;
+}
+
+int open_container_target(uid_t uid, const std::string &userName)
+{
+    std::string user = userName.empty() ? get_user_name_by_uid(uid) : userName;
+    if (user.empty()) {
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] Can't find user name of uid %u!", __func__, uid);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(gTargetMutex);
+    for (auto &target : gTargets) {
+        if (target.second.uid == uid && target.second.userName == user) {
+            ++target.second.refCount;
+            return target.first;
+        }
+    }
+
+    int handle = gNextTargetHandle++;
+    gTargets[handle] = {uid, user, get_container_socket_dir(uid, user), 1};
+    return handle;
+}
+
+bool close_container_target(int handle)
+{
+    std::lock_guard<std::mutex> lock(gTargetMutex);
+    auto it = gTargets.find(handle);
+    if (it == gTargets.end()) {
+        return false;
+    }
+    if (--it->second.refCount <= 0) {
+        gTargets.erase(it);
+    }
+    return true;
+}
+
+bool select_container_target(int handle)
+{
+    if (handle <= 0) {
+        tlsSocketDir.clear();
+        tlsSocketPathsValid = false;
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(gTargetMutex);
+    auto it = gTargets.find(handle);
+    if (it == gTargets.end()) {
+        return false;
+    }
+    tlsSocketDir = it->second.socketDir;
+    tlsSocketPathsValid = false;
+    return true;
+}
+
+bool get_target_socket_path(int handle, SocketLink link, std::string &path)
+{
+    if (handle <= 0) {
+        path = self_socket_dir() + socket_name(link);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(gTargetMutex);
+    auto it = gTargets.find(handle);
+    if (it == gTargets.end()) {
+        return false;
+    }
+    path = it->second.socketDir + socket_name(link);
+    return true;
+}
+
+const std::string& get_socket_path(SocketLink link)
+{
+    if (!tlsSocketPathsValid) {
+        const std::string &dir = tlsSocketDir.empty() ? self_socket_dir() : tlsSocketDir;
+        for (int n = 0; n < eLink_Count; n++) {
+            tlsSocketPaths[n].assign(dir).append(socket_name(static_cast<SocketLink>(n)));
+        }
+        tlsSocketPathsValid = true;
+    }
+    return tlsSocketPaths[link];
+}
+
+// 命令编号对应的连接及是否有回复，由 kmre_command.h 中的登记表生成
+SocketLink link_of_command(int index)
+{
+#define KMRE_COMMAND_LINK(Message, Index, Link, Reply, Priority, TimeoutSec, ControlRing) \
+    case Index: return Link;
+
+    switch (index) {
+    KMRE_COMMAND_LIST(KMRE_COMMAND_LINK)
+    default:
+        return eLink_Launcher;
+    }
+#undef KMRE_COMMAND_LINK
+}
+
+bool command_has_reply(int index)
+{
+#define KMRE_COMMAND_HAS_REPLY(Message, Index, Link, Reply, Priority, TimeoutSec, ControlRing) \
+    case Index: return CommandTraits<kmrecore::Message>::kHasReply;
+
+    switch (index) {
+    KMRE_COMMAND_LIST(KMRE_COMMAND_HAS_REPLY)
+    default:
+        return false;
+    }
+#undef KMRE_COMMAND_HAS_REPLY
+}
+
+void encode_cmd_header(int index, unsigned char header[4])
+{
+    header[0] = static_cast<unsigned char>((index / 1000) % 10);
+    header[1] = static_cast<unsigned char>((index / 100) % 10);
+    header[2] = static_cast<unsigned char>((index / 10) % 10);
+    header[3] = static_cast<unsigned char>(index % 10);
+}
+
+int64_t monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 int connect_socket(const char *container_socket_file)
 {
     int fd, len, err, rval;
     struct sockaddr_un un;
 
     if((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] socket error: %s, %d\n", __func__, strerror(errno), errno);
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] socket error: %s, %d\n", __func__, strerror(errno), errno);
         return -1;
     }
 
@@ -44,7 +324,7 @@ int connect_socket(const char *container_socket_file)
 
     if(connect(fd, (struct sockaddr*)&un, len) < 0)
     {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] connect error: %s, %d\n", __func__, strerror(errno), errno);
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] connect error: %s, %d\n", __func__, strerror(errno), errno);
         close(fd);
         return -1;
     }
@@ -73,6 +353,102 @@ int write_fully(int fd, const void *buffer, size_t size)
     return retval;
 }
 
+int write_fully_vectored(int fd, const void *header, size_t headerSize, const void *body, size_t bodySize)
+{
+    const size_t total = headerSize + bodySize;
+    size_t sent = 0;
+
+    while (sent < total) {
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (sent < headerSize) {
+            iov[iovcnt].iov_base = (char *)header + sent;
+            iov[iovcnt].iov_len = headerSize - sent;
+            ++iovcnt;
+            iov[iovcnt].iov_base = const_cast<void *>(body);
+            iov[iovcnt].iov_len = bodySize;
+            ++iovcnt;
+        }
+        else {
+            iov[iovcnt].iov_base = (char *)body + (sent - headerSize);
+            iov[iovcnt].iov_len = total - sent;
+            ++iovcnt;
+        }
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t stat = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (stat < 0) {
+            if (errno != EINTR) {
+                return stat;
+            }
+        } else {
+            sent += stat;
+        }
+    }
+
+    return 0;
+}
+
+#define SEND_BUFFER_KEEP_SIZE (64 * 1024)
+#define RECV_BUFFER_KEEP_SIZE (64 * 1024)
+
+static thread_local std::string tlsSendBuffer;
+static thread_local std::string tlsRecvBuffer;
+
+std::string &thread_send_buffer()
+{
+    return tlsSendBuffer;
+}
+
+// 偶尔发送的大消息(如大段剪贴板内容)不应让缓冲区一直占用内存
+void trim_thread_send_buffer()
+{
+    if (tlsSendBuffer.capacity() > SEND_BUFFER_KEEP_SIZE) {
+        std::string().swap(tlsSendBuffer);
+    }
+}
+
+std::string &thread_recv_buffer()
+{
+    return tlsRecvBuffer;
+}
+
+// 偶尔收到的大回复(如带图标的应用列表)不应让缓冲区一直占用内存
+void trim_thread_recv_buffer()
+{
+    if (tlsRecvBuffer.capacity() > RECV_BUFFER_KEEP_SIZE) {
+        std::string().swap(tlsRecvBuffer);
+    }
+}
+
+ssize_t read_until_eof(int fd, std::string &buf)
+{
+    size_t total = 0;
+    for (;;) {
+        if (buf.size() < total + BUF_SIZE) {
+            buf.resize(std::max(buf.size() * 2, total + BUF_SIZE));
+        }
+
+        ssize_t stat = recv(fd, &buf[total], buf.size() - total, 0);
+        if (stat > 0) {
+            total += stat;
+        }
+        else if (stat == 0) {
+            break;
+        }
+        else if (errno != EINTR) {
+            KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] read failed after %zu bytes: %s(errno: %d)",
+                __func__, total, strerror(errno), errno);
+            return -1;
+        }
+    }
+    return static_cast<ssize_t>(total);
+}
+
 ssize_t read_buf(int fd, void *buf, size_t len)
 {
     if (!buf) {
@@ -84,7 +460,7 @@ ssize_t read_buf(int fd, void *buf, size_t len)
         return stat;
     }
 
-    syslog(LOG_ERR, "[libkylin-kmre][%s] read buf failed!\n", __func__);
+    KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] read buf failed!\n", __func__);
     return -1;
 }
 
@@ -95,14 +471,14 @@ ssize_t set_timeout(int fd, int send_timeout, int rcv_timeout)
     timeout.tv_sec = send_timeout;
     int iRes = setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(struct timeval));
     if (iRes != 0) {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] Set send timeout failed! iRes=%d,error: %s(errno: %d)\n", 
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] Set send timeout failed! iRes=%d,error: %s(errno: %d)\n", 
             __func__, iRes, strerror(errno), errno);
     }
 
     timeout.tv_sec = rcv_timeout;
     iRes = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(struct timeval));
     if (iRes != 0) {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] Set rcv timeout failed! iRes=%d,error: %s(errno: %d)\n", 
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] Set rcv timeout failed! iRes=%d,error: %s(errno: %d)\n", 
             __func__, iRes, strerror(errno), errno);
     }
 
@@ -121,7 +497,7 @@ ssize_t read_buf_with_timeout(int fd, void *buf, size_t len, int secs)
     timeout.tv_sec = timeoutsecs;
     int iRes = setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(struct timeval));
     if (iRes != 0) {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] setsockopt failed! iRes=%d,error: %s(errno: %d)\n", 
+        KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] setsockopt failed! iRes=%d,error: %s(errno: %d)\n", 
             __func__, iRes, strerror(errno), errno);
         ssize_t stat = recv(fd, (char *)(buf), len, 0);
         if (stat > 0) {
@@ -135,8 +511,33 @@ ssize_t read_buf_with_timeout(int fd, void *buf, size_t len, int secs)
         }
     }
 
-    syslog(LOG_ERR, "[libkylin-kmre][%s] read buf failed!\n", __func__);
+    KMRE_LOG(LOG_ERR, "[libkylin-kmre][%s] read buf failed!\n", __func__);
     return -1;
 }
 
+void append_json_string(std::string &out, const std::string &str)
+{
+    out += "\"";
+    for (char c : str) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: {
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            }
+            else {
+                out += c;
+            }
+        }break;
+        }
+    }
+    out += "\"";
+}
+
 }
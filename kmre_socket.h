@@ -33,11 +33,65 @@
 #include <sys/un.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <string>
 
 namespace KmreSocket {
 
+typedef enum {
+    eLink_Launcher = 0,
+    eLink_Manager,
+    eLink_Count,
+}SocketLink;
+
+#define BUF_SIZE 2048
+#define LAUNCHER_SOCKET_LOCK_FILE "/tmp/.kmre_launcher_socket.lock"
+#define MANAGER_SOCKET_LOCK_FILE "/tmp/.kmre_manager_socket.lock"
+
+bool file_is_exists(const char *filepath);
+std::string get_user_name();
+std::string get_uid();
+std::string convertUserNameToPath(const std::string& userName);
+std::string get_user_name_by_uid(uid_t uid);// 查不到时返回空字符串
+// 各容器socket目录的上级目录，默认为/var/lib/kmre/，可由环境变量KMRE_SOCKET_ROOT指定(如测试用的模拟服务端)，
+// 进程内第一次使用时确定
+const std::string& get_socket_root();
+std::string get_container_socket_dir(uid_t uid, const std::string &userName);
+
+// 本线程当前选中的容器(默认为本进程用户的容器)中link对应的socket路径，
+// 返回本线程缓存的路径，在本线程下一次选择容器前有效
+const std::string& get_socket_path(SocketLink link);
+
+// 以uid和用户名指定任意用户的容器，解析后的路径缓存在句柄中(句柄大于0)，
+// 同一容器重复打开返回同一句柄并增加引用计数
+int open_container_target(uid_t uid, const std::string &userName);
+bool close_container_target(int handle);
+// 本线程之后的请求发往handle对应的容器，handle<=0时恢复为本进程用户的容器
+bool select_container_target(int handle);
+bool get_target_socket_path(int handle, SocketLink link, std::string &path);
+
+SocketLink link_of_command(int index);
+bool command_has_reply(int index);
+
+// 命令头为4字节，每字节为命令编号的一位十进制数，如 0012 -> {0,0,1,2}
+void encode_cmd_header(int index, unsigned char header[4]);
+
+int64_t monotonic_us();
+
+// 以json字符串(带引号)追加str，转义其中的特殊字符
+void append_json_string(std::string &out, const std::string &str);
+
 int connect_socket(const char *container_socket_file);
 int write_fully(int fd, const void *buffer, size_t size);
+// 以一次sendmsg发送命令头和消息体，部分写入时继续发送剩余部分
+int write_fully_vectored(int fd, const void *header, size_t headerSize, const void *body, size_t bodySize);
+// 本线程复用的发送缓冲区，避免每次请求分配内存
+std::string &thread_send_buffer();
+void trim_thread_send_buffer();
+// 本线程复用的接收缓冲区
+std::string &thread_recv_buffer();
+void trim_thread_recv_buffer();
+// 读到对端关闭连接为止，buf按需扩大且只增不减; 返回读到的字节数，出错返回-1
+ssize_t read_until_eof(int fd, std::string &buf);
 ssize_t set_timeout(int fd, int send_timeout, int rcv_timeout);
 ssize_t read_buf(int fd, void *buf, size_t len);
 //ssize_t read_buf_with_timeout(int fd, void *buf, size_t len, int secs);
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_trace.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/syslog.h>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "kmre_log.h"
+#include "kmre_command.h"
+
+namespace KmreSocket {
+
+#define TRACE_MAX_EXITED_RINGS 16   // 已退出线程最多保留几个缓冲区
+
+static bool trace_env_enabled()
+{
+    const char *value = getenv("KMRE_TRACE");
+    return value && *value && strcmp(value, "0") != 0;
+}
+
+std::atomic<bool> gTraceEnabled{trace_env_enabled()};
+
+static const char *kSpanNames[eSpan_Count] = {
+    "command", "resolve", "schedule", "connect", "serialize", "write", "read", "parse",
+};
+
+static const char *command_name(int index)
+{
+#define KMRE_COMMAND_NAME(Message, Index, Link, Reply, Priority, TimeoutSec, ControlRing) \
+    case Index: return #Message;
+
+    switch (index) {
+    KMRE_COMMAND_LIST(KMRE_COMMAND_NAME)
+    default:
+        return "Unknown";
+    }
+#undef KMRE_COMMAND_NAME
+}
+
+struct TraceEvent {
+    int64_t start;
+    int64_t end;
+    int64_t bytes;
+    int16_t kind;
+    int16_t command;
+    bool ok;
+};
+
+// 单线程写入; 每个槽位带序号，导出时与写入并发也不会读到写了一半的记录
+struct ThreadRing {
+    struct Slot {
+        std::atomic<uint32_t> seq{0};// 奇数表示正在写
+        TraceEvent event;
+    };
+
+    pid_t tid = 0;
+    std::string name;
+    std::atomic<bool> exited{false};
+    uint64_t head = 0;// 只有所属线程访问
+    Slot slots[TRACE_RING_SIZE];
+};
+
+static std::atomic<int64_t> gClearedBefore{0};
+static std::mutex gRingsMutex;
+static std::vector<std::shared_ptr<ThreadRing>> gRings;
+
+// 线程退出时标记缓冲区，缓冲区本身留给之后的导出
+struct ThreadRingHolder {
+    std::shared_ptr<ThreadRing> ring;
+    ~ThreadRingHolder() {
+        if (ring) {
+            ring->exited = true;
+        }
+    }
+};
+
+static thread_local ThreadRingHolder tlsRing;
+
+static void prune_exited_rings_locked()
+{
+    size_t exited = 0;
+    for (const auto &ring : gRings) {
+        exited += ring->exited ? 1 : 0;
+    }
+    for (auto it = gRings.begin(); it != gRings.end() && exited > TRACE_MAX_EXITED_RINGS;) {
+        if ((*it)->exited) {
+            it = gRings.erase(it);
+            --exited;
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+static ThreadRing *thread_ring()
+{
+    if (!tlsRing.ring) {
+        std::shared_ptr<ThreadRing> ring = std::make_shared<ThreadRing>();
+        ring->tid = static_cast<pid_t>(syscall(SYS_gettid));
+        char name[16] = {0};
+        if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0) {
+            ring->name = name;
+        }
+
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        prune_exited_rings_locked();
+        gRings.push_back(ring);
+        tlsRing.ring = ring;
+    }
+    return tlsRing.ring.get();
+}
+
+void trace_set_enabled(bool enabled)
+{
+    gTraceEnabled = enabled;
+}
+
+void trace_record(SpanKind kind, int command, int64_t start, int64_t end, int64_t bytes, bool ok)
+{
+    ThreadRing *ring = thread_ring();
+    ThreadRing::Slot &slot = ring->slots[ring->head % TRACE_RING_SIZE];
+    ++ring->head;
+
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event.start = start;
+    slot.event.end = end;
+    slot.event.bytes = bytes;
+    slot.event.kind = static_cast<int16_t>(kind);
+    slot.event.command = static_cast<int16_t>(command);
+    slot.event.ok = ok;
+    slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+// 只记录清除时间，导出时跳过之前开始的span，不与写入线程竞争
+void trace_clear()
+{
+    gClearedBefore = monotonic_us();
+    std::lock_guard<std::mutex> lock(gRingsMutex);
+    for (auto it = gRings.begin(); it != gRings.end();) {
+        it = (*it)->exited ? gRings.erase(it) : it + 1;
+    }
+}
+
+static bool read_slot(const ThreadRing::Slot &slot, TraceEvent &event)
+{
+    uint32_t before = slot.seq.load(std::memory_order_acquire);
+    if (before == 0 || (before & 1) != 0) {
+        return false;
+    }
+    event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == before && event.start >= gClearedBefore.load();
+}
+
+std::string trace_chrome_json()
+{
+    std::vector<std::shared_ptr<ThreadRing>> rings;
+    {
+        std::lock_guard<std::mutex> lock(gRingsMutex);
+        rings = gRings;
+    }
+
+    const std::string pid = std::to_string(getpid());
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    json += "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"args\":{\"name\":";
+    append_json_string(json, std::string("libkmre ") + program_invocation_short_name);
+    json += "}}";
+
+    for (const auto &ring : rings) {
+        const std::string tid = std::to_string(ring->tid);
+        json += ",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid + ",\"args\":{\"name\":";
+        append_json_string(json, ring->name.empty() ? tid : ring->name);
+        json += "}}";
+
+        for (const auto &slot : ring->slots) {
+            TraceEvent event;
+            if (!read_slot(slot, event) || event.kind < 0 || event.kind >= eSpan_Count) {
+                continue;
+            }
+            // 同一线程内的span是嵌套的，Chrome按开始时间排序，不需要在此排序
+            json += ",{\"name\":\"";
+            json += kSpanNames[event.kind];
+            json += "\",\"cat\":\"kmre\",\"ph\":\"X\",\"ts\":" + std::to_string(event.start);
+            json += ",\"dur\":" + std::to_string(event.end - event.start);
+            json += ",\"pid\":" + pid + ",\"tid\":" + tid;
+            json += ",\"args\":{\"cmd\":" + std::to_string(event.command);
+            json += ",\"command\":\"";
+            json += command_name(event.command);
+            json += "\"";
+            if (event.bytes >= 0) {
+                json += ",\"bytes\":" + std::to_string(event.bytes);
+            }
+            json += std::string(",\"ok\":") + (event.ok ? "true" : "false") + "}}";
+        }
+    }
+    json += "]}";
+    return json;
+}
+
+bool trace_dump_to_file(const std::string &path)
+{
+    std::string json = trace_chrome_json();
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Open '%s' failed: %s", __func__, tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    for (size_t written = 0; written < json.size();) {
+        ssize_t len = write(fd, json.data() + written, json.size() - written);
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            ok = false;
+            break;
+        }
+        written += len;
+    }
+    ok = (close(fd) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Write '%s' failed: %s", __func__, path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+static std::mutex gSignalMutex;
+static std::string gSignalDir;
+static int gSignalPipe[2] = {-1, -1};
+
+static void trace_signal_handler(int)
+{
+    int savedErrno = errno;
+    char c = 0;
+    ssize_t ret = write(gSignalPipe[1], &c, 1);
+    (void)ret;
+    errno = savedErrno;
+}
+
+static void trace_signal_loop()
+{
+    pthread_setname_np(pthread_self(), "kmre-trace");
+    unsigned int count = 0;
+    char buf[64];
+
+    for (;;) {
+        ssize_t len = read(gSignalPipe[0], buf, sizeof(buf));
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (len <= 0) {
+            return;
+        }
+
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(gSignalMutex);
+            dir = gSignalDir;
+        }
+        std::string path = dir + "/kmre-trace-" + std::to_string(getpid()) + "-" + std::to_string(++count) + ".json";
+        if (trace_dump_to_file(path)) {
+            KMRE_LOG(LOG_INFO, "[%s] Trace written to '%s'", __func__, path.c_str());
+        }
+    }
+}
+
+bool trace_dump_on_signal(int signo, const std::string &dir)
+{
+    if (signo <= 0 || signo >= NSIG || signo == SIGKILL || signo == SIGSTOP || dir.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(gSignalMutex);
+    gSignalDir = dir;
+    if (gSignalPipe[0] < 0) {
+        if (pipe2(gSignalPipe, O_CLOEXEC) != 0) {
+            KMRE_LOG(LOG_ERR, "[%s] pipe2 failed: %s", __func__, strerror(errno));
+            return false;
+        }
+        // 写端非阻塞，短时间内收到很多信号时多余的直接丢弃
+        fcntl(gSignalPipe[1], F_SETFL, O_NONBLOCK);
+        try {
+            std::thread(trace_signal_loop).detach();
+        }
+        catch (const std::system_error &e) {
+            KMRE_LOG(LOG_ERR, "[%s] Create thread failed: %s", __func__, e.what());
+            close(gSignalPipe[0]);
+            close(gSignalPipe[1]);
+            gSignalPipe[0] = gSignalPipe[1] = -1;
+            return false;
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = trace_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(signo, &action, nullptr) != 0) {
+        KMRE_LOG(LOG_ERR, "[%s] sigaction(%d) failed: %s", __func__, signo, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+}
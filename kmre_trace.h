@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_TRACE_H__
+#define __KMRE_TRACE_H__
+
+#include <atomic>
+#include <string>
+
+#include "kmre_socket.h"
+
+namespace KmreSocket {
+
+typedef enum {
+    eSpan_Command = 0,  // send_command整体
+    eSpan_Resolve,      // 解析socket路径
+    eSpan_Schedule,     // 等待调度名额
+    eSpan_Connect,
+    eSpan_Serialize,
+    eSpan_Write,
+    eSpan_Read,
+    eSpan_Parse,
+    eSpan_Count,
+}SpanKind;
+
+#define TRACE_RING_SIZE 1024    // 每个线程保留最近的span个数
+
+// 默认关闭，环境变量 KMRE_TRACE=1 或 trace_set_enabled 打开；关闭时每个span只有一次原子读
+extern std::atomic<bool> gTraceEnabled;
+
+inline bool trace_enabled()
+{
+    return gTraceEnabled.load(std::memory_order_relaxed);
+}
+
+void trace_set_enabled(bool enabled);
+// 时间为CLOCK_MONOTONIC微秒，写入本线程的环形缓冲区，满时覆盖最旧的
+void trace_record(SpanKind kind, int command, int64_t start, int64_t end, int64_t bytes, bool ok);
+void trace_clear();
+
+// Chrome Trace Event格式(JSON)，可直接在chrome://tracing或Perfetto UI中打开
+std::string trace_chrome_json();
+bool trace_dump_to_file(const std::string &path);
+// 收到signo时将trace写入dir/kmre-trace-<pid>-<序号>.json，由后台线程完成，信号处理函数只写一个字节
+bool trace_dump_on_signal(int signo, const std::string &dir);
+
+// 析构时记录span，构造时未开启trace则什么也不做
+class TraceSpan
+{
+public:
+    TraceSpan(SpanKind kind, int command)
+        : mKind(kind), mCommand(command), mStart(trace_enabled() ? monotonic_us() : 0) {}
+
+    ~TraceSpan() {
+        end();
+    }
+
+    void setBytes(int64_t bytes) { mBytes = bytes; }
+    void setFailed() { mOk = false; }
+
+    void end() {
+        if (mStart > 0) {
+            trace_record(mKind, mCommand, mStart, monotonic_us(), mBytes, mOk);
+            mStart = 0;
+        }
+    }
+
+private:
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    SpanKind mKind;
+    int mCommand;
+    int64_t mStart;
+    int64_t mBytes = -1;
+    bool mOk = true;
+};
+
+}
+
+#endif // __KMRE_TRACE_H__
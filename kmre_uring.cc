@@ -0,0 +1,248 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "kmre_uring.h"
+
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/syslog.h>
+
+#include "kmre_log.h"
+
+namespace KmreSocket {
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                              const void *arg, size_t argSize)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+static std::atomic<int> gIoBackend{-1};
+
+static IoBackend backend_from_env()
+{
+    const char *value = getenv("KMRE_IO_BACKEND");
+    return (value && strcmp(value, "uring") == 0) ? eIoBackend_Uring : eIoBackend_Epoll;
+}
+
+void set_io_backend(IoBackend backend)
+{
+    gIoBackend = backend;
+}
+
+IoBackend get_io_backend()
+{
+    int backend = gIoBackend.load();
+    if (backend < 0) {
+        backend = backend_from_env();
+        gIoBackend = backend;
+    }
+    return static_cast<IoBackend>(backend);
+}
+
+// 需要5.11以上内核(IORING_FEAT_EXT_ARG用于带超时的等待)，
+// 且被seccomp或io_uring_disabled禁用时也视为不可用
+static bool probe_uring()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = sys_io_uring_setup(4, &params);
+    if (fd < 0) {
+        KMRE_LOG(LOG_INFO, "[%s] io_uring unavailable: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    bool ok = (params.features & IORING_FEAT_EXT_ARG) && (params.features & IORING_FEAT_NODROP);
+    const size_t probeSize = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = static_cast<struct io_uring_probe *>(calloc(1, probeSize));
+    if (ok && probe && sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        const int required[] = {IORING_OP_CONNECT, IORING_OP_SENDMSG, IORING_OP_READ,
+                                IORING_OP_READ_FIXED, IORING_OP_ASYNC_CANCEL};
+        for (int op : required) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                ok = false;
+            }
+        }
+    }
+    else {
+        ok = false;
+    }
+    free(probe);
+    close(fd);
+
+    if (!ok) {
+        KMRE_LOG(LOG_INFO, "[%s] io_uring lacks required features, use epoll instead.", __func__);
+    }
+    return ok;
+}
+
+bool uring_available()
+{
+    static const bool available = probe_uring();
+    return available;
+}
+
+IoUring::~IoUring()
+{
+    if (mSqes) {
+        munmap(mSqes, mSqesSize);
+    }
+    if (mCqRing && mCqRing != mSqRing) {
+        munmap(mCqRing, mCqRingSize);
+    }
+    if (mSqRing) {
+        munmap(mSqRing, mSqRingSize);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+bool IoUring::init(unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP;
+    mFd = sys_io_uring_setup(entries, &params);
+    if (mFd < 0) {
+        KMRE_LOG(LOG_ERR, "[%s] io_uring_setup failed: %s", __func__, strerror(errno));
+        return false;
+    }
+
+    mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mSqRingSize = mCqRingSize = (mSqRingSize > mCqRingSize) ? mSqRingSize : mCqRingSize;
+    }
+
+    mSqRing = mmap(nullptr, mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+    if (mSqRing == MAP_FAILED) {
+        mSqRing = nullptr;
+        KMRE_LOG(LOG_ERR, "[%s] Map sq ring failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        mCqRing = mSqRing;
+    }
+    else {
+        mCqRing = mmap(nullptr, mCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+        if (mCqRing == MAP_FAILED) {
+            mCqRing = nullptr;
+            KMRE_LOG(LOG_ERR, "[%s] Map cq ring failed: %s", __func__, strerror(errno));
+            return false;
+        }
+    }
+
+    mSqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        KMRE_LOG(LOG_ERR, "[%s] Map sqes failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    mSqes = static_cast<struct io_uring_sqe *>(sqes);
+
+    char *sq = static_cast<char *>(mSqRing);
+    mSqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    mSqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    mSqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    mSqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    mSqEntries = params.sq_entries;
+    mSqLocalTail = *mSqTail;
+
+    char *cq = static_cast<char *>(mCqRing);
+    mCqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    mCqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    mCqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    mCqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IoUring::registerBuffers(const struct iovec *iov, unsigned count)
+{
+    if (sys_io_uring_register(mFd, IORING_REGISTER_BUFFERS, iov, count) != 0) {
+        KMRE_LOG(LOG_WARNING, "[%s] Register buffers failed: %s", __func__, strerror(errno));
+        return false;
+    }
+    mBuffersRegistered = true;
+    return true;
+}
+
+struct io_uring_sqe *IoUring::getSqe()
+{
+    unsigned head = __atomic_load_n(mSqHead, __ATOMIC_ACQUIRE);
+    if (mSqLocalTail - head >= mSqEntries) {
+        return nullptr;
+    }
+
+    unsigned index = mSqLocalTail & *mSqMask;
+    struct io_uring_sqe *sqe = &mSqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    mSqArray[index] = index;
+    ++mSqLocalTail;
+    ++mToSubmit;
+    return sqe;
+}
+
+int IoUring::submitAndWait(int64_t timeoutMs)
+{
+    __atomic_store_n(mSqTail, mSqLocalTail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    if (timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+    }
+
+    for (;;) {
+        int ret = sys_io_uring_enter(mFd, mToSubmit, 1, flags, &arg, sizeof(arg));
+        if (ret >= 0) {
+            mToSubmit -= (static_cast<unsigned>(ret) < mToSubmit) ? ret : mToSubmit;
+            return ret;
+        }
+        if (errno == ETIME) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __KMRE_URING_H__
+#define __KMRE_URING_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+namespace KmreSocket {
+
+typedef enum {
+    eIoBackend_Epoll = 0,   // 非阻塞socket + epoll(默认)
+    eIoBackend_Uring,       // io_uring，不可用时自动回退到epoll
+}IoBackend;
+
+// 进程级的I/O后端选择，初始值取自环境变量KMRE_IO_BACKEND(epoll/uring)
+void set_io_backend(IoBackend backend);
+IoBackend get_io_backend();
+
+// 内核是否支持本库用到的io_uring特性(结果缓存)
+bool uring_available();
+
+// 直接通过系统调用使用io_uring的最小封装，不依赖liburing
+class IoUring
+{
+public:
+    IoUring() = default;
+    ~IoUring();
+
+    bool init(unsigned entries);
+    bool registerBuffers(const struct iovec *iov, unsigned count);
+    bool buffersRegistered() const { return mBuffersRegistered; }
+
+    // 队列已满时返回nullptr，调用方应先submitAndWait()
+    struct io_uring_sqe *getSqe();
+    // 提交所有未提交的sqe，并等待至少一个完成事件或超时(timeoutMs<0为不限时)
+    int submitAndWait(int64_t timeoutMs);
+    // 依次处理已完成的事件，返回处理的个数
+    template <typename F>
+    unsigned forEachCqe(F &&handler) {
+        unsigned head = *mCqHead;
+        unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            const struct io_uring_cqe &cqe = mCqes[head & *mCqMask];
+            handler(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    int mFd = -1;
+    void *mSqRing = nullptr;
+    void *mCqRing = nullptr;
+    size_t mSqRingSize = 0;
+    size_t mCqRingSize = 0;
+    struct io_uring_sqe *mSqes = nullptr;
+    size_t mSqesSize = 0;
+
+    unsigned *mSqHead = nullptr;
+    unsigned *mSqTail = nullptr;
+    unsigned *mSqMask = nullptr;
+    unsigned *mSqArray = nullptr;
+    unsigned mSqEntries = 0;
+    unsigned mSqLocalTail = 0;
+    unsigned mToSubmit = 0;
+
+    unsigned *mCqHead = nullptr;
+    unsigned *mCqTail = nullptr;
+    unsigned *mCqMask = nullptr;
+    struct io_uring_cqe *mCqes = nullptr;
+
+    bool mBuffersRegistered = false;
+};
+
+}
+
+#endif // __KMRE_URING_H__
@@ -0,0 +1,1637 @@
+/*
+ * Copyright (c) KylinSoft Co., Ltd. 2016-2024.All rights reserved.
+ *
+ * Authors:
+ *  Kobe Lee    lixiang@kylinos.cn
+ *  Alan Xie    xiehuijun@kylinos.cn
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// kmrectl: libkmre.so 的命令行工具
+//   kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] <command> [args...]
+//   kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --batch [-j N]   从标准输入逐行读取命令，结果以NDJSON输出
+//   kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --soak [-j N] ...  长时间压力测试，定期输出吞吐及资源占用
+//   kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --check-alloc [--sends N]  检查稳定状态下发送命令不分配内存
+
+#include <dirent.h>
+#include <errno.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "KmreCore.pb.h"
+#include "kmre_app_stats.h"
+#include "kmre_command.h"
+#include "kmre_shm_ring.h"
+
+extern "C" {
+bool install_app(char *filename, char *appname, char *pkgname);
+int kmre_install_apps(const char **apk_paths, const char **appnames, const char **pkgnames, int count,
+                      const char *stage_dir, int concurrency,
+                      void (*callback)(int, const char *, int, int, void *), void *user_data);
+int uninstall_app(char *pkgname);
+int uninstall_apps(char **pkgnames, int count, int *results);
+bool launch_app(char *pkgname, bool fullscreen, int width, int height, int density);
+bool close_app(char *appname, char *pkgname);
+bool kmre_launch_trace_apply_result(const char *data, int len);
+bool kmre_launch_trace_apply_event(const char *data, int len);
+bool kmre_display_registry_apply_event(const char *data, int len);
+char *kmre_display_package(int display_id);
+char *kmre_display_registry_dump();
+void kmre_display_registry_set_suppress(bool enable);
+void kmre_display_registry_clear();
+int kmre_event_dispatch(const char *data, int len);
+char *kmre_event_stats();
+char *kmre_launch_stats(const char *pkgname);
+void kmre_launch_stats_reset();
+char *get_installed_applist();
+char *kmre_installed_apps_since(unsigned long long generation);
+char *get_running_applist();
+void kmre_app_cache_enable(bool enable);
+void kmre_app_cache_set_max_age(int installed_ms, int running_ms);
+void kmre_app_cache_invalidate();
+char *kmre_app_cache_stats();
+typedef void (*InstalledAppCallback)(int index, const char *app_name, const char *package_name,
+                                     const char *version_name, void *user_data);
+typedef void (*RunningAppCallback)(int index, const char *app_name, const char *package_name, void *user_data);
+typedef void (*FileItemCallback)(int index, const char *path, const char *mime_type, void *user_data);
+int kmre_get_installed_applist_stream(InstalledAppCallback callback, void *user_data);
+int kmre_get_running_applist_stream(RunningAppCallback callback, void *user_data);
+int kmre_files_list_stream(const char *data, int len, FileItemCallback callback, void *user_data, int *type);
+int kmre_get_app_stats(const char *pkgname, KmreAppStats *stats, int max_count);
+bool kmre_set_app_stats_push(int interval_ms);
+char *kmre_app_stats_dump();
+void kmre_singleflight_enable(bool enable);
+char *kmre_singleflight_stats();
+bool send_clipboard(char *content);
+bool focus_win_id(int display_id);
+bool control_app(int display_id, char *pkgname, int event_type, int event_value);
+bool insert_file(char *path, char *mime_type);
+bool remove_file(char *path, char *mime_type);
+bool request_media_files(int type);
+bool kmre_media_index_apply_files_list(const char *data, int len);
+bool kmre_media_index_apply_event(const char *data, int len);
+const char *kmre_media_index_lookup(const char *path);
+int kmre_media_index_count(const char *mime_type);
+char *kmre_media_index_list(const char *mime_type);
+void kmre_media_index_clear();
+bool kmre_media_watcher_start(const char **dirs, int count);
+typedef void (*ReconcileCallback)(int stage, long long done, long long total, void *user_data);
+char *kmre_media_reconcile(const char **dirs, int count, int threads, int dump_timeout_ms,
+                           ReconcileCallback callback, void *user_data);
+void kmre_media_watcher_stop();
+void kmre_media_watcher_set_options(int debounce_ms, int max_pending, int max_inflight);
+bool request_drag_file(const char *path, const char *pkg, int display_id, bool has_double_display);
+bool rotation_changed(int display_id, char *pkgname, int width, int height, int rotation);
+bool set_system_prop(int event_type, char *prop_name, char *prop_value);
+char *get_system_prop(int event_type, char *prop_name);
+int update_app_window_size(const char *pkg_name, int display_id, int width, int height);
+int update_network_proxy(bool enable, const char *protocal, const char *host, int port);
+int update_display_size(int display_id, int width, int height);
+int answer_call(bool answer);
+int kmre_user_open(unsigned int uid, const char *user);
+bool kmre_user_select(int handle);
+bool kmre_set_io_backend(int backend);
+void kmre_control_ring_enable(bool enable);
+void kmre_scheduler_set_limits(int max_bulk_inflight, int max_bulk_queue);
+char *kmre_scheduler_stats();
+void kmre_log_set_level(int level);
+char *kmre_log_stats();
+void kmre_trace_enable(bool enable);
+char *kmre_trace_dump();
+bool kmre_trace_dump_to_file(const char *path);
+void kmre_trace_clear();
+int kmre_get_io_backend();
+bool is_deb_package_installed(const char *pkg);
+bool is_android_env_installed();
+bool kmre_wait_ready(int timeout_ms);
+typedef void (*ReadyCallback)(bool ready, int elapsed_ms, void *user_data);
+bool kmre_wait_ready_async(int timeout_ms, ReadyCallback callback, void *user_data);
+}
+
+typedef std::vector<std::string> Args;
+
+// 命令执行结果: ok为false时result为错误信息，否则为json值
+struct Result {
+    bool ok;
+    std::string result;
+};
+
+struct Command {
+    const char *name;
+    int minArgs;
+    const char *usage;
+    Result (*run)(Args &args);
+};
+
+static std::string json_string(const std::string &str)
+{
+    std::string out = "\"";
+    for (char c : str) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: {
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char esc[8];
+                snprintf(esc, sizeof(esc), "\\u%04x", c);
+                out += esc;
+            }
+            else {
+                out += c;
+            }
+        }break;
+        }
+    }
+    out += "\"";
+    return out;
+}
+
+static Result ok_bool(bool value) { return {true, value ? "true" : "false"}; }
+static Result ok_int(long long value) { return {true, std::to_string(value)}; }
+static Result ok_json(const char *json) { return {true, json ? json : "null"}; }
+static Result ok_str(const char *str) { return {true, str ? json_string(str) : "null"}; }
+
+static char *arg(Args &args, size_t n) { return &args[n][0]; }
+static int iarg(Args &args, size_t n) { return atoi(args[n].c_str()); }
+static bool barg(Args &args, size_t n)
+{
+    return args[n] == "1" || args[n] == "true" || args[n] == "yes";
+}
+
+static Result cmd_install_app(Args &a) { return ok_bool(install_app(arg(a, 0), arg(a, 1), arg(a, 2))); }
+
+// apk路径:应用名:包名 ...
+static Result cmd_install_apps(Args &a)
+{
+    std::vector<std::string> apks, names, pkgs;
+    for (size_t n = 2; n < a.size(); n++) {
+        size_t p1 = a[n].find(':');
+        size_t p2 = (p1 == std::string::npos) ? p1 : a[n].find(':', p1 + 1);
+        if (p2 == std::string::npos) {
+            return {false, "item must be apk:appname:pkgname"};
+        }
+        apks.push_back(a[n].substr(0, p1));
+        names.push_back(a[n].substr(p1 + 1, p2 - p1 - 1));
+        pkgs.push_back(a[n].substr(p2 + 1));
+    }
+
+    std::vector<const char *> apkPtrs, namePtrs, pkgPtrs;
+    for (size_t n = 0; n < apks.size(); n++) {
+        apkPtrs.push_back(apks[n].c_str());
+        namePtrs.push_back(names[n].c_str());
+        pkgPtrs.push_back(pkgs[n].c_str());
+    }
+    const char *stageDir = (a[0] == "-") ? nullptr : a[0].c_str();
+    return ok_int(kmre_install_apps(apkPtrs.data(), namePtrs.data(), pkgPtrs.data(), static_cast<int>(apks.size()),
+                                    stageDir, iarg(a, 1), nullptr, nullptr));
+}
+
+static Result cmd_uninstall_app(Args &a) { return ok_int(uninstall_app(arg(a, 0))); }
+
+static Result cmd_uninstall_apps(Args &a)
+{
+    std::vector<char *> pkgs;
+    for (size_t n = 0; n < a.size(); n++) {
+        pkgs.push_back(arg(a, n));
+    }
+    std::vector<int> results(pkgs.size());
+    uninstall_apps(pkgs.data(), static_cast<int>(pkgs.size()), results.data());
+
+    std::string json = "{";
+    for (size_t n = 0; n < pkgs.size(); n++) {
+        json += (n > 0) ? "," : "";
+        json += json_string(a[n]) + ":" + std::to_string(results[n]);
+    }
+    json += "}";
+    return {true, json};
+}
+
+static Result cmd_launch_app(Args &a)
+{
+    bool fullscreen = (a.size() > 1) ? barg(a, 1) : false;
+    int width = (a.size() > 2) ? iarg(a, 2) : 0;
+    int height = (a.size() > 3) ? iarg(a, 3) : 0;
+    int density = (a.size() > 4) ? iarg(a, 4) : 0;
+    return ok_bool(launch_app(arg(a, 0), fullscreen, width, height, density));
+}
+
+static Result cmd_close_app(Args &a) { return ok_bool(close_app(arg(a, 0), arg(a, 1))); }
+static Result cmd_get_installed_applist(Args &) { return ok_json(get_installed_applist()); }
+static Result cmd_installed_apps_since(Args &a)
+{
+    return ok_json(kmre_installed_apps_since(strtoull(a[0].c_str(), nullptr, 10)));
+}
+static Result cmd_get_running_applist(Args &) { return ok_json(get_running_applist()); }
+// 流式接口的结果同样拼成json数组输出
+static Result cmd_installed_applist_stream(Args &)
+{
+    std::string json = "[";
+    auto callback = [](int index, const char *app_name, const char *package_name, const char *version_name, void *user_data) {
+        std::string &out = *static_cast<std::string *>(user_data);
+        out += std::string(index > 0 ? "," : "") + "{\"app_name\":" + json_string(app_name) +
+               ",\"package_name\":" + json_string(package_name) + ",\"version_name\":" + json_string(version_name) + "}";
+    };
+    if (kmre_get_installed_applist_stream(callback, &json) < 0) {
+        return {false, "read installed app list failed"};
+    }
+    return {true, json + "]"};
+}
+
+static Result cmd_running_applist_stream(Args &)
+{
+    std::string json = "[";
+    auto callback = [](int index, const char *app_name, const char *package_name, void *user_data) {
+        std::string &out = *static_cast<std::string *>(user_data);
+        out += std::string(index > 0 ? "," : "") + "{\"app_name\":" + json_string(app_name) +
+               ",\"package_name\":" + json_string(package_name) + "}";
+    };
+    if (kmre_get_running_applist_stream(callback, &json) < 0) {
+        return {false, "read running app list failed"};
+    }
+    return {true, json + "]"};
+}
+
+static Result cmd_app_cache_enable(Args &a) { kmre_app_cache_enable(barg(a, 0)); return ok_bool(true); }
+static Result cmd_app_cache_set_max_age(Args &a)
+{
+    kmre_app_cache_set_max_age(iarg(a, 0), iarg(a, 1));
+    return ok_bool(true);
+}
+static Result cmd_app_cache_invalidate(Args &) { kmre_app_cache_invalidate(); return ok_bool(true); }
+static Result cmd_app_cache_stats(Args &) { return ok_json(kmre_app_cache_stats()); }
+static Result cmd_send_clipboard(Args &a) { return ok_bool(send_clipboard(arg(a, 0))); }
+static Result cmd_focus_win_id(Args &a) { return ok_bool(focus_win_id(iarg(a, 0))); }
+static Result cmd_control_app(Args &a)
+{
+    int value = (a.size() > 3) ? iarg(a, 3) : 0;
+    return ok_bool(control_app(iarg(a, 0), arg(a, 1), iarg(a, 2), value));
+}
+static Result cmd_insert_file(Args &a) { return ok_bool(insert_file(arg(a, 0), arg(a, 1))); }
+static Result cmd_remove_file(Args &a) { return ok_bool(remove_file(arg(a, 0), arg(a, 1))); }
+static Result cmd_request_media_files(Args &a) { return ok_bool(request_media_files(iarg(a, 0))); }
+
+static Result read_file(const std::string &path, std::string &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return {false, "can't open " + path};
+    }
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return {true, ""};
+}
+
+static Result cmd_media_index_apply_files_list(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    return r.ok ? ok_bool(kmre_media_index_apply_files_list(data.data(), static_cast<int>(data.size()))) : r;
+}
+
+static Result cmd_media_index_apply_event(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    return r.ok ? ok_bool(kmre_media_index_apply_event(data.data(), static_cast<int>(data.size()))) : r;
+}
+
+static Result cmd_launch_trace_apply_event(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    return r.ok ? ok_bool(kmre_launch_trace_apply_event(data.data(), static_cast<int>(data.size()))) : r;
+}
+
+static Result cmd_display_registry_apply_event(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    return r.ok ? ok_bool(kmre_display_registry_apply_event(data.data(), static_cast<int>(data.size()))) : r;
+}
+
+static Result cmd_event_dispatch(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    if (!r.ok) {
+        return r;
+    }
+    int delivered = kmre_event_dispatch(data.data(), static_cast<int>(data.size()));
+    return delivered < 0 ? Result{false, "malformed EventSequence"} : ok_int(delivered);
+}
+
+static Result cmd_files_list_stream(Args &a)
+{
+    std::string data;
+    Result r = read_file(a[0], data);
+    if (!r.ok) {
+        return r;
+    }
+
+    std::string json = "[";
+    auto callback = [](int index, const char *path, const char *mime_type, void *user_data) {
+        std::string &out = *static_cast<std::string *>(user_data);
+        out += std::string(index > 0 ? "," : "") + "{\"path\":" + json_string(path) +
+               ",\"mime_type\":" + json_string(mime_type) + "}";
+    };
+    int type = 0;
+    if (kmre_files_list_stream(data.data(), static_cast<int>(data.size()), callback, &json, &type) < 0) {
+        return {false, "no valid FilesList"};
+    }
+    return {true, "{\"type\":" + std::to_string(type) + ",\"items\":" + json + "]}"};
+}
+
+static Result cmd_event_stats(Args &) { return ok_json(kmre_event_stats()); }
+static Result cmd_display_package(Args &a) { return ok_str(kmre_display_package(iarg(a, 0))); }
+static Result cmd_display_registry_dump(Args &) { return ok_json(kmre_display_registry_dump()); }
+static Result cmd_display_registry_set_suppress(Args &a)
+{
+    kmre_display_registry_set_suppress(barg(a, 0));
+    return ok_bool(true);
+}
+static Result cmd_display_registry_clear(Args &) { kmre_display_registry_clear(); return ok_bool(true); }
+
+static Result cmd_launch_stats(Args &a) { return ok_json(kmre_launch_stats(a.empty() ? nullptr : a[0].c_str())); }
+static Result cmd_launch_stats_reset(Args &) { kmre_launch_stats_reset(); return ok_bool(true); }
+
+static Result cmd_media_index_lookup(Args &a) { return ok_str(kmre_media_index_lookup(a[0].c_str())); }
+static Result cmd_media_index_count(Args &a)
+{
+    return ok_int(kmre_media_index_count(a.empty() ? nullptr : a[0].c_str()));
+}
+static Result cmd_media_index_list(Args &a)
+{
+    return ok_json(kmre_media_index_list(a.empty() ? nullptr : a[0].c_str()));
+}
+static Result cmd_media_index_clear(Args &) { kmre_media_index_clear(); return ok_bool(true); }
+
+// 进度输出到标准错误，结果输出到标准输出
+static Result cmd_media_reconcile(Args &a)
+{
+    std::vector<const char *> dirs;
+    for (size_t n = 2; n < a.size(); n++) {
+        dirs.push_back(a[n].c_str());
+    }
+    auto progress = [](int stage, long long done, long long total, void *) {
+        static const char *kStages[] = {"scanning", "fetching", "removing", "inserting", "finished"};
+        fprintf(stderr, "kmrectl: %s %lld/%lld\n", (stage >= 0 && stage <= 4) ? kStages[stage] : "?", done, total);
+    };
+    char *result = kmre_media_reconcile(dirs.data(), static_cast<int>(dirs.size()), iarg(a, 0), iarg(a, 1),
+                                        progress, nullptr);
+    return result ? ok_json(result) : Result{false, "no media dump from android"};
+}
+
+static volatile sig_atomic_t gStop = 0;
+static void on_signal(int) { gStop = 1; }
+
+// 前台运行直到收到SIGINT/SIGTERM
+static Result cmd_media_watch(Args &a)
+{
+    std::vector<const char *> dirs;
+    for (const auto &dir : a) {
+        dirs.push_back(dir.c_str());
+    }
+    if (!kmre_media_watcher_start(dirs.data(), static_cast<int>(dirs.size()))) {
+        return {false, "start media watcher failed"};
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    while (!gStop) {
+        pause();
+    }
+    kmre_media_watcher_stop();
+    return ok_bool(true);
+}
+
+static Result cmd_media_watcher_set_options(Args &a)
+{
+    kmre_media_watcher_set_options(iarg(a, 0), iarg(a, 1), iarg(a, 2));
+    return ok_bool(true);
+}
+
+static Result cmd_request_drag_file(Args &a)
+{
+    int displayId = (a.size() > 2) ? iarg(a, 2) : 0;
+    bool doubleDisplay = (a.size() > 3) ? barg(a, 3) : false;
+    return ok_bool(request_drag_file(a[0].c_str(), a[1].c_str(), displayId, doubleDisplay));
+}
+
+static Result cmd_rotation_changed(Args &a)
+{
+    return ok_bool(rotation_changed(iarg(a, 0), arg(a, 1), iarg(a, 2), iarg(a, 3), iarg(a, 4)));
+}
+static Result cmd_set_system_prop(Args &a) { return ok_bool(set_system_prop(iarg(a, 0), arg(a, 1), arg(a, 2))); }
+static Result cmd_get_system_prop(Args &a)
+{
+    const char *value = get_system_prop(iarg(a, 0), arg(a, 1));
+    return value ? ok_str(value) : Result{false, "get system prop failed"};
+}
+static Result cmd_get_app_stats(Args &a)
+{
+    const char *pkgname = a.empty() ? nullptr : a[0].c_str();
+    int count = kmre_get_app_stats(pkgname, nullptr, 0);
+    std::vector<KmreAppStats> stats(count > 0 ? count : 0);
+    if (count > 0) {
+        // 两次调用之间应用数可能变化
+        count = std::min(kmre_get_app_stats(pkgname, stats.data(), count), count);
+    }
+    if (count < 0) {
+        return {false, "get app stats failed"};
+    }
+
+    std::string json = "[";
+    for (int n = 0; n < count; n++) {
+        const KmreAppStats &s = stats[n];
+        json += (n > 0 ? ",{\"package_name\":" : "{\"package_name\":") + json_string(s.package_name);
+        json += ",\"pid\":" + std::to_string(s.pid);
+        json += ",\"cpu_permille\":" + std::to_string(s.cpu_permille);
+        json += ",\"rss_kb\":" + std::to_string(s.rss_kb);
+        json += ",\"pss_kb\":" + std::to_string(s.pss_kb);
+        json += std::string(",\"foreground\":") + (s.foreground ? "true" : "false");
+        json += ",\"display_id\":" + std::to_string(s.display_id);
+        json += ",\"age_ms\":" + std::to_string(s.age_ms) + "}";
+    }
+    return {true, json + "]"};
+}
+static Result cmd_set_app_stats_push(Args &a) { return ok_bool(kmre_set_app_stats_push(iarg(a, 0))); }
+static Result cmd_app_stats_dump(Args &) { return ok_json(kmre_app_stats_dump()); }
+static Result cmd_singleflight_enable(Args &a) { kmre_singleflight_enable(barg(a, 0)); return ok_bool(true); }
+static Result cmd_singleflight_stats(Args &) { return ok_json(kmre_singleflight_stats()); }
+static Result cmd_update_app_window_size(Args &a)
+{
+    return ok_int(update_app_window_size(a[0].c_str(), iarg(a, 1), iarg(a, 2), iarg(a, 3)));
+}
+static Result cmd_update_network_proxy(Args &a)
+{
+    return ok_int(update_network_proxy(barg(a, 0), a[1].c_str(), a[2].c_str(), iarg(a, 3)));
+}
+static Result cmd_update_display_size(Args &a) { return ok_int(update_display_size(iarg(a, 0), iarg(a, 1), iarg(a, 2))); }
+static Result cmd_answer_call(Args &a) { return ok_int(answer_call(barg(a, 0))); }
+static Result cmd_scheduler_set_limits(Args &a)
+{
+    kmre_scheduler_set_limits(iarg(a, 0), iarg(a, 1));
+    return ok_bool(true);
+}
+static Result cmd_scheduler_stats(Args &) { return ok_json(kmre_scheduler_stats()); }
+static Result cmd_log_set_level(Args &a)
+{
+    kmre_log_set_level(iarg(a, 0));
+    return ok_bool(true);
+}
+static Result cmd_log_stats(Args &) { return ok_json(kmre_log_stats()); }
+static Result cmd_trace_enable(Args &a) { kmre_trace_enable(barg(a, 0)); return ok_bool(true); }
+static Result cmd_trace_dump(Args &a)
+{
+    return a.empty() ? ok_json(kmre_trace_dump()) : ok_bool(kmre_trace_dump_to_file(a[0].c_str()));
+}
+static Result cmd_trace_clear(Args &) { kmre_trace_clear(); return ok_bool(true); }
+static Result cmd_is_deb_package_installed(Args &a) { return ok_bool(is_deb_package_installed(a[0].c_str())); }
+static Result cmd_is_android_env_installed(Args &) { return ok_bool(is_android_env_installed()); }
+static Result cmd_wait_ready(Args &a) { return ok_bool(kmre_wait_ready(iarg(a, 0))); }
+
+static Result cmd_wait_ready_async(Args &a)
+{
+    std::promise<std::pair<bool, int>> done;
+    auto callback = [](bool ready, int elapsed_ms, void *user_data) {
+        static_cast<std::promise<std::pair<bool, int>> *>(user_data)->set_value({ready, elapsed_ms});
+    };
+    if (!kmre_wait_ready_async(iarg(a, 0), callback, &done)) {
+        return {false, "can't start waiting"};
+    }
+    std::pair<bool, int> result = done.get_future().get();
+    return {true, std::string("{\"ready\":") + (result.first ? "true" : "false") +
+                  ",\"elapsed_ms\":" + std::to_string(result.second) + "}"};
+}
+
+static const Command kCommands[] = {
+    {"install_app", 3, "<filename> <appname> <pkgname>", cmd_install_app},
+    {"kmre_install_apps", 3, "<stage_dir|-> <concurrency> <apk:appname:pkgname>...", cmd_install_apps},
+    {"uninstall_app", 1, "<pkgname>", cmd_uninstall_app},
+    {"uninstall_apps", 1, "<pkgname>...", cmd_uninstall_apps},
+    {"launch_app", 1, "<pkgname> [fullscreen] [width] [height] [density]", cmd_launch_app},
+    {"close_app", 2, "<appname> <pkgname>", cmd_close_app},
+    {"kmre_launch_trace_apply_event", 1, "<file>", cmd_launch_trace_apply_event},
+    {"kmre_display_registry_apply_event", 1, "<file>", cmd_display_registry_apply_event},
+    {"kmre_event_dispatch", 1, "<file>", cmd_event_dispatch},
+    {"kmre_event_stats", 0, "", cmd_event_stats},
+    {"kmre_files_list_stream", 1, "<file>", cmd_files_list_stream},
+    {"kmre_get_app_stats", 0, "[pkgname]", cmd_get_app_stats},
+    {"kmre_set_app_stats_push", 1, "<interval_ms>", cmd_set_app_stats_push},
+    {"kmre_app_stats_dump", 0, "", cmd_app_stats_dump},
+    {"kmre_singleflight_enable", 1, "<enable>", cmd_singleflight_enable},
+    {"kmre_singleflight_stats", 0, "", cmd_singleflight_stats},
+    {"kmre_display_package", 1, "<display_id>", cmd_display_package},
+    {"kmre_display_registry_dump", 0, "", cmd_display_registry_dump},
+    {"kmre_display_registry_set_suppress", 1, "<enable>", cmd_display_registry_set_suppress},
+    {"kmre_display_registry_clear", 0, "", cmd_display_registry_clear},
+    {"kmre_launch_stats", 0, "[pkgname]", cmd_launch_stats},
+    {"kmre_launch_stats_reset", 0, "", cmd_launch_stats_reset},
+    {"get_installed_applist", 0, "", cmd_get_installed_applist},
+    {"kmre_installed_apps_since", 1, "<generation>", cmd_installed_apps_since},
+    {"get_running_applist", 0, "", cmd_get_running_applist},
+    {"kmre_get_installed_applist_stream", 0, "", cmd_installed_applist_stream},
+    {"kmre_get_running_applist_stream", 0, "", cmd_running_applist_stream},
+    {"kmre_app_cache_enable", 1, "<enable>", cmd_app_cache_enable},
+    {"kmre_app_cache_set_max_age", 2, "<installed_ms> <running_ms>", cmd_app_cache_set_max_age},
+    {"kmre_app_cache_invalidate", 0, "", cmd_app_cache_invalidate},
+    {"kmre_app_cache_stats", 0, "", cmd_app_cache_stats},
+    {"send_clipboard", 1, "<content>", cmd_send_clipboard},
+    {"focus_win_id", 1, "<display_id>", cmd_focus_win_id},
+    {"control_app", 3, "<display_id> <pkgname> <event_type> [event_value]", cmd_control_app},
+    {"insert_file", 2, "<path> <mime_type>", cmd_insert_file},
+    {"remove_file", 2, "<path> <mime_type>", cmd_remove_file},
+    {"request_media_files", 1, "<type>", cmd_request_media_files},
+    {"kmre_media_index_apply_files_list", 1, "<file>", cmd_media_index_apply_files_list},
+    {"kmre_media_index_apply_event", 1, "<file>", cmd_media_index_apply_event},
+    {"kmre_media_index_lookup", 1, "<path>", cmd_media_index_lookup},
+    {"kmre_media_index_count", 0, "[mime_type]", cmd_media_index_count},
+    {"kmre_media_index_list", 0, "[mime_type]", cmd_media_index_list},
+    {"kmre_media_index_clear", 0, "", cmd_media_index_clear},
+    {"kmre_media_reconcile", 3, "<threads> <dump_timeout_ms|-1> <dir>...", cmd_media_reconcile},
+    {"kmre_media_watcher_start", 1, "<dir>...  (runs until SIGINT/SIGTERM)", cmd_media_watch},
+    {"kmre_media_watcher_set_options", 3, "<debounce_ms> <max_pending> <max_inflight>", cmd_media_watcher_set_options},
+    {"request_drag_file", 2, "<path> <pkgname> [display_id] [has_double_display]", cmd_request_drag_file},
+    {"rotation_changed", 5, "<display_id> <pkgname> <width> <height> <rotation>", cmd_rotation_changed},
+    {"set_system_prop", 3, "<event_type> <name> <value>", cmd_set_system_prop},
+    {"get_system_prop", 2, "<event_type> <name>", cmd_get_system_prop},
+    {"update_app_window_size", 4, "<pkgname> <display_id> <width> <height>", cmd_update_app_window_size},
+    {"update_network_proxy", 4, "<enable> <protocol> <host> <port>", cmd_update_network_proxy},
+    {"update_display_size", 3, "<display_id> <width> <height>", cmd_update_display_size},
+    {"answer_call", 1, "<answer>", cmd_answer_call},
+    {"kmre_scheduler_set_limits", 2, "<max_bulk_inflight> <max_bulk_queue>", cmd_scheduler_set_limits},
+    {"kmre_scheduler_stats", 0, "", cmd_scheduler_stats},
+    {"kmre_log_set_level", 1, "<level>", cmd_log_set_level},
+    {"kmre_log_stats", 0, "", cmd_log_stats},
+    {"kmre_trace_enable", 1, "<enable>", cmd_trace_enable},
+    {"kmre_trace_dump", 0, "[file]", cmd_trace_dump},
+    {"kmre_trace_clear", 0, "", cmd_trace_clear},
+    {"is_deb_package_installed", 1, "<package>", cmd_is_deb_package_installed},
+    {"is_android_env_installed", 0, "", cmd_is_android_env_installed},
+    {"kmre_wait_ready", 1, "<timeout_ms>", cmd_wait_ready},
+    {"kmre_wait_ready_async", 1, "<timeout_ms>", cmd_wait_ready_async},
+};
+
+static void usage()
+{
+    fprintf(stderr, "Usage: kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] <command> [args...]\n"
+                    "       kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --batch [-j jobs]\n"
+                    "       kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --soak [-j threads] [--duration sec]\n"
+                    "               [--interval sec] [--mix file] [--fake-server [--fail percent]]\n"
+                    "               [--max-fd-growth n] [--max-rss-growth kb] [--max-alloc-growth n] [--min-throughput percent]\n"
+                    "       kmrectl [-u uid[:user]] [--io epoll|uring] [--ring] --check-alloc [--sends n]\n"
+                    "\nCommands:\n");
+    for (const auto &cmd : kCommands) {
+        fprintf(stderr, "  %s %s\n", cmd.name, cmd.usage);
+    }
+}
+
+static Result execute(Args &words)
+{
+    if (words.empty()) {
+        return {false, "empty command"};
+    }
+
+    for (const auto &cmd : kCommands) {
+        if (words[0] != cmd.name) {
+            continue;
+        }
+        Args args(words.begin() + 1, words.end());
+        if (static_cast<int>(args.size()) < cmd.minArgs) {
+            return {false, std::string("usage: ") + cmd.name + " " + cmd.usage};
+        }
+        return cmd.run(args);
+    }
+    return {false, "unknown command: " + words[0]};
+}
+
+// 按空白分割，支持双引号及反斜杠转义
+static bool split_line(const std::string &line, Args &words)
+{
+    std::string word;
+    bool inWord = false, quoted = false;
+
+    for (size_t n = 0; n < line.size(); n++) {
+        char c = line[n];
+        if (c == '\\' && n + 1 < line.size()) {
+            word += line[++n];
+            inWord = true;
+        }
+        else if (c == '"') {
+            quoted = !quoted;
+            inWord = true;
+        }
+        else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if (inWord) {
+                words.push_back(word);
+                word.clear();
+                inWord = false;
+            }
+        }
+        else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord) {
+        words.push_back(word);
+    }
+    return !quoted;
+}
+
+// 工作线程从标准输入取命令执行，每条结果输出一行json，按完成顺序输出，以line字段对应输入行
+static int run_batch(int jobs, int handle)
+{
+    std::mutex inputMutex, outputMutex;
+    std::atomic<int> failed{0};
+    long lineNo = 0;
+
+    auto worker = [&]() {
+        if (handle > 0) {
+            kmre_user_select(handle);
+        }
+
+        std::string line;
+        for (;;) {
+            long current;
+            {
+                std::lock_guard<std::mutex> lock(inputMutex);
+                if (!std::getline(std::cin, line)) {
+                    break;
+                }
+                current = ++lineNo;
+            }
+
+            Args words;
+            if (!split_line(line, words)) {
+                words.clear();
+            }
+            if (words.empty() || words[0][0] == '#') {
+                continue;
+            }
+
+            Result r = execute(words);
+            if (!r.ok) {
+                ++failed;
+            }
+
+            std::string out = "{\"line\":" + std::to_string(current) + ",\"cmd\":" + json_string(words[0]);
+            out += r.ok ? ",\"ok\":true,\"result\":" + r.result : ",\"ok\":false,\"error\":" + json_string(r.result);
+            out += "}\n";
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int n = 1; n < jobs; n++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    return failed ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// 长时间压力测试: 多线程反复执行命令组合，定期采样吞吐、RSS、打开的fd数及存活的堆分配数，
+// 资源持续增长或吞吐量崩溃时以非0退出。可选在本进程内启动模拟的launcher/manager服务端并注入故障
+
+// 统计本进程(包括libkmre.so)通过operator new分配的次数，存活数持续增长说明有泄漏
+static std::atomic<long long> gAllocCount{0};
+static std::atomic<long long> gFreeCount{0};
+static thread_local long long tlsAllocCount = 0;// 本线程的分配次数，不受模拟服务端线程影响
+
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size ? size : 1);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    gAllocCount.fetch_add(1, std::memory_order_relaxed);
+    ++tlsAllocCount;
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    if (ptr) {
+        gFreeCount.fetch_add(1, std::memory_order_relaxed);
+        free(ptr);
+    }
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+struct SoakOptions {
+    int threads = 4;
+    int durationSec = 60;
+    int intervalSec = 5;
+    std::string mixFile;
+    bool fakeServer = false;
+    int failPercent = 0;            // 模拟服务端每个连接注入故障的概率
+    int maxFdGrowth = 8;
+    long maxRssGrowthKb = 16 * 1024;
+    long long maxAllocGrowth = 20000;
+    int minThroughputPercent = 30;  // 相对第一个采样周期的吞吐下限
+};
+
+// 默认命令组合，%n 替换为递增的序号，避免窗口更新被当作重复更新跳过
+static const char *kSoakMix[] = {
+    "get_installed_applist",
+    "get_running_applist",
+    "launch_app com.kmre.soak 0 720 1280 240",
+    "close_app soak com.kmre.soak",
+    "focus_win_id %n",
+    "control_app 1 com.kmre.soak 2",
+    "rotation_changed 1 com.kmre.soak %n 720 0",
+    "update_app_window_size com.kmre.soak 1 %n 1280",
+    "update_display_size 1 %n 1920",
+    "get_system_prop 0 soak.prop%n",
+    "set_system_prop 0 soak.prop value%n",
+    "send_clipboard soak%n",
+    "insert_file /tmp/soak%n.png image/png",
+    "remove_file /tmp/soak%n.png image/png",
+    "request_media_files 0",
+    "uninstall_app com.kmre.soak%n",
+    "kmre_installed_apps_since 0",
+    "kmre_get_app_stats",
+    "kmre_get_app_stats com.kmre.soak",
+    "kmre_set_app_stats_push 200",
+};
+
+struct SoakSample {
+    long long ops = 0;
+    long long failures = 0;
+    long rssKb = 0;
+    int fds = 0;
+    long long liveAllocs = 0;
+};
+
+static long read_rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int count_open_fds()
+{
+    int count = 0;
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) {
+        return -1;
+    }
+    while (struct dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            ++count;
+        }
+    }
+    closedir(dir);
+    return count - 1;// opendir自身的fd
+}
+
+// API返回false、空指针或负数时视为失败(故障注入时是预期的)
+static bool soak_result_ok(const Result &r)
+{
+    return r.ok && r.result != "false" && r.result != "null" && (r.result.empty() || r.result[0] != '-');
+}
+
+// 模拟的launcher/manager服务端: 每个连接读一条命令，按命令编号回复后关闭连接
+class SoakServer
+{
+public:
+    enum {
+        eFault_None = 0,
+        eFault_Disconnect,  // 不回复直接断开
+        eFault_ShortReply,  // 只回复一半
+        eFault_Garbage,     // 回复无法解析的数据
+        eFault_Stall,       // 超过客户端收发超时后才回复，只用于登记了超时的命令
+        eFault_Count,
+    };
+
+    // dir须已存在
+    bool start(const std::string &dir, int failPercent) {
+        mFailPercent = failPercent;
+        for (const char *name : {"kmre_launcher", "kmre_manager"}) {
+            int fd = listenOn(dir + name);
+            if (fd < 0) {
+                stop();
+                return false;
+            }
+            mListenFds.push_back(fd);
+            mPaths.push_back(dir + name);
+        }
+        for (int fd : mListenFds) {
+            mThreads.emplace_back(&SoakServer::acceptLoop, this, fd);
+        }
+        return true;
+    }
+
+    void stop() {
+        mStop = true;
+        {
+            std::lock_guard<std::mutex> lock(mPushMutex);
+            mPushStop = true;
+        }
+        mPushCond.notify_all();
+        if (mPushThread.joinable()) {
+            mPushThread.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(mRingMutex);
+            for (auto &thread : mRingThreads) {
+                thread.join();
+            }
+            mRingThreads.clear();
+        }
+        for (int fd : mListenFds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (auto &thread : mThreads) {
+            thread.join();
+        }
+        mThreads.clear();
+        for (int fd : mListenFds) {
+            close(fd);
+        }
+        mListenFds.clear();
+        for (const auto &path : mPaths) {
+            unlink(path.c_str());
+        }
+        mPaths.clear();
+        while (mActive > 0) {
+            usleep(10 * 1000);
+        }
+    }
+
+    std::string faultsJson() const {
+        static const char *kNames[eFault_Count] = {"none", "disconnect", "short_reply", "garbage", "stall"};
+        std::string json = "{";
+        for (int n = 0; n < eFault_Count; n++) {
+            json += (n > 0) ? "," : "";
+            json += std::string("\"") + kNames[n] + "\":" + std::to_string(mFaults[n].load());
+        }
+        return json + "}";
+    }
+
+    long long statsPushed() const { return mPushed.load(); }
+    long long ringRecords() const { return mRingRecords.load(); }
+
+private:
+    int listenOn(const std::string &path) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+
+        // 已有服务端在监听时不能抢占它的socket
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe >= 0 && connect(probe, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0) {
+            close(probe);
+            fprintf(stderr, "kmrectl: %s is in use by a running server\n", path.c_str());
+            return -1;
+        }
+        if (probe >= 0) {
+            close(probe);
+        }
+
+        unlink(path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || listen(fd, 256) != 0) {
+            fprintf(stderr, "kmrectl: can't listen on %s: %s\n", path.c_str(), strerror(errno));
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        return fd;
+    }
+
+    void acceptLoop(int listenFd) {
+        while (!mStop) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                break;
+            }
+            ++mActive;
+            std::thread(&SoakServer::handle, this, fd).detach();
+        }
+    }
+
+    // 命令登记的收发超时(秒)，0为客户端不设超时
+    static int timeoutOf(int index) {
+#define KMRE_COMMAND_TIMEOUT(Message, Index, Link, Reply, Priority, TimeoutSec, ControlRing) \
+        case Index: return TimeoutSec;
+
+        switch (index) {
+        KMRE_COMMAND_LIST(KMRE_COMMAND_TIMEOUT)
+        default:
+            return 0;
+        }
+#undef KMRE_COMMAND_TIMEOUT
+    }
+
+    // 客户端没有超时的命令等待回复时会一直阻塞，不注入eFault_Stall(排在最后)
+    int pickFault(int index) {
+        static thread_local std::mt19937 rng(std::random_device{}());
+        if (mFailPercent <= 0 || static_cast<int>(rng() % 100) >= mFailPercent) {
+            return eFault_None;
+        }
+        const int count = (timeoutOf(index) > 0) ? eFault_Count - 1 : eFault_Stall - 1;
+        return 1 + static_cast<int>(rng() % count);
+    }
+
+    // 模拟安卓的资源采样，package为空时返回全部"运行中"的应用
+    static cn::kylinos::kmre::kmrecore::AppStatsList statsFor(const std::string &package) {
+        namespace kmrecore = cn::kylinos::kmre::kmrecore;
+        static std::atomic<int> sample{0};
+        const int serial = ++sample;
+        kmrecore::AppStatsList list;
+        list.set_timestamp_ms(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        list.set_mem_total_kb(8 * 1024 * 1024);
+        list.set_mem_available_kb(4 * 1024 * 1024);
+        for (int n = 0; n < 4; n++) {
+            const std::string name = (n == 0) ? "com.kmre.soak" : "com.kmre.soak" + std::to_string(n);
+            if (!package.empty() && package != name) {
+                continue;
+            }
+            kmrecore::AppStats *item = list.add_item();
+            item->set_package_name(name);
+            item->set_pid(1000 + n);
+            item->set_cpu_permille((serial * 37 + n * 101) % 1000);
+            item->set_rss_kb(100 * 1024 + n * 4096 + serial % 1024);
+            item->set_pss_kb(80 * 1024 + n * 4096 + serial % 1024);
+            item->set_foreground(n == 0);
+            item->set_display_id(n);
+        }
+        return list;
+    }
+
+    // head 0023: 按interval_ms在本进程内把EventSequence{app_stats}交给kmre_event_dispatch，
+    // 相当于安卓经事件通道推送; 为0时停止
+    void setStatsPush(int intervalMs) {
+        std::lock_guard<std::mutex> lock(mPushMutex);
+        intervalMs = std::max(intervalMs, 0);
+        if (intervalMs == mPushIntervalMs) {
+            return;// 重复设置不打断当前周期
+        }
+        mPushIntervalMs = intervalMs;
+        if (mPushIntervalMs > 0 && !mPushThread.joinable() && !mPushStop) {
+            mPushThread = std::thread(&SoakServer::pushLoop, this);
+        }
+        mPushCond.notify_all();
+    }
+
+    void pushLoop() {
+        std::unique_lock<std::mutex> lock(mPushMutex);
+        while (!mPushStop) {
+            if (mPushIntervalMs <= 0) {
+                mPushCond.wait(lock);
+                continue;
+            }
+            if (mPushCond.wait_for(lock, std::chrono::milliseconds(mPushIntervalMs)) == std::cv_status::no_timeout) {
+                continue;// 间隔改变或停止
+            }
+
+            lock.unlock();
+            cn::kylinos::kmre::kmrecore::EventSequence event;
+            *event.mutable_app_stats() = statsFor("");
+            std::string data;
+            event.SerializeToString(&data);
+            kmre_event_dispatch(data.data(), static_cast<int>(data.size()));
+            ++mPushed;
+            lock.lock();
+        }
+    }
+
+    std::string replyFor(int index, const char *body, int bodySize) {
+        namespace kmrecore = cn::kylinos::kmre::kmrecore;
+        std::string out;
+        switch (index) {
+        case 1: case 2: case 3: case 4: {
+            kmrecore::ActionResult reply;
+            reply.set_result(true);
+            reply.set_org_cmd(index == 2 ? "DELETE_SUCCEEDED" : "soak");
+            reply.SerializeToString(&out);
+        }break;
+        case 5: {
+            kmrecore::InstalledAppList list;
+            for (int n = 0; n < 32; n++) {
+                kmrecore::InstalledAppItem *item = list.add_item();
+                item->set_app_name("soak" + std::to_string(n));
+                item->set_package_name("com.kmre.soak" + std::to_string(n));
+                item->set_version_code(n);
+                item->set_version_name(std::to_string(n));
+            }
+            list.set_size(list.item_size());
+            list.SerializeToString(&out);
+        }break;
+        case 6: {
+            kmrecore::RunningAppList list;
+            kmrecore::RunningAppItem *item = list.add_item();
+            item->set_app_name("soak");
+            item->set_package_name("com.kmre.soak");
+            list.set_size(1);
+            list.SerializeToString(&out);
+        }break;
+        case 16: {
+            kmrecore::GetSystemProp request;
+            request.ParseFromArray(body, bodySize);
+            kmrecore::SendSystemProp reply;
+            reply.set_event_type(request.event_type());
+            reply.set_value_field(request.value_field());
+            reply.set_value("soak");
+            reply.SerializeToString(&out);
+        }break;
+        case 22: {
+            kmrecore::GetAppStats request;
+            request.ParseFromArray(body, bodySize);
+            statsFor(request.package_name()).SerializeToString(&out);
+        }break;
+        case 23: {
+            kmrecore::SetAppStatsPush request;
+            if (request.ParseFromArray(body, bodySize)) {
+                setStatsPush(request.interval_ms());
+            }
+        }break;
+        default:
+            break;
+        }
+        return out;
+    }
+
+    // head 0021: 接管客户端发来的memfd和eventfd，由单独的线程作为消费者取出控制通道中的命令
+    bool openRing(int memFd, int eventFd) {
+        std::unique_ptr<KmreSocket::ShmRing> ring(new KmreSocket::ShmRing());
+        if (!ring->attach(memFd, eventFd)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mRingMutex);
+        if (mStop) {
+            return false;
+        }
+        mRingThreads.emplace_back(&SoakServer::consumeRing, this, ring.release());
+        return true;
+    }
+
+    void consumeRing(KmreSocket::ShmRing *raw) {
+        std::unique_ptr<KmreSocket::ShmRing> ring(raw);
+        int index;
+        std::string body;
+        while (!mStop) {
+            while (ring->pop(index, body)) {
+                ++mRingRecords;
+            }
+            ring->wait(100);
+        }
+    }
+
+    void handle(int fd) {
+        char buf[64 * 1024];
+        int fds[2] = {-1, -1};
+        char control[CMSG_SPACE(sizeof(fds))];
+        struct iovec iov = {buf, sizeof(buf)};
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t size = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+        struct cmsghdr *cmsg = (size > 0) ? CMSG_FIRSTHDR(&msg) : nullptr;
+        if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+        int index = (size >= 4) ? buf[0] * 1000 + buf[1] * 100 + buf[2] * 10 + buf[3] : -1;
+        int fault = pickFault(index);
+        ++mFaults[fault];
+
+        bool ringOpened = false;
+        if (index == 21 && fault == eFault_None && fds[0] >= 0) {
+            ringOpened = openRing(fds[0], fds[1]);// 无论成败fd都已交给ShmRing
+            fds[0] = fds[1] = -1;
+        }
+        for (int ringFd : fds) {
+            if (ringFd >= 0) {
+                close(ringFd);
+            }
+        }
+
+        if (size >= 4 && fault != eFault_Disconnect) {
+            std::string out = replyFor(index, buf + 4, static_cast<int>(size - 4));
+            if (index == 21) {
+                cn::kylinos::kmre::kmrecore::ActionResult reply;
+                reply.set_result(ringOpened);
+                reply.set_org_cmd("soak");
+                reply.SerializeToString(&out);
+            }
+            if (fault == eFault_ShortReply) {
+                out.resize(out.size() / 2);
+            }
+            else if (fault == eFault_Garbage) {
+                out.assign(64, '\xff');
+            }
+            else if (fault == eFault_Stall) {
+                usleep((timeoutOf(index) * 1000 + 500) * 1000);
+            }
+            if (!out.empty() && send(fd, out.data(), out.size(), MSG_NOSIGNAL) < 0) {
+                // 客户端已超时断开
+            }
+        }
+        close(fd);
+        --mActive;
+    }
+
+    int mFailPercent = 0;
+    std::atomic<bool> mStop{false};
+    std::atomic<int> mActive{0};
+    std::atomic<long long> mFaults[eFault_Count] = {};
+    std::vector<int> mListenFds;
+    std::vector<std::string> mPaths;
+    std::vector<std::thread> mThreads;
+
+    std::mutex mPushMutex;
+    std::condition_variable mPushCond;
+    std::thread mPushThread;
+    int mPushIntervalMs = 0;
+    bool mPushStop = false;
+    std::atomic<long long> mPushed{0};
+
+    std::mutex mRingMutex;
+    std::vector<std::thread> mRingThreads;
+    std::atomic<long long> mRingRecords{0};
+};
+
+// 模拟服务端的socket放在临时目录下，通过KMRE_SOCKET_ROOT让库连接到这里，不占用正式容器的路径
+static std::string soak_socket_dir(const std::string &root, const char *userSpec)
+{
+    uid_t uid = getuid();
+    std::string user;
+    if (userSpec) {
+        std::string spec = userSpec;
+        size_t colon = spec.find(':');
+        uid = static_cast<uid_t>(strtoul(spec.substr(0, colon).c_str(), nullptr, 10));
+        if (colon != std::string::npos) {
+            user = spec.substr(colon + 1);
+        }
+    }
+    if (user.empty()) {
+        struct passwd *pw = getpwuid(uid);
+        user = pw ? pw->pw_name : std::to_string(uid);
+    }
+    std::replace(user.begin(), user.end(), '\\', '_');
+    return root + "/kmre-" + std::to_string(uid) + "-" + user + "/sockets/";
+}
+
+// 须在库第一次解析socket路径(如 -u 打开用户)之前调用
+static bool create_soak_root(std::string &root)
+{
+    char dir[] = "/tmp/kmrectl-soak-XXXXXX";
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "kmrectl: can't create temporary socket root: %s\n", strerror(errno));
+        return false;
+    }
+    root = dir;
+    setenv("KMRE_SOCKET_ROOT", dir, 1);
+    return true;
+}
+
+static bool make_soak_dirs(const std::string &dir)
+{
+    // dir为 root/kmre-uid-user/sockets/
+    const std::string container = dir.substr(0, dir.rfind('/', dir.size() - 2));
+    if ((mkdir(container.c_str(), 0700) != 0 && errno != EEXIST) ||
+        (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST)) {
+        fprintf(stderr, "kmrectl: can't create %s: %s\n", dir.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void remove_soak_dirs(const std::string &root, const std::string &dir)
+{
+    rmdir(dir.c_str());
+    rmdir(dir.substr(0, dir.rfind('/', dir.size() - 2)).c_str());
+    rmdir(root.c_str());
+}
+
+static bool load_soak_mix(const std::string &file, std::vector<Args> &mix)
+{
+    std::vector<std::string> lines;
+    if (file.empty()) {
+        lines.assign(std::begin(kSoakMix), std::end(kSoakMix));
+    }
+    else {
+        std::ifstream input(file);
+        if (!input) {
+            fprintf(stderr, "kmrectl: can't open %s\n", file.c_str());
+            return false;
+        }
+        std::string line;
+        while (std::getline(input, line)) {
+            lines.push_back(line);
+        }
+    }
+
+    for (const auto &line : lines) {
+        Args words;
+        if (split_line(line, words) && !words.empty() && words[0][0] != '#') {
+            mix.push_back(words);
+        }
+    }
+    return !mix.empty();
+}
+
+static SoakSample take_sample(long long ops, long long failures)
+{
+    SoakSample sample;
+    sample.ops = ops;
+    sample.failures = failures;
+    sample.rssKb = read_rss_kb();
+    sample.fds = count_open_fds();
+    sample.liveAllocs = gAllocCount.load() - gFreeCount.load();
+    return sample;
+}
+
+static int run_soak(const SoakOptions &options, int handle, const char *userSpec, const std::string &soakRoot)
+{
+    std::vector<Args> mix;
+    if (!load_soak_mix(options.mixFile, mix)) {
+        return 2;
+    }
+
+    SoakServer server;
+    const std::string socketDir = options.fakeServer ? soak_socket_dir(soakRoot, userSpec) : "";
+    if (options.fakeServer && (!make_soak_dirs(socketDir) ||
+                               !server.start(socketDir, options.failPercent))) {
+        remove_soak_dirs(soakRoot, socketDir);
+        return 2;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    std::atomic<long long> ops{0}, failures{0};
+    std::atomic<bool> running{true};
+    auto worker = [&](int id) {
+        if (handle > 0) {
+            kmre_user_select(handle);
+        }
+        long long serial = id * 1000000LL;
+        for (size_t n = id; running; n++) {
+            Args words = mix[n % mix.size()];
+            for (auto &word : words) {
+                size_t pos = word.find("%n");
+                if (pos != std::string::npos) {
+                    word.replace(pos, 2, std::to_string(++serial));
+                }
+            }
+            if (!soak_result_ok(execute(words))) {
+                ++failures;
+            }
+            ++ops;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int n = 0; n < options.threads; n++) {
+        threads.emplace_back(worker, n);
+    }
+
+    // 第一个周期为预热(线程局部缓冲区、连接缓存等)，其结束时的资源占用作为基线
+    const int intervals = std::max(1, options.durationSec / options.intervalSec);
+    SoakSample base, last;
+    long long baseRate = 0;
+    int slowIntervals = 0;
+    std::string failure;
+    for (int n = 0; n <= intervals && !gStop && failure.empty(); n++) {
+        for (int ms = 0; ms < options.intervalSec * 1000 && !gStop; ms += 100) {
+            usleep(100 * 1000);
+        }
+
+        SoakSample sample = take_sample(ops.load(), failures.load());
+        long long rate = (sample.ops - last.ops) / options.intervalSec;
+        if (n == 0) {
+            base = sample;
+        }
+        else if (n == 1) {
+            baseRate = std::max(rate, 1LL);
+        }
+        else if (rate * 100 < baseRate * options.minThroughputPercent) {
+            // 连续两个周期低于下限才视为崩溃，避免偶发的调度抖动
+            if (++slowIntervals >= 2) {
+                failure = "throughput collapsed to " + std::to_string(rate) + "/s (baseline " +
+                          std::to_string(baseRate) + "/s)";
+            }
+        }
+        else {
+            slowIntervals = 0;
+        }
+
+        printf("{\"t\":%d,\"ops_per_sec\":%lld,\"ops\":%lld,\"failures\":%lld,\"rss_kb\":%ld,\"fds\":%d,\"live_allocs\":%lld}\n",
+               n * options.intervalSec + options.intervalSec, rate, sample.ops, sample.failures,
+               sample.rssKb, sample.fds, sample.liveAllocs);
+        fflush(stdout);
+        last = sample;
+    }
+
+    running = false;
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::string faults;
+    long long statsPushed = 0, ringRecords = 0;
+    if (options.fakeServer) {
+        faults = server.faultsJson();
+        statsPushed = server.statsPushed();
+        ringRecords = server.ringRecords();
+        server.stop();
+        remove_soak_dirs(soakRoot, socketDir);
+    }
+
+    SoakSample end = take_sample(ops.load(), failures.load());
+    if (failure.empty() && end.fds - base.fds > options.maxFdGrowth) {
+        failure = "open fds grew from " + std::to_string(base.fds) + " to " + std::to_string(end.fds);
+    }
+    if (failure.empty() && end.rssKb - base.rssKb > options.maxRssGrowthKb) {
+        failure = "rss grew from " + std::to_string(base.rssKb) + "KB to " + std::to_string(end.rssKb) + "KB";
+    }
+    if (failure.empty() && end.liveAllocs - base.liveAllocs > options.maxAllocGrowth) {
+        failure = "live allocations grew from " + std::to_string(base.liveAllocs) + " to " + std::to_string(end.liveAllocs);
+    }
+
+    std::string summary = "{\"ok\":" + std::string(failure.empty() ? "true" : "false");
+    summary += ",\"ops\":" + std::to_string(end.ops) + ",\"failures\":" + std::to_string(end.failures);
+    summary += ",\"fd_growth\":" + std::to_string(end.fds - base.fds);
+    summary += ",\"rss_growth_kb\":" + std::to_string(end.rssKb - base.rssKb);
+    summary += ",\"alloc_growth\":" + std::to_string(end.liveAllocs - base.liveAllocs);
+    if (!faults.empty()) {
+        summary += ",\"faults\":" + faults + ",\"stats_pushed\":" + std::to_string(statsPushed);
+        summary += ",\"ring_records\":" + std::to_string(ringRecords);
+    }
+    if (!failure.empty()) {
+        summary += ",\"error\":" + json_string(failure);
+    }
+    printf("%s}\n", summary.c_str());
+    return failure.empty() ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------
+// 发送路径分配检查: 对模拟服务端反复发送只含整数字段的无回复命令(消息本身不分配)，
+// 预热后统计调用线程上operator new的次数，稳定状态下每次发送都应为0，否则以非0退出
+
+struct AllocCheckCommand {
+    const char *name;
+    bool (*send)(int serial);
+};
+
+static const AllocCheckCommand kAllocCheckCommands[] = {
+    {"focus_win_id", [](int serial) { return focus_win_id(serial); }},
+    {"answer_call", [](int serial) { return answer_call(serial & 1) == 0; }},
+};
+
+static int run_alloc_check(int sends, int handle, const char *userSpec, const std::string &soakRoot)
+{
+    const int kWarmupSends = 64;// 线程局部缓冲区、连接相关缓存在预热期间建立
+
+    SoakServer server;
+    const std::string socketDir = soak_socket_dir(soakRoot, userSpec);
+    if (!make_soak_dirs(socketDir) || !server.start(socketDir, 0)) {
+        remove_soak_dirs(soakRoot, socketDir);
+        return 2;
+    }
+    if (handle > 0) {
+        kmre_user_select(handle);
+    }
+
+    std::string failure;
+    std::string results;
+    int serial = 0;
+    for (const auto &cmd : kAllocCheckCommands) {
+        for (int n = 0; n < kWarmupSends && failure.empty(); n++) {
+            if (!cmd.send(++serial)) {
+                failure = std::string(cmd.name) + " failed during warm-up";
+            }
+        }
+        if (!failure.empty()) {
+            break;
+        }
+
+        long long failed = 0;
+        const long long before = tlsAllocCount;
+        for (int n = 0; n < sends; n++) {
+            failed += cmd.send(++serial) ? 0 : 1;
+        }
+        const long long allocs = tlsAllocCount - before;
+
+        results += std::string(results.empty() ? "" : ",") + "{\"command\":" + json_string(cmd.name) +
+                   ",\"sends\":" + std::to_string(sends) + ",\"failures\":" + std::to_string(failed) +
+                   ",\"allocs\":" + std::to_string(allocs) + "}";
+        if (failed > 0) {
+            failure = std::string(cmd.name) + " failed " + std::to_string(failed) + " times";
+        }
+        else if (allocs > 0) {
+            failure = std::string(cmd.name) + " allocated " + std::to_string(allocs) + " times in " +
+                      std::to_string(sends) + " sends";
+        }
+        if (!failure.empty()) {
+            break;
+        }
+    }
+
+    server.stop();
+    remove_soak_dirs(soakRoot, socketDir);
+
+    std::string summary = "{\"ok\":" + std::string(failure.empty() ? "true" : "false");
+    summary += ",\"commands\":[" + results + "]";
+    if (!failure.empty()) {
+        summary += ",\"error\":" + json_string(failure);
+    }
+    printf("%s}\n", summary.c_str());
+    return failure.empty() ? 0 : 1;
+}
+
+static int open_user(const char *spec)
+{
+    std::string str = spec;
+    std::string user;
+    size_t colon = str.find(':');
+    if (colon != std::string::npos) {
+        user = str.substr(colon + 1);
+        str = str.substr(0, colon);
+    }
+    return kmre_user_open(static_cast<unsigned int>(strtoul(str.c_str(), nullptr, 10)),
+                          user.empty() ? nullptr : user.c_str());
+}
+
+int main(int argc, char **argv)
+{
+    int handle = 0;
+    int jobs = 0;
+    bool batch = false;
+    bool soak = false;
+    int allocCheckSends = 0;
+    SoakOptions soakOptions;
+    const char *userSpec = nullptr;
+    int n = 1;
+
+    for (; n < argc && argv[n][0] == '-'; n++) {
+        if (strcmp(argv[n], "-u") == 0 && n + 1 < argc) {
+            userSpec = argv[++n];
+        }
+        else if (strcmp(argv[n], "-j") == 0 && n + 1 < argc) {
+            jobs = atoi(argv[++n]);
+            jobs = (jobs > 0) ? jobs : 1;
+        }
+        else if (strcmp(argv[n], "--batch") == 0) {
+            batch = true;
+        }
+        else if (strcmp(argv[n], "--soak") == 0) {
+            soak = true;
+        }
+        else if (strcmp(argv[n], "--check-alloc") == 0) {
+            allocCheckSends = 1000;
+        }
+        else if (strcmp(argv[n], "--sends") == 0 && n + 1 < argc) {
+            allocCheckSends = std::max(1, atoi(argv[++n]));
+        }
+        else if (strcmp(argv[n], "--duration") == 0 && n + 1 < argc) {
+            soakOptions.durationSec = std::max(1, atoi(argv[++n]));
+        }
+        else if (strcmp(argv[n], "--interval") == 0 && n + 1 < argc) {
+            soakOptions.intervalSec = std::max(1, atoi(argv[++n]));
+        }
+        else if (strcmp(argv[n], "--mix") == 0 && n + 1 < argc) {
+            soakOptions.mixFile = argv[++n];
+        }
+        else if (strcmp(argv[n], "--fake-server") == 0) {
+            soakOptions.fakeServer = true;
+        }
+        else if (strcmp(argv[n], "--fail") == 0 && n + 1 < argc) {
+            soakOptions.failPercent = atoi(argv[++n]);
+        }
+        else if (strcmp(argv[n], "--max-fd-growth") == 0 && n + 1 < argc) {
+            soakOptions.maxFdGrowth = atoi(argv[++n]);
+        }
+        else if (strcmp(argv[n], "--max-rss-growth") == 0 && n + 1 < argc) {
+            soakOptions.maxRssGrowthKb = atol(argv[++n]);
+        }
+        else if (strcmp(argv[n], "--max-alloc-growth") == 0 && n + 1 < argc) {
+            soakOptions.maxAllocGrowth = atoll(argv[++n]);
+        }
+        else if (strcmp(argv[n], "--min-throughput") == 0 && n + 1 < argc) {
+            soakOptions.minThroughputPercent = atoi(argv[++n]);
+        }
+        else if (strcmp(argv[n], "--ring") == 0) {
+            kmre_control_ring_enable(true);
+        }
+        else if (strcmp(argv[n], "--io") == 0 && n + 1 < argc) {
+            ++n;
+            int backend = (strcmp(argv[n], "uring") == 0) ? 1 : 0;
+            if (!kmre_set_io_backend(backend)) {
+                fprintf(stderr, "kmrectl: io backend '%s' unavailable, use epoll\n", argv[n]);
+            }
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::string soakRoot;
+    if (((soak && soakOptions.fakeServer) || allocCheckSends > 0) && !create_soak_root(soakRoot)) {
+        return 2;
+    }
+    if (userSpec) {
+        handle = open_user(userSpec);
+        if (handle <= 0) {
+            fprintf(stderr, "kmrectl: invalid user '%s'\n", userSpec);
+            if (!soakRoot.empty()) {
+                rmdir(soakRoot.c_str());
+            }
+            return 2;
+        }
+    }
+
+    if (allocCheckSends > 0) {
+        return run_alloc_check(allocCheckSends, handle, userSpec, soakRoot);
+    }
+    if (soak) {
+        soakOptions.threads = (jobs > 0) ? jobs : soakOptions.threads;
+        return run_soak(soakOptions, handle, userSpec, soakRoot);
+    }
+    if (batch) {
+        return run_batch((jobs > 0) ? jobs : 1, handle);
+    }
+    if (n >= argc) {
+        usage();
+        return 2;
+    }
+
+    if (handle > 0) {
+        kmre_user_select(handle);
+    }
+
+    Args words(argv + n, argv + argc);
+    Result r = execute(words);
+    if (!r.ok) {
+        fprintf(stderr, "kmrectl: %s\n", r.result.c_str());
+        return 1;
+    }
+    printf("%s\n", r.result.c_str());
+    return 0;
+}
@@ -19,6 +19,7 @@
  */
 
 #include <pthread.h>
+#include <algorithm>
 #include <iostream>
 #include <stdio.h>
 #include <stdlib.h>
@@ -33,6 +34,25 @@
 
 #include "KmreCore.pb.h"
 #include "kmre_socket.h"
+#include "kmre_log.h"
+#include "kmre_connect_socket.h"
+#include "kmre_pipeline.h"
+#include "kmre_media_index.h"
+#include "kmre_media_watcher.h"
+#include "kmre_app_snapshot.h"
+#include "kmre_installer.h"
+#include "kmre_launch_tracer.h"
+#include "kmre_uring.h"
+#include "kmre_shm_ring.h"
+#include "kmre_scheduler.h"
+#include "kmre_display_registry.h"
+#include "kmre_event.h"
+#include "kmre_ready.h"
+#include "kmre_trace.h"
+#include "kmre_media_reconciler.h"
+#include "kmre_app_cache.h"
+#include "kmre_app_stats.h"
+#include "kmre_singleflight.h"
 
 using namespace std;
 using namespace KmreSocket;
@@ -58,47 +78,102 @@ static char *remove_space(char *str)
     return str;
 }
 
-static bool file_is_exists(const char *filepath)
+//删除软件的desktoop文件和icon，目录只打开一次，批量卸载时可复用
+class DesktopCleaner
 {
-    struct stat statbuf;
-    return stat(filepath, &statbuf) == 0;
-}
-
-static bool delete_local_file(const char *filepath)
-{
-    if (file_is_exists(filepath)) {
-        remove(filepath);
+public:
+    DesktopCleaner() {
+        const char *homedir = getenv("HOME");
+        if (homedir) {
+            std::string share = std::string(homedir) + "/.local/share/";
+            mAppsDirFd = open((share + "applications").c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+            mIconsDirFd = open((share + "icons").c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+        }
     }
-    return true;
-}
 
-//删除软件的desktoop文件和icon
-static bool delete_desktop_and_icon(const char *pkgname)
-{
-    char *homedir = getenv("HOME");
-    int r;
-    if (homedir) {
-        char desktop_file[512] = {0};
-        r = sprintf(desktop_file, "%s/.local/share/applications/%s.desktop", homedir, pkgname);
-        if (r >= 0) {
-            delete_local_file(desktop_file);
+    ~DesktopCleaner() {
+        if (mAppsDirFd >= 0) {
+            close(mAppsDirFd);
         }
-
-        char svg_icon_file[512] = {0};
-        r = sprintf(svg_icon_file, "%s/.local/share/icons/%s.svg", homedir, pkgname);
-        if (r >= 0) {
-            delete_local_file(svg_icon_file);
+        if (mIconsDirFd >= 0) {
+            close(mIconsDirFd);
         }
+    }
+
+    void remove(const std::string &pkgname) {
+        unlinkFile(mAppsDirFd, pkgname + ".desktop");
+        unlinkFile(mIconsDirFd, pkgname + ".svg");
+        unlinkFile(mIconsDirFd, pkgname + ".png");
+    }
 
-        char png_icon_file[512] = {0};
-        r = sprintf(png_icon_file, "%s/.local/share/icons/%s.png", homedir, pkgname);
-        if (r >= 0) {
-            delete_local_file(png_icon_file);
+private:
+    static void unlinkFile(int dirfd, const std::string &name) {
+        if (dirfd < 0 || name.find('/') != std::string::npos) {
+            return;
+        }
+        if (unlinkat(dirfd, name.c_str(), 0) != 0 && errno != ENOENT) {
+            KMRE_LOG(LOG_WARNING, "[%s] Remove '%s' failed: %s", __func__, name.c_str(), strerror(errno));
         }
     }
+
+    int mAppsDirFd = -1;
+    int mIconsDirFd = -1;
+};
+
+#define UNINSTALL_MAX_INFLIGHT 8
+#define UNINSTALL_TIMEOUT_MS (60 * 1000)
+
+#define USERS_MAX_INFLIGHT 256
+#define USERS_TIMEOUT_MS (30 * 1000)
+
+// index为请求在数组中的下标
+typedef void (*TargetReplyCallback)(int index, int handle, bool ok, const char *reply, int reply_len, void *user_data);
+
+// field为EventSequence中子消息的字段编号，data为子消息序列化后的数据，只在回调期间有效
+typedef void (*EventCallback)(int field, const char *data, int len, void *user_data);
+
+// 流式读取列表时每个item调用一次，index从0开始，字符串只在回调期间有效
+typedef void (*InstalledAppCallback)(int index, const char *app_name, const char *package_name,
+                                     const char *version_name, void *user_data);
+typedef void (*RunningAppCallback)(int index, const char *app_name, const char *package_name, void *user_data);
+typedef void (*FileItemCallback)(int index, const char *path, const char *mime_type, void *user_data);
+
+static bool delete_desktop_and_icon(const char *pkgname)
+{
+    DesktopCleaner cleaner;
+    cleaner.remove(pkgname);
     return true;
 }
 
+//将卸载结果转换为uninstall_app的返回值，1为成功
+static int uninstall_result_code(const cn::kylinos::kmre::kmrecore::ActionResult &reply)
+{
+    std::string cmdInfo = reply.org_cmd();//UninstallApp or InstallApp
+
+    if (reply.result() || cmdInfo == "DELETE_SUCCEEDED") {
+        return 1;
+    }
+    else if (cmdInfo == "DELETE_FAILED_INTERNAL_ERROR") {//未指明的原因
+        return -1;
+    }
+    else if (cmdInfo == "DELETE_FAILED_DEVICE_POLICY_MANAGER") {//设备管理器
+        return -2;
+    }
+    else if (cmdInfo == "DELETE_FAILED_USER_RESTRICTED") {//用户受到限制
+        return -3;
+    }
+    else if (cmdInfo == "DELETE_FAILED_OWNER_BLOCKED") {//因为配置文件或设备所有者已将包标记为可卸载
+        return -4;
+    }
+    else if (cmdInfo == "DELETE_FAILED_ABORTED") {//中止
+        return -5;
+    }
+    else if (cmdInfo == "DELETE_FAILED_USED_SHARED_LIBRARY") {//因为packge是一个由其他已安装的包使用的共享库
+        return -6;
+    }
+    return -1;
+}
+
 
 static int isInCpuinfo(const char *fmt, const char *str)
 {
@@ -148,209 +223,63 @@ static int strInCpuinfo(const char *str)
     return found;
 }
 
-static std::string get_user_name()
-{
-    std::string user_name = "";
-    struct passwd  pwd;
-    struct passwd *result = nullptr;
-    char *buf = nullptr;
-
-    int bufSize = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (bufSize == -1) {
-        bufSize = 16384;
-    }
-    buf = new char[bufSize]();
-
-    getpwuid_r(getuid(), &pwd, buf, bufSize, &result);
-    if (result && pwd.pw_name) {
-        user_name = pwd.pw_name;
-    }
-    else {
-        syslog(LOG_ERR, "[libkylin-kmre][%s] getpwuid_r error!", __func__);
-
-        user_name = std::getenv("USER");
-        if (user_name.empty()) {
-            user_name = std::getenv("USERNAME");
-        }
-        if (user_name.empty()) {
-            char name[16];
-            snprintf(name, sizeof(name), "%u", getuid());
-            user_name = std::string(name);
-        }
-    }
-
-    if (buf) {
-        delete[] buf;
-    }
-
-    return user_name;
-}
-
-static std::string get_uid()
-{
-    uid_t uid = getuid();
-    static char uidstr[12] = {0};
-    snprintf(uidstr, sizeof(uidstr), "%d", uid);
-
-    return std::string(uidstr);
-}
-
-typedef enum {
-    eLink_Launcher = 0,
-    eLink_Manager,
-}SocketLink;
-
-#define BUF_SIZE 2048
-#define LAUNCHER_SOCKET_LOCK_FILE "/tmp/.kmre_launcher_socket.lock"
-#define MANAGER_SOCKET_LOCK_FILE "/tmp/.kmre_manager_socket.lock"
-
-static std::string convertUserNameToPath(const std::string& userName)
+//获取已安装应用列表，成功时同时更新本地快照；优先读取同一用户各进程共享的快照，快照无效时才向容器请求
+static bool fetch_installed_applist(cn::kylinos::kmre::kmrecore::InstalledAppList &data)
 {
-    char buffer[BUF_SIZE] = {0};
-    std::string path = userName;
-    unsigned int i = 0;
-    const char* str = nullptr;
-
-    str = userName.c_str();
-    if (str && strstr(str, "\\")) {
-        snprintf(buffer, sizeof(buffer), "%s", str);
-        for (i = 0; i < sizeof(buffer); ++i) {
-            if ('\0' == buffer[i]) {
-                break;
-            }
-
-            if ('\\' == buffer[i]) {
-                buffer[i] = '_';
-            }
-        }
-
-        path = buffer;
+    if (AppListCache::getInstance().getInstalled(data) && data.has_size()) {
+        InstalledAppSnapshot::getInstance().update(data);
+        return true;
     }
 
-    return path;
+    KMRE_LOG(LOG_ERR, "[%s] Get installed app list failed!", __func__);
+    return false;
 }
 
-template <typename T, typename R = cn::kylinos::kmre::kmrecore::ActionResult>
-class ConnectSocket
+// 共享快照有效时从快照中逐个解析，否则边从socket读取边解析; 返回item个数，失败返回-1
+template <typename T, typename Item>
+static int stream_app_list(AppCacheList list, const T &request, int itemField,
+                           const std::function<void(int, const Item&)> &onItem)
 {
-public:
-    ConnectSocket(SocketLink link) {
-        switch (link) {
-        case eLink_Launcher: {
-            mSocketPath = "/var/lib/kmre/kmre-" + get_uid() + "-" + convertUserNameToPath(get_user_name()) + "/sockets/kmre_launcher";
-        }break;
-        case eLink_Manager: {
-            mSocketPath = "/var/lib/kmre/kmre-" + get_uid() + "-" + convertUserNameToPath(get_user_name()) + "/sockets/kmre_manager";
-        }break;
-        default:break;
-        }
-    }
-
-    ~ConnectSocket() {
-        if (mSocketFd > 0) {
-            close(mSocketFd);
-        }
-        mSocketFd = -1;
-    }
-
-    bool connect() {
-        if (!file_is_exists(mSocketPath.c_str())) {
-            syslog(LOG_ERR, "[%s] Can't find socket file:'%s'!", __func__, mSocketPath.c_str());
-            return false;
-        }
-
-        mSocketFd = connect_socket(mSocketPath.c_str());
-        if (mSocketFd < 0) {
-            syslog(LOG_ERR, "[%s] Create socket:'%s' or connect server failed!", __func__, mSocketPath.c_str());
-            return false;
-        }
-        return true;
-    }
-
-    bool setTimeout(int sendTimeout = 2, int rcvTimeout = 2) {// default timeout: 2s
-        if (mSocketFd < 0) {
-            syslog(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
-            return false;
-        }
-        
-        if (set_timeout(mSocketFd, sendTimeout, rcvTimeout) != 0) {
-            syslog(LOG_ERR, "[%s] Set socket timeout failed!", __func__);
-            return false;
-        }
-        return true;
-    }
-
-    bool sendData(T &&data, const int &&index) {
-        if (mSocketFd < 0) {
-            syslog(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
-            return false;
-        }
-
-        const size_t content_size = data.ByteSize();
-        const unsigned char header_bytes[4] = {
-            static_cast<unsigned char>((index / 1000) % 10),
-            static_cast<unsigned char>((index / 100) % 10),
-            static_cast<unsigned char>((index / 10) % 10),
-            static_cast<unsigned char>(index % 10),
-        };
-        std::vector<std::uint8_t> send_buffer(sizeof(header_bytes) + content_size);
-        std::copy(header_bytes, header_bytes + sizeof(header_bytes), send_buffer.begin());
-        data.SerializeToArray(send_buffer.data() + sizeof(header_bytes), content_size);
-
-        int ret = write_fully(mSocketFd, reinterpret_cast<const char *>(send_buffer.data()), send_buffer.size());
-        if (ret < 0) {
-            syslog(LOG_ERR, "[%s] Write data to server failed!", __func__);            
-            return false;
-        }
+    typename CommandTraits<T>::ReplyType envelope;
+    int count = 0;
+    std::function<bool(const Item&)> counted = [&](const Item &item) {
+        onItem(count++, item);
         return true;
-    }
-
-    bool readData(R &data) {
-        if (mSocketFd < 0) {
-            syslog(LOG_ERR, "[%s] Invalid socket fd!", __func__); 
-            return false;
-        }
-
-        char* buf = (char*)malloc(BUF_SIZE);
-        memset(buf, 0, BUF_SIZE);
-        ssize_t readSize = 0, totalSize = 0, readCount = 0;
-
-        readSize = read_buf(mSocketFd, buf, BUF_SIZE);
-        ++readCount;
-
-        while (readSize == BUF_SIZE) {
-            totalSize += readSize;
-
-            char* newBuf = (char*)realloc(buf, (readCount + 1) * BUF_SIZE);
-            if (!newBuf) {
-                syslog(LOG_ERR , "[%s] Realloc failed !", __func__);
-                free(buf);
+    };
+
+    // 直接在映射的快照上解析，每个item交出前确认快照未被改写; 交出第一个item之前被改写时可以重新读取，
+    // 之后被改写只能返回失败
+    bool torn = false;
+    bool viewed = AppListCache::getInstance().viewSnapshot(list,
+        [&](const char *data, int len, const std::function<bool()> &unchanged) {
+            if (count > 0) {
                 return false;
             }
-
-            buf = newBuf;
-            char* dataStartAddr = buf + (readCount * BUF_SIZE);
-            memset(dataStartAddr, 0, BUF_SIZE);
-
-            readSize = read_buf(mSocketFd, dataStartAddr, BUF_SIZE);
-            ++readCount;
-        }
-        if (readSize > 0) {
-            totalSize += readSize;
-        }
-
-        string str(buf, totalSize);
-        data.ParseFromString(str);
-        free(buf);
-
-        return true;
+            std::function<bool(const Item&)> checked = [&](const Item &item) {
+                if (!unchanged()) {
+                    torn = true;
+                    return false;
+                }
+                return counted(item);
+            };
+            torn = false;
+            return parse_list_stream(data, len, itemField, envelope, checked) && unchanged();
+        });
+    if (viewed) {
+        return count;
+    }
+    if (count > 0) {
+        KMRE_LOG(LOG_ERR, "[%s] Shared snapshot %s after %d items!", __func__, torn ? "changed" : "is corrupted", count);
+        return -1;
     }
 
-private:
-    std::string mSocketPath = "";
-    int mSocketFd = -1;
-};
-
+    ConnectSocket<T> connectSocket;
+    if (!connectSocket.connect() || !connectSocket.sendData(request)) {
+        KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+        return -1;
+    }
+    return connectSocket.readStream(itemField, envelope, counted) ? count : -1;
+}
 }
 
 extern "C" {
@@ -372,27 +301,65 @@ extern "C" {
  ************************************************************/
 bool install_app(char *filename, char *appname, char *pkgname)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::InstallApp> connectSocket(eLink_Launcher);
-    
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::InstallApp obj;
-        obj.set_file_name(filename);
-        obj.set_app_name(appname);
-        obj.set_package_name(pkgname);
-        if (connectSocket.sendData(std::move(obj), 1)) {
-            cn::kylinos::kmre::kmrecore::ActionResult reply;
-            if (connectSocket.readData(reply)) {
-                return reply.result();
-            }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return false;
+    cn::kylinos::kmre::kmrecore::InstallApp obj;
+    obj.set_file_name(filename);
+    obj.set_app_name(appname);
+    obj.set_package_name(pkgname);
+    cn::kylinos::kmre::kmrecore::ActionResult reply;
+    CommandStatus status = send_command(obj, reply);
+    if (status == eCommand_Ok) {
+        if (reply.result()) {
+            AppListCache::getInstance().invalidate(eAppCache_Installed);
         }
+        return reply.result();
     }
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] %s data failed!", __func__, (status == eCommand_SendFailed) ? "Send" : "Read");
     return false;
 }
 
+/***********************************************************
+   Function:       kmre_install_apps
+   Description:    批量安装app
+   Calls:
+   Called By:
+   Input:
+        apk_paths:apk完整路径数组
+        appnames:应用名数组
+        pkgnames:包名数组
+        count:安装项个数
+        stage_dir:容器可见的目录，apk先并行拷贝到该目录再安装；
+                  为nullptr时不拷贝，直接以apk文件名提交安装
+        concurrency:并行拷贝及同时安装的个数，小于等于0时为4
+        callback:进度回调，可为nullptr
+            stage 0:开始拷贝 1:拷贝结束 2:安装结束，result 1:成功 0:失败
+        user_data:回调参数
+   Output:
+   Return:  安装成功的个数
+   Others:  head: 0001   回调可能来自不同线程，但不会并发调用;
+            apk文件名与前面的项相同的项不拷贝也不安装(stage 1和2的result均为0)
+ ************************************************************/
+int kmre_install_apps(const char **apk_paths, const char **appnames, const char **pkgnames, int count,
+                      const char *stage_dir, int concurrency, InstallCallback callback, void *user_data)
+{
+    if (!apk_paths || !appnames || !pkgnames || count <= 0) {
+        return 0;
+    }
+
+    std::vector<InstallItem> items(count);
+    for (int n = 0; n < count; n++) {
+        items[n].apkPath = apk_paths[n] ? apk_paths[n] : "";
+        items[n].appName = appnames[n] ? appnames[n] : "";
+        items[n].pkgName = pkgnames[n] ? pkgnames[n] : "";
+    }
+
+    int installed = bulk_install(items, stage_dir ? stage_dir : "", concurrency, callback, user_data);
+    if (installed > 0) {
+        AppListCache::getInstance().invalidate(eAppCache_Installed);
+    }
+    return installed;
+}
+
 /***********************************************************
    Function:       uninstall_app
    Description:    卸载app
@@ -408,58 +375,104 @@ bool install_app(char *filename, char *appname, char *pkgname)
  ************************************************************/
 int uninstall_app(char* pkgname)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::UninstallApp> connectSocket(eLink_Launcher);
-    
-    if (connectSocket.connect()) {
+    cn::kylinos::kmre::kmrecore::UninstallApp obj;
+    obj.set_package_name(pkgname);
+    cn::kylinos::kmre::kmrecore::ActionResult reply;
+    CommandStatus status = send_command(obj, reply);
+    if (status == eCommand_Ok) {
+        std::string cmdInfo = reply.org_cmd();//UninstallApp or InstallApp
+        std::string errInfo = reply.has_err_info() ? reply.err_info() : "";
+
+        KMRE_LOG(LOG_DEBUG, "[%s] Reply:result = %d, cmd_info:'%s', err_info:'%s'", 
+            __func__, reply.result(), cmdInfo.c_str(), errInfo.c_str());
+
+        int ret = uninstall_result_code(reply);
+        if (ret == 1) {
+            AppListCache::getInstance().invalidate(eAppCache_Installed);
+            delete_desktop_and_icon(pkgname);// remove desktop file
+        }
+        return ret;
+    }
+    if (status == eCommand_ReadFailed) {
+        KMRE_LOG(LOG_ERR, "[%s] Read data failed!", __func__);
+        return -7;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send data failed!", __func__);
+    return -8;
+}
+
+/***********************************************************
+   Function:       uninstall_apps
+   Description:    批量卸载app
+   Calls:
+   Called By:
+   Input:
+        pkgnames:包名数组
+        count:包名个数
+   Output:
+        results:可为nullptr，每个包的卸载结果，取值同uninstall_app; 包名为NULL时为-9且不发送
+   Return:  卸载成功的个数
+   Others:  head: 0002   同时发出多个卸载请求，不逐个等待回复
+ ************************************************************/
+int uninstall_apps(char **pkgnames, int count, int *results)
+{
+    if (!pkgnames || count <= 0) {
+        return 0;
+    }
+
+    const std::string socketPath = get_socket_path(eLink_Launcher);
+    std::vector<PipelineRequest> requests;
+    std::vector<int> requestIndex(count, -1);// 包名在requests中的位置，NULL包名为-1
+    requests.reserve(count);
+    for (int n = 0; n < count; n++) {
+        if (!pkgnames[n]) {
+            KMRE_LOG(LOG_ERR, "[%s] Package name %d is NULL, skipped!", __func__, n);
+            continue;
+        }
         cn::kylinos::kmre::kmrecore::UninstallApp obj;
-        obj.set_package_name(pkgname);
-        if (connectSocket.sendData(std::move(obj), 2)) {
-            cn::kylinos::kmre::kmrecore::ActionResult reply;
-            if (connectSocket.readData(reply)) {
-                std::string cmdInfo = reply.org_cmd();//UninstallApp or InstallApp
-                std::string errInfo = reply.has_err_info() ? reply.err_info() : "";
+        obj.set_package_name(pkgnames[n]);
+        requestIndex[n] = static_cast<int>(requests.size());
+        requests.emplace_back();
+        make_pipeline_request(requests.back(), socketPath, obj);
+    }
 
-                syslog(LOG_DEBUG, "[%s] Reply:result = %d, cmd_info:'%s', err_info:'%s'", 
-                    __func__, reply.result(), cmdInfo.c_str(), errInfo.c_str());
+    if (!requests.empty()) {
+        run_pipeline(requests, UNINSTALL_MAX_INFLIGHT, UNINSTALL_TIMEOUT_MS);
+    }
 
-                if (reply.result()) {
-                    delete_desktop_and_icon(pkgname);// remove desktop file
-                    return 1;
+    DesktopCleaner cleaner;
+    int succeeded = 0;
+    for (int n = 0; n < count; n++) {
+        int ret = -9;
+        if (requestIndex[n] >= 0) {
+            const PipelineRequest &req = requests[requestIndex[n]];
+            ret = -8;
+            if (req.sent) {
+                cn::kylinos::kmre::kmrecore::ActionResult reply;
+                if (req.ok && reply.ParseFromString(req.reply)) {
+                    ret = uninstall_result_code(reply);
                 }
                 else {
-                    if (cmdInfo == "DELETE_SUCCEEDED") {
-                        delete_desktop_and_icon(pkgname);// remove desktop file
-                        return 1;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_INTERNAL_ERROR") {//未指明的原因
-                        return -1;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_DEVICE_POLICY_MANAGER") {//设备管理器
-                        return -2;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_USER_RESTRICTED") {//用户受到限制
-                        return -3;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_OWNER_BLOCKED") {//因为配置文件或设备所有者已将包标记为可卸载
-                        return -4;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_ABORTED") {//中止
-                        return -5;
-                    }
-                    else if (cmdInfo == "DELETE_FAILED_USED_SHARED_LIBRARY") {//因为packge是一个由其他已安装的包使用的共享库
-                        return -6;
-                    }
+                    KMRE_LOG(LOG_ERR, "[%s] Read reply of '%s' failed!", __func__, pkgnames[n]);
+                    ret = -7;
                 }
-                return -1;
             }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return -7;
         }
-    }
 
+        if (ret == 1) {
+            cleaner.remove(pkgnames[n]);
+            ++succeeded;
+        }
+        if (results) {
+            results[n] = ret;
+        }
+    }
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
-    return -8;
+    if (succeeded > 0) {
+        AppListCache::getInstance().invalidate(eAppCache_Installed);
+    }
+    return succeeded;
 }
 
 /***********************************************************
@@ -481,29 +494,131 @@ int uninstall_app(char* pkgname)
  ************************************************************/
 bool launch_app(char* pkgname, bool fullscreen, int width, int height, int density)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::LaunchApp> connectSocket(eLink_Launcher);
-    
+    int64_t start = monotonic_us();
+    int64_t phases[ePhase_Result];
+    ConnectSocket<cn::kylinos::kmre::kmrecore::LaunchApp> connectSocket;
+    phases[ePhase_Resolve] = monotonic_us();
+
     if (connectSocket.connect()) {
+        phases[ePhase_Connect] = monotonic_us();
         cn::kylinos::kmre::kmrecore::LaunchApp obj;
         obj.set_package_name(pkgname);
         obj.set_fullscreen(fullscreen);
         obj.set_width((width > 0) ? width : 0);
         obj.set_height((height > 0) ? height : 0);
         obj.set_density((density > 0) ? density : 240);
-        if (connectSocket.sendData(std::move(obj), 3)) {
+        if (connectSocket.sendData(obj)) {
+            phases[ePhase_Send] = monotonic_us();
             cn::kylinos::kmre::kmrecore::ActionResult reply;
             if (connectSocket.readData(reply)) {
+                phases[ePhase_Ack] = monotonic_us();
+                if (reply.result()) {
+                    AppListCache::getInstance().invalidate(eAppCache_Running);
+                    LaunchTracer::getInstance().onLaunchAcked(pkgname, start, phases);
+                    DisplayRegistry::getInstance().onLaunchAcked(pkgname, fullscreen, obj.width(), obj.height(), obj.density());
+                }
                 return reply.result();
             }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
+            KMRE_LOG(LOG_ERR, "[%s] Read data failed!", __func__);
             return false;
         }
     }
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send data failed!", __func__);
     return false;
 }
 
+/***********************************************************
+   Function:       kmre_launch_trace_apply_result
+   Description:    将安卓发来的LaunchResult(序列化数据)与之前的launch_app请求关联，记录启动耗时
+   Calls:
+   Called By:
+   Input:
+        data: LaunchResult序列化后的数据
+        len: 数据长度
+   Output:
+        true: 执行成功
+        false: 数据解析失败
+   Return:
+   Others:
+ ************************************************************/
+bool kmre_launch_trace_apply_result(const char *data, int len)
+{
+    if (!data || len < 0) {
+        return false;
+    }
+
+    cn::kylinos::kmre::kmrecore::LaunchResult result;
+    if (!result.ParseFromArray(data, len)) {
+        KMRE_LOG(LOG_ERR, "[%s] Parse LaunchResult failed!", __func__);
+        return false;
+    }
+    LaunchTracer::getInstance().onLaunchResult(result);
+    return true;
+}
+
+/***********************************************************
+   Function:       kmre_launch_trace_apply_event
+   Description:    从EventSequence(序列化数据)中取出LaunchResult并记录启动耗时
+   Calls:
+   Called By:
+   Input:
+        data: EventSequence序列化后的数据
+        len: 数据长度
+   Output:
+        true: 包含LaunchResult
+        false: 解析失败或不包含LaunchResult
+   Return:
+   Others:  只解析所需的子消息，其余子消息直接跳过
+ ************************************************************/
+bool kmre_launch_trace_apply_event(const char *data, int len)
+{
+    if (!data || len < 0) {
+        return false;
+    }
+
+    cn::kylinos::kmre::kmrecore::LaunchResult result;
+    if (!decode_event_field(data, len, result)) {
+        return false;
+    }
+    LaunchTracer::getInstance().onLaunchResult(result);
+    return true;
+}
+
+/***********************************************************
+   Function:       kmre_launch_stats
+   Description:    获取应用启动耗时统计
+   Calls:
+   Called By:
+   Input:
+        pkgname: 包名，为nullptr时返回所有应用
+   Output:  返回json格式的字符串，包含冷启动(cold)、恢复(resumed)的耗时分布及各阶段
+            (resolve, connect, send, ack, result)的耗时分布，单位为毫秒
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_launch_stats(const char *pkgname)
+{
+    static thread_local std::string stats;
+    stats = LaunchTracer::getInstance().statsJson(pkgname ? pkgname : "");
+    return const_cast<char *>(stats.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_launch_stats_reset
+   Description:    清空应用启动耗时统计
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_launch_stats_reset()
+{
+    LaunchTracer::getInstance().reset();
+}
+
 /***********************************************************
    Function:       close_app
    Description:    关闭app
@@ -520,23 +635,20 @@ bool launch_app(char* pkgname, bool fullscreen, int width, int height, int densi
  ************************************************************/
 bool close_app(char* appname, char* pkgname)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::CloseApp> connectSocket(eLink_Launcher);
-    
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::CloseApp obj;
-        obj.set_app_name(appname);
-        obj.set_package_name(pkgname);
-        if (connectSocket.sendData(std::move(obj), 4)) {
-            cn::kylinos::kmre::kmrecore::ActionResult reply;
-            if (connectSocket.readData(reply)) {
-                return reply.result();
-            }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return false;
+    cn::kylinos::kmre::kmrecore::CloseApp obj;
+    obj.set_app_name(appname);
+    obj.set_package_name(pkgname);
+    cn::kylinos::kmre::kmrecore::ActionResult reply;
+    CommandStatus status = send_command(obj, reply);
+    if (status == eCommand_Ok) {
+        if (reply.result()) {
+            AppListCache::getInstance().invalidate(eAppCache_Running);
+            DisplayRegistry::getInstance().onAppClosed(pkgname);
         }
+        return reply.result();
     }
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] %s data failed!", __func__, (status == eCommand_SendFailed) ? "Send" : "Read");
     return false;
 }
 
@@ -552,120 +664,353 @@ bool close_app(char* appname, char* pkgname)
  ************************************************************/
 char* get_installed_applist()
 {
-    static std::string list = "[]";
-    ConnectSocket<cn::kylinos::kmre::kmrecore::GetInstalledAppList, \
-                cn::kylinos::kmre::kmrecore::InstalledAppList> connectSocket(eLink_Launcher);
-    
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::GetInstalledAppList obj;
-        obj.set_include_hide_app(true);
-        if (connectSocket.sendData(std::move(obj), 5)) {
-            cn::kylinos::kmre::kmrecore::InstalledAppList data;
-            if (connectSocket.readData(data)) {
-                if (data.size() > 1) {//size is a member variable of InstalledAppList
-                    list = "[";
-                    for (int n = 0; n < data.item_size(); n++) {
-                        auto app = data.item(n);//InstalledAppItem
-                        if(n > 0){
-                            list += ",";
-                        }
-                        list += "{\"app_name\":\"";
-                        list += app.app_name();
-
-                        list += "\",\"package_name\":\"";
-                        list += app.package_name();
-
-                        list += "\",\"version_name\":\"";
-                        list += app.version_name();
-                        list += "\"}";
-                    }
-                    list += "]";
-
-                    return const_cast<char *>(list.c_str());
+    static thread_local std::string list = "[]";
+    cn::kylinos::kmre::kmrecore::InstalledAppList data;
+
+    if (fetch_installed_applist(data)) {
+        if (data.size() > 1) {//size is a member variable of InstalledAppList
+            list = "[";
+            for (int n = 0; n < data.item_size(); n++) {
+                auto app = data.item(n);//InstalledAppItem
+                if(n > 0){
+                    list += ",";
                 }
+                list += "{\"app_name\":\"";
+                list += app.app_name();
+
+                list += "\",\"package_name\":\"";
+                list += app.package_name();
+
+                list += "\",\"version_name\":\"";
+                list += app.version_name();
+                list += "\"}";
             }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return const_cast<char *>(list.c_str());
+            list += "]";
         }
     }
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
     return const_cast<char *>(list.c_str());
 }
 
 /***********************************************************
-   Function:       get_running_applist
-   Description:    获取正在运行的应用列表
+   Function:       kmre_installed_apps_since
+   Description:    获取自某一版本(generation)以来已安装应用列表的变化
    Calls:
    Called By:
    Input:
-   Output:
+        generation: 上一次调用返回的generation，首次调用传0
+   Output:  返回json格式的字符串:
+        {"generation":N,"reset":false,"added":[...],"updated":[...],"removed":["包名",...]}
+        added/updated中每项包含 app_name, package_name, version_code, version_name
    Return:
-   Others:          head: 0006   （保证返回值的格式为[],方便管理端程序对其转换为json进行解析      strdup）
+   Others:  head: 0005   reset为true时added为全部应用，调用者需重建列表
+            返回值在本线程下一次调用前有效
  ************************************************************/
-char* get_running_applist()
+char* kmre_installed_apps_since(unsigned long long generation)
 {
-    static std::string list = "[]";
-    ConnectSocket<cn::kylinos::kmre::kmrecore::GetRunningAppList, \
-                cn::kylinos::kmre::kmrecore::RunningAppList> connectSocket(eLink_Launcher);
-    
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::GetRunningAppList obj;
-        obj.set_with_thumbnail(true);
-        if (connectSocket.sendData(std::move(obj), 6)) {
-            cn::kylinos::kmre::kmrecore::RunningAppList data;
-            if (connectSocket.readData(data)) {
-                if (data.size() > 0) {//size is a member variable of RunningAppList
-                    list = "[";
-                    for (int n = 0; n < data.item_size(); n++) {
-                        auto app = data.item(n);//RunningAppItem
-                        if(n > 0){
-                            list += ",";
-                        }
-                        list += "{\"app_name\":\"";
-                        list += app.app_name();
-
-                        list += "\",\"package_name\":\"";
-                        list += app.package_name();
-                        list += "\"}";
-                    }
-                    list += "]";
-
-                    return const_cast<char *>(list.c_str());
-                }
+    static thread_local std::string result;
+    cn::kylinos::kmre::kmrecore::InstalledAppList data;
+
+    if (!fetch_installed_applist(data)) {
+        KMRE_LOG(LOG_ERR, "[%s] Refresh installed app list failed, use local snapshot!", __func__);
+    }
+
+    InstalledAppDelta delta = InstalledAppSnapshot::getInstance().changesSince(generation);
+    auto appendApps = [](std::string &out, const std::vector<InstalledAppInfo> &apps) {
+        out += "[";
+        for (size_t n = 0; n < apps.size(); n++) {
+            if (n > 0) {
+                out += ",";
             }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return const_cast<char *>(list.c_str());
+            out += "{\"app_name\":";
+            append_json_string(out, apps[n].appName);
+            out += ",\"package_name\":";
+            append_json_string(out, apps[n].packageName);
+            out += ",\"version_code\":";
+            out += std::to_string(apps[n].versionCode);
+            out += ",\"version_name\":";
+            append_json_string(out, apps[n].versionName);
+            out += "}";
         }
+        out += "]";
+    };
+
+    result = "{\"generation\":" + std::to_string(delta.generation);
+    result += delta.reset ? ",\"reset\":true" : ",\"reset\":false";
+    result += ",\"added\":";
+    appendApps(result, delta.added);
+    result += ",\"updated\":";
+    appendApps(result, delta.updated);
+    result += ",\"removed\":[";
+    for (size_t n = 0; n < delta.removed.size(); n++) {
+        if (n > 0) {
+            result += ",";
+        }
+        append_json_string(result, delta.removed[n]);
     }
+    result += "]}";
 
-    syslog(LOG_ERR, "[%s] Send data failed!", __func__);
-    return const_cast<char *>(list.c_str());
+    return const_cast<char *>(result.c_str());
 }
 
 /***********************************************************
-   Function:       send_clipboard
-   Description:    将kylin桌面的剪切板数据发送给android
+   Function:       get_running_applist
+   Description:    获取正在运行的应用列表
    Calls:
    Called By:
    Input:
    Output:
    Return:
-   Others:          head: 0007
+   Others:          head: 0006   （保证返回值的格式为[],方便管理端程序对其转换为json进行解析      strdup）
  ************************************************************/
-bool send_clipboard(char *content)
+char* get_running_applist()
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::SetClipboard> connectSocket(eLink_Manager);
+    static thread_local std::string list = "[]";
+    cn::kylinos::kmre::kmrecore::RunningAppList data;
+    bool ok = AppListCache::getInstance().getRunning(data);
+    if (ok && data.size() > 0) {//size is a member variable of RunningAppList
+        list = "[";
+        for (int n = 0; n < data.item_size(); n++) {
+            auto app = data.item(n);//RunningAppItem
+            if(n > 0){
+                list += ",";
+            }
+            list += "{\"app_name\":\"";
+            list += app.app_name();
 
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::SetClipboard obj;
-        obj.set_content(content);
-        if (connectSocket.sendData(std::move(obj), 7)) {
-            return true;
+            list += "\",\"package_name\":\"";
+            list += app.package_name();
+            list += "\"}";
         }
+        list += "]";
+
+        return const_cast<char *>(list.c_str());
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] %s!", __func__, ok ? "No running app" : "Get running app list failed");
+    return const_cast<char *>(list.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_get_installed_applist_stream
+   Description:    流式获取已安装应用列表，每解析完一个应用回调一次
+   Calls:
+   Called By:
+   Input:
+        callback: 每个应用调用一次，在本线程中执行
+        user_data: 回调参数
+   Output:
+   Return:  应用个数，失败时返回-1(之前可能已回调了部分应用)
+   Others:  head: 0005  不等待整个回复，内存占用与单个应用相当；共享快照有效时直接从快照中解析。
+            不更新kmre_installed_apps_since使用的本地快照
+ ************************************************************/
+int kmre_get_installed_applist_stream(InstalledAppCallback callback, void *user_data)
+{
+    if (!callback) {
+        return -1;
+    }
+
+    cn::kylinos::kmre::kmrecore::GetInstalledAppList obj;
+    obj.set_include_hide_app(true);
+    return stream_app_list<cn::kylinos::kmre::kmrecore::GetInstalledAppList, cn::kylinos::kmre::kmrecore::InstalledAppItem>(
+        eAppCache_Installed, obj, cn::kylinos::kmre::kmrecore::InstalledAppList::kItemFieldNumber,
+        [&](int index, const cn::kylinos::kmre::kmrecore::InstalledAppItem &app) {
+            callback(index, app.app_name().c_str(), app.package_name().c_str(), app.version_name().c_str(), user_data);
+        });
+}
+
+/***********************************************************
+   Function:       kmre_get_running_applist_stream
+   Description:    流式获取运行中的应用列表，每解析完一个应用回调一次
+   Calls:
+   Called By:
+   Input:
+        callback: 每个应用调用一次，在本线程中执行
+        user_data: 回调参数
+   Output:
+   Return:  应用个数，失败时返回-1
+   Others:  head: 0006  同kmre_get_installed_applist_stream
+ ************************************************************/
+int kmre_get_running_applist_stream(RunningAppCallback callback, void *user_data)
+{
+    if (!callback) {
+        return -1;
+    }
+
+    cn::kylinos::kmre::kmrecore::GetRunningAppList obj;
+    obj.set_with_thumbnail(true);
+    return stream_app_list<cn::kylinos::kmre::kmrecore::GetRunningAppList, cn::kylinos::kmre::kmrecore::RunningAppItem>(
+        eAppCache_Running, obj, cn::kylinos::kmre::kmrecore::RunningAppList::kItemFieldNumber,
+        [&](int index, const cn::kylinos::kmre::kmrecore::RunningAppItem &app) {
+            callback(index, app.app_name().c_str(), app.package_name().c_str(), user_data);
+        });
+}
+
+/***********************************************************
+   Function:       kmre_files_list_stream
+   Description:    逐个读取EventSequence中FilesList的文件，不构造整个FilesList
+   Calls:
+   Called By:
+   Input:
+        data: 安卓发来的EventSequence序列化后的数据
+        len: 数据长度
+        callback: 每个文件调用一次，在本线程中执行
+        user_data: 回调参数
+   Output:
+        type: 可为nullptr，FilesList的类型 0:全量dump 1:插入 2:删除
+   Return:  文件个数，没有FilesList或数据格式错误时返回-1
+   Others:  不更新本地媒体索引，需要时另外调用kmre_event_dispatch
+ ************************************************************/
+int kmre_files_list_stream(const char *data, int len, FileItemCallback callback, void *user_data, int *type)
+{
+    const char *listData = nullptr;
+    int listLen = 0;
+    if (!callback || !find_event_field(data, len, EventTraits<cn::kylinos::kmre::kmrecore::FilesList>::kField,
+                                       listData, listLen)) {
+        return -1;
+    }
+
+    cn::kylinos::kmre::kmrecore::FilesList envelope;
+    int count = 0;
+    std::function<bool(const cn::kylinos::kmre::kmrecore::SingleFile&)> onItem =
+        [&](const cn::kylinos::kmre::kmrecore::SingleFile &file) {
+            callback(count++, file.data().c_str(), file.mime_type().c_str(), user_data);
+            return true;
+        };
+    if (!parse_list_stream(listData, listLen, cn::kylinos::kmre::kmrecore::FilesList::kItemFieldNumber,
+                           envelope, onItem)) {
+        return -1;
+    }
+    if (type) {
+        *type = envelope.type();
+    }
+    return count;
+}
+
+/***********************************************************
+   Function:       kmre_app_cache_enable
+   Description:    打开或关闭已安装/运行中应用列表的跨进程缓存
+   Calls:
+   Called By:
+   Input:
+        enable: true为打开
+   Output:
+   Return:
+   Others:  默认打开，环境变量 KMRE_APP_CACHE=0 时关闭。同一用户的各进程共享
+            $XDG_RUNTIME_DIR(没有时为/tmp)下的快照文件，只读映射到各进程中；快照无效时只有一个进程向容器请求，
+            其余进程等待其写入后直接读取。容器重启、本库发出的安装/卸载/启动/关闭命令成功，
+            以及分发到LaunchResult/CloseResult/UpdatePackageStatus事件时快照失效
+ ************************************************************/
+void kmre_app_cache_enable(bool enable)
+{
+    AppListCache::getInstance().setEnabled(enable);
+}
+
+/***********************************************************
+   Function:       kmre_app_cache_set_max_age
+   Description:    设置快照的最长有效时间
+   Calls:
+   Called By:
+   Input:
+        installed_ms: 已安装应用列表，默认60000，小于0时不修改
+        running_ms: 运行中应用列表，默认2000，小于0时不修改
+   Output:
+   Return:
+   Others:  只影响本进程的判断
+ ************************************************************/
+void kmre_app_cache_set_max_age(int installed_ms, int running_ms)
+{
+    AppListCache::getInstance().setMaxAge(installed_ms, running_ms);
+}
+
+/***********************************************************
+   Function:       kmre_app_cache_invalidate
+   Description:    使所有进程的应用列表快照失效
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:  下一次get_installed_applist/get_running_applist会重新向容器请求
+ ************************************************************/
+void kmre_app_cache_invalidate()
+{
+    AppListCache::getInstance().invalidate(eAppCache_Installed);
+    AppListCache::getInstance().invalidate(eAppCache_Running);
+}
+
+/***********************************************************
+   Function:       kmre_app_cache_stats
+   Description:    获取本进程应用列表缓存的统计
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串，包含命中、等待其他进程刷新后命中、向容器请求及未使用缓存的次数
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_app_cache_stats()
+{
+    static thread_local std::string stats;
+    stats = AppListCache::getInstance().statsJson();
+    return const_cast<char *>(stats.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_singleflight_enable
+   Description:    打开或关闭本进程内相同查询的合并
+   Calls:
+   Called By:
+   Input:
+        enable: true为打开
+   Output:
+   Return:
+   Others:  默认打开。作用于get_installed_applist/get_running_applist(含应用列表缓存需要刷新时)
+            及get_system_prop: 命令、目标容器和参数都相同的并发调用只发出一次请求，其余调用者等待并复制其回复
+ ************************************************************/
+void kmre_singleflight_enable(bool enable)
+{
+    SingleFlight::getInstance().setEnabled(enable);
+}
+
+/***********************************************************
+   Function:       kmre_singleflight_stats
+   Description:    查询合并的统计
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串:
+        {"enabled":true,"leaders":N,"shared":N,"max_waiters":N,"expired":N}
+        leaders为实际发出的请求数，shared为复用其他调用者回复的次数; expired为等待超时后自己发送的次数
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_singleflight_stats()
+{
+    static thread_local std::string result;
+    result = SingleFlight::getInstance().statsJson();
+    return const_cast<char *>(result.c_str());
+}
+
+/***********************************************************
+   Function:       send_clipboard
+   Description:    将kylin桌面的剪切板数据发送给android
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:          head: 0007
+ ************************************************************/
+bool send_clipboard(char *content)
+{
+    cn::kylinos::kmre::kmrecore::SetClipboard obj;
+    obj.set_content(content);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
@@ -681,17 +1026,13 @@ bool send_clipboard(char *content)
  ************************************************************/
 bool focus_win_id(int display_id)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::FocusWin> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::FocusWin obj;
-        obj.set_focus_win(display_id);
-        if (connectSocket.sendData(std::move(obj), 8)) {
-            return true;
-        }
+    cn::kylinos::kmre::kmrecore::FocusWin obj;
+    obj.set_focus_win(display_id);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
@@ -714,22 +1055,18 @@ bool focus_win_id(int display_id)
  ************************************************************/
 bool control_app(int display_id, char *pkgname, int event_type, int event_value)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::ControlApp> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::ControlApp obj;
-        obj.set_display_id(display_id);
-        obj.set_package_name(pkgname);
-        obj.set_event_type(event_type);
-        if (event_value > 0) {
-            obj.set_event_value(event_value);
-        }
-        if (connectSocket.sendData(std::move(obj), 9)) {
-            return true;
-        }
+    cn::kylinos::kmre::kmrecore::ControlApp obj;
+    obj.set_display_id(display_id);
+    obj.set_package_name(pkgname);
+    obj.set_event_type(event_type);
+    if (event_value > 0) {
+        obj.set_event_value(event_value);
+    }
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
@@ -745,18 +1082,14 @@ bool control_app(int display_id, char *pkgname, int event_type, int event_value)
  ************************************************************/
 bool insert_file(char *path, char *mime_type)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::InsertFile> connectSocket(eLink_Manager);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::InsertFile obj;
-        obj.set_data(path);
-        obj.set_mime_type(mime_type);
-        if (connectSocket.sendData(std::move(obj), 10)) {
-            return true;
-        }
+    cn::kylinos::kmre::kmrecore::InsertFile obj;
+    obj.set_data(path);
+    obj.set_mime_type(mime_type);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
@@ -772,18 +1105,14 @@ bool insert_file(char *path, char *mime_type)
  ************************************************************/
 bool remove_file(char *path, char *mime_type)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::RemoveFile> connectSocket(eLink_Manager);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::RemoveFile obj;
-        obj.set_data(path);
-        obj.set_mime_type(mime_type);
-        if (connectSocket.sendData(std::move(obj), 11)) {
-            return true;
-        }
+    cn::kylinos::kmre::kmrecore::RemoveFile obj;
+    obj.set_data(path);
+    obj.set_mime_type(mime_type);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
@@ -804,285 +1133,1151 @@ bool remove_file(char *path, char *mime_type)
  ************************************************************/
 bool request_media_files(int type)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::RequestMediaFiles> connectSocket(eLink_Manager);
+    ConnectSocket<cn::kylinos::kmre::kmrecore::RequestMediaFiles> connectSocket;
 
     if (connectSocket.connect()) {
         cn::kylinos::kmre::kmrecore::RequestMediaFiles obj;
         obj.set_type(type);
-        if (connectSocket.sendData(std::move(obj), 12)) {
+        // dump页可能在sendData返回前到达，须先订阅并登记类别; 发送失败时撤销，不留下等待中的dump
+        MediaIndex &index = MediaIndex::getInstance();
+        bool pinned = index.pin();
+        index.expectDump(type);
+        if (connectSocket.sendData(obj)) {
             return true;
         }
+        index.expectDump(0);
+        if (pinned) {
+            index.unpin();
+        }
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
     return false;
 }
 
 /***********************************************************
-   Function:       request_drag_file
-   Description:    拖动文件到安卓应用里
+   Function:       kmre_media_index_apply_files_list
+   Description:    将安卓发来的FilesList(序列化数据)应用到本地媒体索引
    Calls:
    Called By:
    Input:
+        data: FilesList序列化后的数据
+        len: 数据长度
    Output:
+        true: 执行成功
+        false: 数据解析失败
    Return:
-   Others:  head: 0013
+   Others:  FilesList type 0:dump(可分多页) 1:插入 2:删除
  ************************************************************/
-bool request_drag_file(const char *path, const char *pkg, int display_id, bool has_double_display)
+bool kmre_media_index_apply_files_list(const char *data, int len)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::DragFile> connectSocket(eLink_Manager);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::DragFile obj;
-        obj.set_file_path(path);
-        obj.set_package_name(pkg);
-        obj.set_display_id(display_id);
-        obj.set_has_double_display(has_double_display);
-        if (connectSocket.sendData(std::move(obj), 13)) {
-            return true;
-        }
+    if (!data || len < 0) {
+        return false;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return false;
+    cn::kylinos::kmre::kmrecore::FilesList list;
+    if (!list.ParseFromArray(data, len)) {
+        KMRE_LOG(LOG_ERR, "[%s] Parse FilesList failed!", __func__);
+        return false;
+    }
+    return MediaIndex::getInstance().applyFilesList(list);
 }
 
 /***********************************************************
-   Function:       rotation_changed
-   Description:    窗口方向发生了变化(横、竖、方)
+   Function:       kmre_media_index_apply_event
+   Description:    从EventSequence(序列化数据)中取出FilesList并更新本地媒体索引
    Calls:
    Called By:
    Input:
-        display_id:ID, 如 5001
-        pkgname:包名, 如 com.tencent.mm
-        width:窗口宽度, 如 450
-        height:窗口高度, 如 800
-        rotation:包名，如 0表示竖向   1表示横向     2表示方型
+        data: EventSequence序列化后的数据
+        len: 数据长度
    Output:
+        true: 包含FilesList且更新成功
+        false: 解析失败或不包含FilesList
    Return:
-   Others:  head: 0014
+   Others:  只解析所需的子消息，其余子消息直接跳过
  ************************************************************/
-bool rotation_changed(int display_id, char *pkgname, int width, int height, int rotation)
+bool kmre_media_index_apply_event(const char *data, int len)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::RotationChanged> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::RotationChanged obj;
-        obj.set_display_id(display_id);
-        obj.set_package_name(pkgname);
-        obj.set_width(width);
-        obj.set_height(height);
-        obj.set_rotation(rotation);
-        if (connectSocket.sendData(std::move(obj), 14)) {
-            return true;
-        }
+    if (!data || len < 0) {
+        return false;
     }
 
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return false;
+    cn::kylinos::kmre::kmrecore::FilesList list;
+    if (!decode_event_field(data, len, list)) {
+        return false;
+    }
+    return MediaIndex::getInstance().applyFilesList(list);
 }
 
 /***********************************************************
-   Function:       set_system_prop
-   Description:    设置Android属性
+   Function:       kmre_event_dispatch
+   Description:    分发安卓发来的EventSequence，同时更新启动耗时统计及display记录; 本地媒体索引只在
+                   媒体监视运行、全量比较进行中或调用过request_media_files(直到kmre_media_index_clear)时更新
    Calls:
    Called By:
    Input:
-        event_type:属性类型, 0：prop属性，1：setting属性
-        prop_name:属性名称
-        prop_value:属性值
+        data: EventSequence序列化后的数据
+        len: 数据长度
    Output:
-   Return:
-   Others:  head: 0015
+   Return:  交给订阅者的子消息个数，数据格式错误时返回-1
+   Others:  只扫描字段标签，没有订阅者的子消息(如大的FilesList)直接跳过，不拷贝也不解析;
+            使用本接口时不需要再调用各个 *_apply_event 接口
  ************************************************************/
-bool set_system_prop(int event_type, char *prop_name, char *prop_value)
+int kmre_event_dispatch(const char *data, int len)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::SetSystemProp> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::SetSystemProp obj;
-        obj.set_event_type(event_type);
-        obj.set_value_field(prop_name);
-        obj.set_value(prop_value);
-        if (connectSocket.sendData(std::move(obj), 15)) {
-            return true;
-        }
-    }
-
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return false;
+    return EventDispatcher::getInstance().dispatch(data, len);
 }
 
 /***********************************************************
-   Function:       get_system_prop
-   Description:    获取Android属性
+   Function:       kmre_event_subscribe
+   Description:    订阅EventSequence中的一种子消息
    Calls:
    Called By:
    Input:
-        event_type:属性类型, 0：prop属性，1：setting属性
-        prop_name:属性名称
+        field: 子消息在EventSequence中的字段编号，如 1:Notification 3:LaunchResult 8:FilesList
+        callback: 在kmre_event_dispatch的调用线程中执行，参数为子消息序列化后的数据
+        user_data: 回调参数
    Output:
-   Return:
-   Others:  head: 0016
+   Return:  订阅id(大于0)，参数无效时返回-1
+   Others:
  ************************************************************/
-char *get_system_prop(int event_type, char *prop_name)
+int kmre_event_subscribe(int field, EventCallback callback, void *user_data)
 {
-    static std::string value;
-    ConnectSocket<cn::kylinos::kmre::kmrecore::GetSystemProp, \
-                    cn::kylinos::kmre::kmrecore::SendSystemProp> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::GetSystemProp obj;
-        obj.set_event_type(event_type);
-        obj.set_value_field(prop_name);
-        connectSocket.setTimeout();
-        if (connectSocket.sendData(std::move(obj), 16)) {
-            cn::kylinos::kmre::kmrecore::SendSystemProp data;
-            if (connectSocket.readData(data)) {
-                if ((data.event_type() == event_type) && (data.value_field() == prop_name)) {
-                    value = data.value();
-                    return (char*)(value.c_str());
-                }
-            }
-            syslog(LOG_ERR, "[%s] Read data failed!", __func__);
-            return nullptr;
-        }
+    if (!callback) {
+        return -1;
     }
-
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return nullptr;
+    return EventDispatcher::getInstance().subscribe(field, [callback, user_data](int field, const char *data, int len) {
+        callback(field, data, len, user_data);
+    });
 }
 
 /***********************************************************
-   Function:       update_app_window_size
-   Description:    更新App窗口大小
+   Function:       kmre_event_unsubscribe
+   Description:    取消订阅
    Calls:
    Called By:
    Input:
-        pkgName: app包名
-        display_id: display id
-        width: 宽度值
-        height: 高度值
+        id: kmre_event_subscribe返回的订阅id
    Output:
+        true: 执行成功
+        false: id不存在
    Return:
-   Others:  head: 0017
+   Others:
  ************************************************************/
-int update_app_window_size(const char* pkg_name, int display_id, int width, int height)
+bool kmre_event_unsubscribe(int id)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::UpdateAppWindowSize> connectSocket(eLink_Launcher);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::UpdateAppWindowSize obj;
-        obj.set_package_name(pkg_name);
-        obj.set_display_id(display_id);
-        obj.set_width(width);
-        obj.set_height(height);
-        if (connectSocket.sendData(std::move(obj), 17)) {
-            return 0;
-        }
-    }
-
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return -1;
+    return EventDispatcher::getInstance().unsubscribe(id);
 }
 
 /***********************************************************
-   Function:       update_network_proxy
-   Description:    更新网络代理
+   Function:       kmre_event_stats
+   Description:    获取事件分发统计
    Calls:
    Called By:
    Input:
-        enable: 打开/关闭
-        protocal: 协议类型，包括（http，https，ftp，socks）
-        host: 主机域名/ip
-        port: 端口号
-   Output:
+   Output:  返回json格式的字符串，包含事件数、格式错误数、跳过的字节数及每种子消息的订阅者数、分发数和跳过数
    Return:
-   Others:  head: 0018
+   Others:  返回值在本线程下一次调用前有效
  ************************************************************/
-int update_network_proxy(bool enable, const char* protocal, const char* host, int port)
+char *kmre_event_stats()
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::SetProxy> connectSocket(eLink_Manager);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::SetProxy obj;
-        obj.set_open(enable);
-        obj.set_host(host);
-        obj.set_port(port);
-        obj.set_type(protocal);
-        if (connectSocket.sendData(std::move(obj), 18)) {
-            return 0;
-        }
-    }
-
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return -1;
+    static thread_local std::string stats;
+    stats = EventDispatcher::getInstance().statsJson();
+    return const_cast<char *>(stats.c_str());
 }
 
 /***********************************************************
-   Function:       update_display_size
-   Description:    动态更新display大小,用于平板模式切换或屏幕分辨率改变时
+   Function:       kmre_media_index_lookup
+   Description:    查询安卓媒体库中是否有该文件
    Calls:
    Called By:
    Input:
-        display_id: display id
-        width: 宽度值
-        height: 高度值
+        path: 文件路径
    Output:
+        文件的mime类型，不存在时返回nullptr
    Return:
-   Others:  head: 0019
+   Others:  返回值在本线程下一次调用前有效
  ************************************************************/
-int update_display_size(int display_id, int width, int height)
+const char *kmre_media_index_lookup(const char *path)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::UpdateDisplaySize> connectSocket(eLink_Launcher);
+    static thread_local std::string mimeType;
 
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::UpdateDisplaySize obj;
-        obj.set_display_id(display_id);
-        obj.set_width(width);
-        obj.set_height(height);
-        if (connectSocket.sendData(std::move(obj), 19)) {
-            return 0;
-        }
+    if (!path) {
+        return nullptr;
     }
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return -1;
+    if (MediaIndex::getInstance().lookup(path, mimeType)) {
+        return mimeType.c_str();
+    }
+    return nullptr;
 }
 
 /***********************************************************
-   Function:       answer_call
-   Description:    消息通知接听/拒收
+   Function:       kmre_media_index_count
+   Description:    获取本地媒体索引中某一mime类型的文件数
    Calls:
    Called By:
    Input:
-        answer: 接听
+        mime_type: mime类型，如 image/png，为nullptr时返回文件总数
    Output:
    Return:
-   Others:  head: 0020
+   Others:
  ************************************************************/
-int answer_call(bool answer)
+int kmre_media_index_count(const char *mime_type)
 {
-    ConnectSocket<cn::kylinos::kmre::kmrecore::AnswerCall> connectSocket(eLink_Manager);
-
-    if (connectSocket.connect()) {
-        cn::kylinos::kmre::kmrecore::AnswerCall obj;
-        obj.set_answer(answer);
-        if (connectSocket.sendData(std::move(obj), 20)) {
-            return 0;
-        }
-    }
-
-    syslog(LOG_ERR, "[%s] Send cmd data failed!", __func__);
-    return -1;
+    return static_cast<int>(MediaIndex::getInstance().count(mime_type ? mime_type : ""));
 }
 
 /***********************************************************
-   Function:       is_debian_package_installed
-   Description:    deb包是否安装
+   Function:       kmre_media_index_list
+   Description:    获取本地媒体索引中某一mime类型的文件路径列表
    Calls:
    Called By:
    Input:
-   Output:
+        mime_type: mime类型，为nullptr时返回全部文件
+   Output:  返回json格式的字符串数组
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_media_index_list(const char *mime_type)
+{
+    static thread_local std::string list;
+    std::vector<std::string> paths = MediaIndex::getInstance().list(mime_type ? mime_type : "");
+
+    list = "[";
+    for (size_t n = 0; n < paths.size(); n++) {
+        if (n > 0) {
+            list += ",";
+        }
+        append_json_string(list, paths[n]);
+    }
+    list += "]";
+
+    return const_cast<char *>(list.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_media_index_clear
+   Description:    清空本地媒体索引
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_media_index_clear()
+{
+    MediaIndex::getInstance().clear();
+}
+
+// 去掉目录末尾的'/'，跳过NULL
+static std::vector<std::string> normalize_dirs(const char **dirs, int count)
+{
+    std::vector<std::string> dirList;
+    for (int n = 0; n < count; n++) {
+        if (dirs[n]) {
+            std::string dir = dirs[n];
+            while (dir.size() > 1 && dir.back() == '/') {
+                dir.pop_back();
+            }
+            dirList.push_back(dir);
+        }
+    }
+    return dirList;
+}
+
+/***********************************************************
+   Function:       kmre_media_watcher_start
+   Description:    监听主机目录，文件增删时自动同步到安卓媒体库
+   Calls:
+   Called By:
+   Input:
+        dirs: 需要监听的目录(含子目录)
+        count: 目录个数
+   Output:
+        true: 执行成功
+        false: 执行失败
+   Return:
+   Others:  短时间内的多次变化会去重合并，再通过 head: 0010/0011 批量发送
+ ************************************************************/
+bool kmre_media_watcher_start(const char **dirs, int count)
+{
+    if (!dirs || count <= 0) {
+        return false;
+    }
+
+    return MediaWatcher::getInstance().start(normalize_dirs(dirs, count));
+}
+
+/***********************************************************
+   Function:       kmre_media_reconcile
+   Description:    全量比较主机目录与安卓媒体库，只补发缺少的和删除多余的记录
+   Calls:
+   Called By:
+   Input:
+        dirs: 主机目录(含子目录)
+        count: 目录个数
+        threads: 扫描线程数，小于等于0时为4
+        dump_timeout_ms: 等待安卓媒体库dump的时间，小于0时不请求dump，直接使用本地索引
+        callback: 进度回调，可为nullptr，在本线程中调用
+            stage 0:扫描目录(done为已扫描目录数) 1:等待dump 2:删除 3:插入(done/total为已发送/需发送个数) 4:结束
+        user_data: 回调参数
+   Output:
+   Return:  返回json格式的统计结果，包含是否全部发送成功、扫描的目录数、双方文件数、需插入/删除及已发送的个数和各阶段耗时;
+            请求dump失败或dump页持续到达直到超时时返回nullptr; 超时前没有收到任何dump页时按安卓媒体库为空处理，
+            全部补发并在结果中置empty_dump
+   Others:  head: 0012 0010 0011
+            dump由安卓通过EventSequence发回，调用方需要在其他线程中继续调用kmre_event_dispatch(或
+            kmre_media_index_apply_event)，dump在500毫秒内没有新页时视为结束; 返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_media_reconcile(const char **dirs, int count, int threads, int dump_timeout_ms,
+                           ReconcileCallback callback, void *user_data)
+{
+    if (!dirs || count <= 0) {
+        return nullptr;
+    }
+
+    ReconcileOptions options;
+    options.threads = threads;
+    options.dumpTimeoutMs = dump_timeout_ms;
+
+    ReconcileResult result;
+    if (!reconcile_media(normalize_dirs(dirs, count), options, callback, user_data, result)) {
+        return nullptr;
+    }
+
+    static thread_local std::string json;
+    json = result.toJson();
+    return const_cast<char *>(json.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_media_watcher_stop
+   Description:    停止监听，并发送尚未发送的文件变化
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_media_watcher_stop()
+{
+    MediaWatcher::getInstance().stop();
+}
+
+/***********************************************************
+   Function:       kmre_media_watcher_set_options
+   Description:    设置文件监听参数，超出取值范围的参数保持原值
+   Calls:
+   Called By:
+   Input:
+        debounce_ms: 最后一次文件变化后等待多久再发送，默认500ms; 可为0(不等待)，小于0时忽略
+        max_pending: 待发送记录上限，达到上限立即发送，默认4096; 小于等于0时忽略
+        max_inflight: 发送时同时在途的连接数，默认16; 小于等于0时忽略
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_media_watcher_set_options(int debounce_ms, int max_pending, int max_inflight)
+{
+    MediaWatcher::getInstance().setOptions(debounce_ms, max_pending, max_inflight);
+}
+
+/***********************************************************
+   Function:       request_drag_file
+   Description:    拖动文件到安卓应用里
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:  head: 0013
+ ************************************************************/
+bool request_drag_file(const char *path, const char *pkg, int display_id, bool has_double_display)
+{
+    cn::kylinos::kmre::kmrecore::DragFile obj;
+    obj.set_file_path(path);
+    obj.set_package_name(pkg);
+    obj.set_display_id(display_id);
+    obj.set_has_double_display(has_double_display);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return false;
+}
+
+/***********************************************************
+   Function:       rotation_changed
+   Description:    窗口方向发生了变化(横、竖、方)
+   Calls:
+   Called By:
+   Input:
+        display_id:ID, 如 5001
+        pkgname:包名, 如 com.tencent.mm
+        width:窗口宽度, 如 450
+        height:窗口高度, 如 800
+        rotation:包名，如 0表示竖向   1表示横向     2表示方型
+   Output:
+   Return:
+   Others:  head: 0014   过滤开启时(见kmre_display_registry_set_suppress)与上次经socket成功发出的参数相同时直接返回，不再发送
+ ************************************************************/
+bool rotation_changed(int display_id, char *pkgname, int width, int height, int rotation)
+{
+    DisplayRegistry &registry = DisplayRegistry::getInstance();
+    if (registry.isRedundantRotation(display_id, pkgname, width, height, rotation)) {
+        return true;
+    }
+
+    cn::kylinos::kmre::kmrecore::RotationChanged obj;
+    obj.set_display_id(display_id);
+    obj.set_package_name(pkgname);
+    obj.set_width(width);
+    obj.set_height(height);
+    obj.set_rotation(rotation);
+    bool viaRing = false;
+    if (send_command(obj, &viaRing) == eCommand_Ok) {
+        if (!viaRing) {
+            registry.onRotationSent(display_id, pkgname, width, height, rotation);
+        }
+        return true;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return false;
+}
+
+/***********************************************************
+   Function:       set_system_prop
+   Description:    设置Android属性
+   Calls:
+   Called By:
+   Input:
+        event_type:属性类型, 0：prop属性，1：setting属性
+        prop_name:属性名称
+        prop_value:属性值
+   Output:
+   Return:
+   Others:  head: 0015
+ ************************************************************/
+bool set_system_prop(int event_type, char *prop_name, char *prop_value)
+{
+    cn::kylinos::kmre::kmrecore::SetSystemProp obj;
+    obj.set_event_type(event_type);
+    obj.set_value_field(prop_name);
+    obj.set_value(prop_value);
+    if (send_command(obj) == eCommand_Ok) {
+        return true;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return false;
+}
+
+/***********************************************************
+   Function:       get_system_prop
+   Description:    获取Android属性
+   Calls:
+   Called By:
+   Input:
+        event_type:属性类型, 0：prop属性，1：setting属性
+        prop_name:属性名称
+   Output:
+   Return:
+   Others:  head: 0016  与本进程中同时进行的相同查询合并为一次请求
+ ************************************************************/
+char *get_system_prop(int event_type, char *prop_name)
+{
+    static thread_local std::string value;
+    cn::kylinos::kmre::kmrecore::GetSystemProp obj;
+    obj.set_event_type(event_type);
+    obj.set_value_field(prop_name);
+    cn::kylinos::kmre::kmrecore::SendSystemProp data;
+    CommandStatus status = send_command_shared(obj, data);// 收发超时2秒，见命令登记表
+    if (status == eCommand_Ok && (data.event_type() == event_type) && (data.value_field() == prop_name)) {
+        value = data.value();
+        return (char*)(value.c_str());
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] %s data failed!", __func__, (status == eCommand_SendFailed) ? "Send cmd" : "Read");
+    return nullptr;
+}
+
+/***********************************************************
+   Function:       update_app_window_size
+   Description:    更新App窗口大小
+   Calls:
+   Called By:
+   Input:
+        pkgName: app包名
+        display_id: display id
+        width: 宽度值
+        height: 高度值
+   Output:
+   Return:
+   Others:  head: 0017   过滤开启时(见kmre_display_registry_set_suppress)与上次经socket成功发出的参数相同时直接返回，不再发送
+ ************************************************************/
+int update_app_window_size(const char* pkg_name, int display_id, int width, int height)
+{
+    DisplayRegistry &registry = DisplayRegistry::getInstance();
+    if (registry.isRedundantWindowSize(display_id, pkg_name, width, height)) {
+        return 0;
+    }
+
+    cn::kylinos::kmre::kmrecore::UpdateAppWindowSize obj;
+    obj.set_package_name(pkg_name);
+    obj.set_display_id(display_id);
+    obj.set_width(width);
+    obj.set_height(height);
+    bool viaRing = false;
+    if (send_command(obj, &viaRing) == eCommand_Ok) {
+        if (!viaRing) {
+            registry.onWindowSizeSent(display_id, pkg_name, width, height);
+        }
+        return 0;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return -1;
+}
+
+/***********************************************************
+   Function:       update_network_proxy
+   Description:    更新网络代理
+   Calls:
+   Called By:
+   Input:
+        enable: 打开/关闭
+        protocal: 协议类型，包括（http，https，ftp，socks）
+        host: 主机域名/ip
+        port: 端口号
+   Output:
+   Return:
+   Others:  head: 0018
+ ************************************************************/
+int update_network_proxy(bool enable, const char* protocal, const char* host, int port)
+{
+    cn::kylinos::kmre::kmrecore::SetProxy obj;
+    obj.set_open(enable);
+    obj.set_host(host);
+    obj.set_port(port);
+    obj.set_type(protocal);
+    if (send_command(obj) == eCommand_Ok) {
+        return 0;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return -1;
+}
+
+/***********************************************************
+   Function:       update_display_size
+   Description:    动态更新display大小,用于平板模式切换或屏幕分辨率改变时
+   Calls:
+   Called By:
+   Input:
+        display_id: display id
+        width: 宽度值
+        height: 高度值
+   Output:
+   Return:
+   Others:  head: 0019   过滤开启时(见kmre_display_registry_set_suppress)与上次经socket成功发出的参数相同时直接返回，不再发送
+ ************************************************************/
+int update_display_size(int display_id, int width, int height)
+{
+    DisplayRegistry &registry = DisplayRegistry::getInstance();
+    if (registry.isRedundantDisplaySize(display_id, width, height)) {
+        return 0;
+    }
+
+    cn::kylinos::kmre::kmrecore::UpdateDisplaySize obj;
+    obj.set_display_id(display_id);
+    obj.set_width(width);
+    obj.set_height(height);
+    bool viaRing = false;
+    if (send_command(obj, &viaRing) == eCommand_Ok) {
+        if (!viaRing) {
+            registry.onDisplaySizeSent(display_id, width, height);
+        }
+        return 0;
+    }
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return -1;
+}
+
+/***********************************************************
+   Function:       answer_call
+   Description:    消息通知接听/拒收
+   Calls:
+   Called By:
+   Input:
+        answer: 接听
+   Output:
+   Return:
+   Others:  head: 0020
+ ************************************************************/
+int answer_call(bool answer)
+{
+    cn::kylinos::kmre::kmrecore::AnswerCall obj;
+    obj.set_answer(answer);
+    if (send_command(obj) == eCommand_Ok) {
+        return 0;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return -1;
+}
+
+/***********************************************************
+   Function:       kmre_get_app_stats
+   Description:    获取安卓内应用的cpu、内存占用及前后台状态
+   Calls:
+   Called By:
+   Input:
+        pkgname: 应用包名，为nullptr或空字符串时返回所有运行中的应用
+        stats: 结果数组，可为nullptr(只返回个数)
+        max_count: stats的元素个数
+   Output:
+        stats: 按pss从大到小排列，超出max_count的应用不填写
+   Return:  应用个数(可能大于max_count)，失败时返回-1
+   Others:  head: 0022  已通过kmre_set_app_stats_push打开推送且最近一次推送未过期(两个推送间隔)时
+            直接使用推送的数据，不再请求安卓
+ ************************************************************/
+int kmre_get_app_stats(const char *pkgname, KmreAppStats *stats, int max_count)
+{
+    const std::string package = pkgname ? pkgname : "";
+    std::vector<KmreAppStats> entries;
+
+    if (!AppStatsTable::getInstance().freshPushed(package, entries)) {
+        cn::kylinos::kmre::kmrecore::GetAppStats obj;
+        if (!package.empty()) {
+            obj.set_package_name(package);
+        }
+        cn::kylinos::kmre::kmrecore::AppStatsList data;
+        CommandStatus status = send_command(obj, data);// 收发超时2秒，见命令登记表
+        if (status != eCommand_Ok) {
+            KMRE_LOG(LOG_ERR, "[%s] %s data failed!", __func__, (status == eCommand_SendFailed) ? "Send cmd" : "Read");
+            return -1;
+        }
+        if (package.empty()) {
+            AppStatsTable::getInstance().update(data, false);
+        }
+        AppStatsTable::toEntries(data, package, 0, entries);
+    }
+
+    if (stats && max_count > 0) {
+        std::copy_n(entries.begin(), std::min(static_cast<size_t>(max_count), entries.size()), stats);
+    }
+    return static_cast<int>(entries.size());
+}
+
+/***********************************************************
+   Function:       kmre_set_app_stats_push
+   Description:    让安卓定时推送应用资源占用，避免轮询
+   Calls:
+   Called By:
+   Input:
+        interval_ms: 推送间隔(毫秒)，0为停止推送
+   Output:
+   Return:  true: 发送成功
+   Others:  head: 0023  推送的AppStatsList随EventSequence到达，调用方需把事件数据交给kmre_event_dispatch，
+            也可用kmre_event_subscribe订阅(字段15)自行处理
+ ************************************************************/
+bool kmre_set_app_stats_push(int interval_ms)
+{
+    cn::kylinos::kmre::kmrecore::SetAppStatsPush obj;
+    obj.set_interval_ms(interval_ms > 0 ? interval_ms : 0);
+    if (send_command(obj) == eCommand_Ok) {
+        AppStatsTable::getInstance().setPushInterval(interval_ms);
+        return true;
+    }
+
+    KMRE_LOG(LOG_ERR, "[%s] Send cmd data failed!", __func__);
+    return false;
+}
+
+/***********************************************************
+   Function:       kmre_app_stats_dump
+   Description:    应用资源占用推送及查询的统计
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串:
+        {"push_interval_ms":N,"pushes":N,"queries":N,"push_hits":N,"last_push_age_ms":N,
+         "timestamp_ms":N,"apps":N,"mem_total_kb":N,"mem_available_kb":N}
+        还没有收到过数据时没有timestamp_ms及之后的字段，没有推送过时last_push_age_ms为-1
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_app_stats_dump()
+{
+    static thread_local std::string result;
+    result = AppStatsTable::getInstance().statsJson();
+    return const_cast<char *>(result.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_display_registry_apply_event
+   Description:    从EventSequence(序列化数据)中取出LaunchResult/CloseResult并更新本地display记录
+   Calls:
+   Called By:
+   Input:
+        data: EventSequence序列化后的数据
+        len: 数据长度
+   Output:
+        true: 包含LaunchResult或CloseResult
+        false: 解析失败或不包含这两种结果
+   Return:
+   Others:  新启动的窗口会清除该display之前记录的参数，之后的更新总会发出
+ ************************************************************/
+bool kmre_display_registry_apply_event(const char *data, int len)
+{
+    if (!data || len < 0) {
+        return false;
+    }
+
+    bool applied = false;
+    cn::kylinos::kmre::kmrecore::LaunchResult launchResult;
+    if (decode_event_field(data, len, launchResult)) {
+        DisplayRegistry::getInstance().onLaunchResult(launchResult);
+        applied = true;
+    }
+    cn::kylinos::kmre::kmrecore::CloseResult closeResult;
+    if (decode_event_field(data, len, closeResult)) {
+        DisplayRegistry::getInstance().onCloseResult(closeResult);
+        applied = true;
+    }
+    return applied;
+}
+
+/***********************************************************
+   Function:       kmre_display_package
+   Description:    查询display上显示的应用，不需要与安卓通信
+   Calls:
+   Called By:
+   Input:
+        display_id: display id
+   Output:  包名，未知时返回nullptr
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_display_package(int display_id)
+{
+    static thread_local std::string pkgname;
+    if (!DisplayRegistry::getInstance().packageOnDisplay(display_id, pkgname)) {
+        return nullptr;
+    }
+    return const_cast<char *>(pkgname.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_display_registry_dump
+   Description:    获取本地记录的display及窗口状态
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串，包含各display上的应用、窗口大小、密度、全屏标志、
+            最近一次发出的方向/窗口大小/display大小，以及被跳过的更新数
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_display_registry_dump()
+{
+    static thread_local std::string dump;
+    dump = DisplayRegistry::getInstance().toJson();
+    return const_cast<char *>(dump.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_display_registry_set_suppress
+   Description:    打开/关闭重复窗口更新的过滤
+   Calls:
+   Called By:
+   Input:
+        enable: false时每次更新都会发出
+   Output:
+   Return:
+   Others:  默认只在本进程收到过该容器的LaunchResult/CloseResult事件(kmre_event_dispatch或
+            kmre_display_registry_apply_event)后过滤，调用本接口后以enable为准;
+            只有经socket发出的更新才会被记录，经控制通道发出的更新不作为过滤依据
+ ************************************************************/
+void kmre_display_registry_set_suppress(bool enable)
+{
+    DisplayRegistry::getInstance().setSuppressEnabled(enable);
+}
+
+/***********************************************************
+   Function:       kmre_display_registry_clear
+   Description:    清空本地记录的display状态
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:  只清空本线程当前选中容器的记录; 安卓环境重启后应调用，避免按旧状态跳过更新
+ ************************************************************/
+void kmre_display_registry_clear()
+{
+    DisplayRegistry::getInstance().clear();
+}
+
+/***********************************************************
+   Function:       kmre_user_open
+   Description:    打开任意用户的安卓容器(用于以root运行的管理程序)
+   Calls:
+   Called By:
+   Input:
+        uid: 用户id
+        user: 用户名，为nullptr时根据uid查询
+   Output:
+   Return:  容器句柄(大于0)，失败返回-1
+   Others:  容器socket路径解析后缓存在句柄中，同一容器重复打开返回同一句柄
+ ************************************************************/
+int kmre_user_open(unsigned int uid, const char *user)
+{
+    return open_container_target(static_cast<uid_t>(uid), user ? user : "");
+}
+
+/***********************************************************
+   Function:       kmre_user_close
+   Description:    关闭kmre_user_open打开的容器句柄
+   Calls:
+   Called By:
+   Input:
+        handle: 容器句柄
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_user_close(int handle)
+{
+    close_container_target(handle);
+}
+
+/***********************************************************
+   Function:       kmre_user_select
+   Description:    选择本线程之后调用的接口所访问的容器
+   Calls:
+   Called By:
+   Input:
+        handle: 容器句柄，小于等于0时恢复为本进程用户的容器
+   Output:
+        true: 执行成功
+        false: 句柄无效
+   Return:
+   Others:  只影响调用线程
+ ************************************************************/
+bool kmre_user_select(int handle)
+{
+    return select_container_target(handle);
+}
+
+/***********************************************************
+   Function:       kmre_users_request
+   Description:    向多个容器发送同一条命令，由一个线程通过epoll(或io_uring)并发处理
+   Calls:
+   Called By:
+   Input:
+        handles: 容器句柄数组，句柄为0表示本进程用户的容器
+        count: 句柄个数
+        cmd: 命令编号(head)，如 5 表示 GetInstalledAppList
+        payload: 序列化后的KmreCore消息
+        payload_len: 消息长度
+        callback: 每个容器完成时的回调，reply为序列化后的回复消息(无回复的命令为空)
+        user_data: 回调参数
+   Output:
+   Return:  成功的个数
+   Others:  回调在调用线程中执行
+ ************************************************************/
+int kmre_users_request(const int *handles, int count, int cmd, const char *payload, int payload_len,
+                       TargetReplyCallback callback, void *user_data)
+{
+    if (!handles || count <= 0 || (!payload && payload_len > 0) || payload_len < 0) {
+        return 0;
+    }
+
+    const SocketLink link = link_of_command(cmd);
+    const bool hasReply = command_has_reply(cmd);
+    std::vector<PipelineRequest> requests;
+    std::vector<int> requestIndex;
+    requests.reserve(count);
+
+    for (int n = 0; n < count; n++) {
+        std::string path;
+        if (!get_target_socket_path(handles[n], link, path)) {
+            KMRE_LOG(LOG_ERR, "[%s] Invalid handle: %d", __func__, handles[n]);
+            if (callback) {
+                callback(n, handles[n], false, nullptr, 0, user_data);
+            }
+            continue;
+        }
+
+        requests.emplace_back();
+        PipelineRequest &req = requests.back();
+        req.socketPath = path;
+        req.index = cmd;
+        req.link = link;
+        req.expectReply = hasReply;
+        req.payload.assign(payload ? payload : "", payload_len);
+        requestIndex.push_back(n);
+    }
+
+    return run_pipeline(requests, USERS_MAX_INFLIGHT, USERS_TIMEOUT_MS, [&](size_t index, PipelineRequest &req) {
+        if (callback) {
+            int n = requestIndex[index];
+            callback(n, handles[n], req.ok, req.reply.data(), static_cast<int>(req.reply.size()), user_data);
+        }
+    });
+}
+
+/***********************************************************
+   Function:       kmre_set_io_backend
+   Description:    选择批量请求(批量安装/卸载、媒体同步、多用户请求)使用的I/O后端
+   Calls:
+   Called By:
+   Input:
+        backend: 0:epoll 1:io_uring
+   Output:
+        true: 设置成功
+        false: 参数错误，或内核不支持io_uring(此时仍使用epoll)
+   Return:
+   Others:  默认值取自环境变量KMRE_IO_BACKEND(epoll/uring)，未设置时为epoll
+ ************************************************************/
+bool kmre_set_io_backend(int backend)
+{
+    if (backend != eIoBackend_Epoll && backend != eIoBackend_Uring) {
+        return false;
+    }
+
+    set_io_backend(static_cast<IoBackend>(backend));
+    return backend == eIoBackend_Epoll || uring_available();
+}
+
+/***********************************************************
+   Function:       kmre_get_io_backend
+   Description:    获取批量请求实际使用的I/O后端
+   Calls:
+   Called By:
+   Input:
+   Output:  0:epoll 1:io_uring
+   Return:
+   Others:
+ ************************************************************/
+int kmre_get_io_backend()
+{
+    return (get_io_backend() == eIoBackend_Uring && uring_available()) ? eIoBackend_Uring : eIoBackend_Epoll;
+}
+
+/***********************************************************
+   Function:       kmre_control_ring_enable
+   Description:    开启或关闭共享内存控制通道
+   Calls:
+   Called By:
+   Input:
+        enable: true开启，false关闭
+   Output:
+   Return:
+   Others:  开启后focus_win_id、control_app、rotation_changed、update_app_window_size、
+            update_display_size 首次调用时在后台线程通过 head: 0021 与launcher协商memfd环形缓冲区，
+            协商完成前仍走socket，之后写入缓冲区并按需用eventfd唤醒对端; 服务端不支持时
+            (关闭连接、不回复或回复失败)该launcher不再协商，缓冲区满或消息过大时也走socket;
+            对端超过2秒没有心跳时放弃控制通道; 本进程有发往launcher的socket命令进行中时也走socket，
+            socket命令开始前先等控制通道中已写入的命令被取走，保持两者的先后顺序
+ ************************************************************/
+void kmre_control_ring_enable(bool enable)
+{
+    ControlRingManager::getInstance().setEnabled(enable);
+}
+
+/***********************************************************
+   Function:       kmre_scheduler_set_limits
+   Description:    设置批量命令(安装、卸载、媒体文件同步等)的调度上限
+   Calls:
+   Called By:
+   Input:
+        max_bulk_inflight: 同时在途的批量命令数，<=0时不修改，默认4
+        max_bulk_queue: 排队等待的批量命令数上限，<0时不修改，默认64; 同步接口超过时只记录告警并继续等待，
+                        流水线及媒体监听达到上限时不再排队，请求以EBUSY失败(媒体监听放回待发送表并退避)
+   Output:
+   Return:
+   Others:  交互命令(启动、焦点、控制等)不受限制，且在途时批量命令暂停发出;
+            名额只覆盖连接和发送，等待回复时不占用; 流水线接口(批量安装、卸载、多用户请求等)同样受上限约束
+ ************************************************************/
+void kmre_scheduler_set_limits(int max_bulk_inflight, int max_bulk_queue)
+{
+    RequestScheduler::getInstance().setLimits(max_bulk_inflight, max_bulk_queue);
+}
+
+/***********************************************************
+   Function:       kmre_scheduler_stats
+   Description:    获取请求调度状态
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串，包含交互/批量命令的在途数、排队数、同步接口超过排队上限的次数(over_queue)、
+            流水线因排队已满被拒绝的次数(rejected)及排队等待时间分布(毫秒)
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_scheduler_stats()
+{
+    static thread_local std::string stats;
+    stats = RequestScheduler::getInstance().statsJson();
+    return const_cast<char *>(stats.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_log_set_level
+   Description:    设置日志输出级别
+   Calls:
+   Called By:
+   Input:
+        level: syslog优先级(LOG_ERR=3 ... LOG_DEBUG=7)，高于该级别的日志直接丢弃
+   Output:
+   Return:
+   Others:  默认级别为LOG_DEBUG(与原来一样输出全部日志)，也可通过环境变量KMRE_LOG_LEVEL设置
+ ************************************************************/
+void kmre_log_set_level(int level)
+{
+    log_set_level(level);
+}
+
+/***********************************************************
+   Function:       kmre_log_flush
+   Description:    等待后台线程把已缓存的日志写入syslog
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:  最多等待100毫秒
+ ************************************************************/
+void kmre_log_flush()
+{
+    log_flush();
+}
+
+/***********************************************************
+   Function:       kmre_log_stats
+   Description:    获取日志统计
+   Calls:
+   Called By:
+   Input:
+   Output:  返回json格式的字符串，包含当前级别、已写入、队列满丢弃及限速抑制的条数
+   Return:
+   Others:  返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_log_stats()
+{
+    static thread_local std::string stats;
+    stats = log_stats_json();
+    return const_cast<char *>(stats.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_trace_enable
+   Description:    打开或关闭请求span的记录
+   Calls:
+   Called By:
+   Input:
+        enable: true为打开
+   Output:
+   Return:
+   Others:  默认关闭，也可以设置环境变量 KMRE_TRACE=1 打开;
+            每个ConnectSocket操作(resolve/schedule/connect/serialize/write/read/parse)及整个命令各记录一个span，
+            包含线程id、命令编号及字节数，保存在各线程的环形缓冲区中，每个线程保留最近1024个
+ ************************************************************/
+void kmre_trace_enable(bool enable)
+{
+    trace_set_enabled(enable);
+}
+
+/***********************************************************
+   Function:       kmre_trace_dump
+   Description:    导出已记录的span
+   Calls:
+   Called By:
+   Input:
+   Output:  返回Chrome Trace Event格式的json字符串，可在chrome://tracing或Perfetto UI中打开
+   Return:
+   Others:  时间戳为CLOCK_MONOTONIC微秒，可与同一时钟的合成器、窗口管理器trace对齐;
+            返回值在本线程下一次调用前有效
+ ************************************************************/
+char *kmre_trace_dump()
+{
+    static thread_local std::string trace;
+    trace = trace_chrome_json();
+    return const_cast<char *>(trace.c_str());
+}
+
+/***********************************************************
+   Function:       kmre_trace_dump_to_file
+   Description:    将已记录的span写入文件
+   Calls:
+   Called By:
+   Input:
+        path: 文件路径
+   Output:
+        true: 执行成功
+        false: 执行失败
+   Return:
+   Others:  格式同kmre_trace_dump，先写临时文件再改名
+ ************************************************************/
+bool kmre_trace_dump_to_file(const char *path)
+{
+    if (!path || !*path) {
+        return false;
+    }
+    return trace_dump_to_file(path);
+}
+
+/***********************************************************
+   Function:       kmre_trace_dump_on_signal
+   Description:    收到指定信号时导出已记录的span
+   Calls:
+   Called By:
+   Input:
+        signo: 信号，如SIGUSR2
+        dir: 导出目录，文件名为 kmre-trace-<pid>-<序号>.json
+   Output:
+        true: 执行成功
+        false: 执行失败
+   Return:
+   Others:  会替换该信号原有的处理函数; 导出在后台线程中进行，重复调用只更新目录
+ ************************************************************/
+bool kmre_trace_dump_on_signal(int signo, const char *dir)
+{
+    if (!dir || !*dir) {
+        return false;
+    }
+    return trace_dump_on_signal(signo, dir);
+}
+
+/***********************************************************
+   Function:       kmre_trace_clear
+   Description:    清除已记录的span
+   Calls:
+   Called By:
+   Input:
+   Output:
+   Return:
+   Others:
+ ************************************************************/
+void kmre_trace_clear()
+{
+    trace_clear();
+}
+
+/***********************************************************
+   Function:       is_debian_package_installed
+   Description:    deb包是否安装
+   Calls:
+   Called By:
+   Input:
+   Output:
         true: 已经安装
         false: 未安装
    Return:
@@ -1120,6 +2315,46 @@ bool is_deb_package_installed(const char *pkg)
     return false;
 }
 
+/***********************************************************
+   Function:       kmre_wait_ready
+   Description:    等待安卓环境启动完成，launcher和manager均可正常服务时返回
+   Calls:
+   Called By:
+   Input:
+        timeout_ms: 最长等待时间(毫秒)，小于0时一直等待，0时只检查一次
+   Output:
+        true: 已就绪
+        false: 超时
+   Return:
+   Others:  sockets目录无变化时阻塞在inotify上，不轮询；socket文件出现后各做一次连接握手。
+            等待的是本线程当前选中的容器
+ ************************************************************/
+bool kmre_wait_ready(int timeout_ms)
+{
+    return wait_container_ready(get_socket_path(eLink_Launcher), get_socket_path(eLink_Manager), timeout_ms);
+}
+
+/***********************************************************
+   Function:       kmre_wait_ready_async
+   Description:    在后台线程中等待安卓环境启动完成，结果通过回调通知
+   Calls:
+   Called By:
+   Input:
+        timeout_ms: 同kmre_wait_ready
+        callback: 就绪或超时后在后台线程中调用，ready为是否就绪，elapsed_ms为等待耗时
+        user_data: 回调参数
+   Output:
+        true: 已开始等待
+        false: 创建线程失败
+   Return:
+   Others:  等待的容器在调用时确定，之后切换容器不影响本次等待
+ ************************************************************/
+bool kmre_wait_ready_async(int timeout_ms, ReadyCallback callback, void *user_data)
+{
+    return wait_container_ready_async(get_socket_path(eLink_Launcher), get_socket_path(eLink_Manager),
+                                      timeout_ms, callback, user_data);
+}
+
 /***********************************************************
    Function:       is_android_env_installed
    Description:    安卓兼容环境是否安装